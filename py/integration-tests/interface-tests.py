@@ -4,6 +4,7 @@ import sys
 import time
 
 from viaems.testcase import TestCase
+from viaems.events import FeedDecoder
 
 def _leaves_have_types(obj):
     if type(obj) == dict:
@@ -44,7 +45,7 @@ class ViaemsInterfaceTests(TestCase):
         assert(outputs[0]['_type'] == 'output')
 
         sensors = result['response']['sensors']
-        assert(len(sensors) == 12)
+        assert(len(sensors) == 14)
         assert(sensors['iat']['_type'] == 'sensor')
 
     def test_structure_types(self):
@@ -59,6 +60,22 @@ class ViaemsInterfaceTests(TestCase):
         assert(_leaves_have_descriptions(output))
         assert(_leaves_have_types(output))
 
+    def test_structure_cached(self):
+        result = self.conn.structure()
+        assert(result['success'])
+        again = self.conn.structure()
+        self.assertEqual(result['hash'], again['hash'])
+        self.assertEqual(result['response'], again['response'])
+        self.assertEqual(result['types'], again['types'])
+
+        unchanged = self.conn.structure(hash=result['hash'])
+        assert(unchanged['success'])
+        assert(unchanged['unchanged'])
+        assert("response" not in unchanged)
+
+        changed = self.conn.structure(hash=result['hash'] ^ 1)
+        self.assertEqual(result['response'], changed['response'])
+
     def test_get_full(self):
         result = self.conn.get(path=[])
         assert(result['success'])
@@ -72,6 +89,21 @@ class ViaemsInterfaceTests(TestCase):
         assert(type(sensors['map']['method']) == str)
         assert(type(sensors['map']['range-min']) == float)
 
+    def test_get_chunked(self):
+        self.conn.send({"id": 7, "type": "request", "method": "get",
+                        "path": []})
+        chunks = []
+        for attempt in range(1000):
+            msg = self.conn.recv()
+            if msg.get('id') == 7:
+                chunks.append(msg)
+                if not msg['more']:
+                    break
+
+        assert(len(chunks) > 1)
+        assert([c['chunk'] for c in chunks] == list(range(len(chunks))))
+        assert(all(c['success'] for c in chunks))
+
     def test_get_all_subpaths(self):
         full = self.conn.get(path=[])['response']
 
@@ -116,6 +148,31 @@ class ViaemsInterfaceTests(TestCase):
         assert(self.conn.get(path=["sensors", "iat", "range-max"])['response'] == 25.0)
         assert(self.conn.get(path=["sensors", "map", "range-max"])['response'] == 26.0)
 
+    def test_set_fault_debounce_clamped(self):
+        result = self.conn.set(path=["sensors", "iat"], value={
+            "fault-debounce-window": 4,
+            "fault-debounce-count": 10,
+        })
+        assert(result['success'])
+        assert(result['response']['fault-debounce-count'] == 4)
+
+        # Shrinking the window shrinks the count with it
+        self.conn.set(path=["sensors", "iat", "fault-debounce-window"],
+                      value=2)
+        result = self.conn.get(path=["sensors", "iat", "fault-debounce-count"])
+        assert(result['response'] == 2)
+
+    def test_sensor_faults(self):
+        result = self.conn.request("sensor-faults")
+        assert(result['success'])
+        faults = result['response']
+        assert(len(faults) == 12)
+        assert(set(faults['vss'].keys()) ==
+               {"active", "total", "longest-us", "last"})
+
+        # Runtime state is kept out of the config
+        assert("sensor-faults" not in self.conn.get(path=[])['response'])
+
     def test_set_array_float(self):
         result = self.conn.set(path=[], value={
             "outputs": [
@@ -195,6 +252,157 @@ class ViaemsInterfaceTests(TestCase):
                                        [700, 800, 900],
                                        ])
 
+    def test_ve_learn(self):
+        ve = self.conn.get(path=["tables", "ve"])['response']
+
+        result = self.conn.request("ve-learn")
+        assert(result['success'])
+        learned = result['response']
+        assert(learned['samples'] == 0)
+        assert(learned['ve'] == ve['data'])
+        assert(len(learned['hits']) == len(ve['data']))
+        assert(learned['confidence'][0][0] == 0.0)
+
+        # Nothing has been learned, so nothing is committed
+        result = self.conn.request("ve-learn-commit")
+        assert(result['success'])
+        assert(result['response'] == 0)
+
+        assert(self.conn.request("ve-learn-reset")['success'])
+
+    def test_tasks(self):
+        result = self.conn.request("tasks")
+        assert(result['success'])
+        tasks = result['response']
+        assert(set(tasks.keys()) == {"fuel-pump", "boost", "idle", "cel", "fan"})
+        assert(tasks["boost"]["period"] == 10)
+        assert(tasks["boost"]["max-ns"] >= tasks["boost"]["last-ns"])
+
+    span_names = {"decoder", "sensors", "buffer-swap", "reschedule", "tasks",
+                  "calculations", "schedule", "plan"}
+
+    def test_spans(self):
+        result = self.conn.request("spans")
+        if not result['success']:
+            # Not built with SPANS=1
+            return
+        spans = result['response']
+        assert(spans["cycle-ps"] > 0)
+
+        for name, start, end in spans["spans"]:
+            assert(name in self.span_names)
+            assert(((end - start) & 0xffffffff) < 0x80000000)
+
+    def test_stats(self):
+        self.conn.sleep(0.5)
+        result = self.conn.request("stats", reset=True)
+        assert(result['success'])
+        stats = result['response']
+        assert(stats.pop("cycle-ps") > 0)
+        assert(set(stats.keys()) == self.span_names)
+        swap = stats["buffer-swap"]
+        assert(swap["count"] > 0)
+        assert(sum(swap["buckets"]) == swap["count"])
+        assert(swap["max-ns"] > 0)
+
+        # Only counted since the reset
+        result = self.conn.request("stats")
+        assert(result['response']["buffer-swap"]["count"] < swap["count"])
+
+    def test_map_windows(self):
+        result = self.conn.request("map-windows", count=2)
+        assert(result['success'])
+        assert(type(result['response']) == list)
+        assert(len(result['response']) <= 2)
+
+    def _recv_feeds(self, count):
+        decoder = FeedDecoder()
+        desc = None
+        feeds = []
+        for attempt in range(1000):
+            msg = self.conn.recv()
+            if msg['type'] == "description":
+                desc = msg
+                decoder.description(msg)
+            elif msg['type'] == "feed" and desc is not None:
+                feeds.append((msg, decoder.values(msg)))
+                if len(feeds) == count:
+                    break
+        return desc, feeds
+
+    def test_feed_packed(self):
+        result = self.conn.request("feed", format="packed")
+        assert(result['success'])
+        assert(result['response']['format'] == "packed")
+
+        desc, feeds = self._recv_feeds(1)
+        msg, values = feeds[0]
+        assert(desc['format'] == "packed")
+        assert(len(msg['packed']) == desc['size'])
+        assert(values['cputime'] == msg['time'])
+        assert(values['sensor.clt'] == 50.0)
+
+        result = self.conn.request("feed", format="cbor")
+        assert(result['response']['format'] == "cbor")
+        assert(not self.conn.request("feed", format="bogus")['success'])
+
+    def test_feed_seq(self):
+        result = self.conn.request("feed", coalesce=True)
+        assert(result['response']['coalesce'])
+
+        desc, feeds = self._recv_feeds(20)
+        # Sequence numbers only skip dropped updates
+        for (prev, _), (msg, _) in zip(feeds, feeds[1:]):
+            assert(msg['seq'] == prev['seq'] + 1 + msg.get('dropped', 0))
+            if 'dropped' in msg:
+                assert(msg['coalesced']['count'] == msg['dropped'])
+
+        result = self.conn.request("feed", coalesce=False)
+        assert(not result['response']['coalesce'])
+
+    def test_feed_delta(self):
+        result = self.conn.request("feed", format="delta")
+        assert(result['response']['format'] == "delta")
+
+        desc, feeds = self._recv_feeds(20)
+        assert(desc['format'] == "delta")
+        assert(feeds[0][0]['keyframe'])
+        for msg, values in feeds:
+            assert(values['cputime'] == msg['time'])
+            assert(values['sensor.clt'] == 50.0)
+        # Unchanging fields are left out
+        assert(sum(len(msg['delta']) for msg, _ in feeds) < 20 * desc['size'])
+
+        self.conn.request("feed", format="cbor")
+
+    def test_subscribe(self):
+        result = self.conn.request("subscribe", keys=["rpm", "sync"])
+        assert(result['success'])
+        fast = result['response']['subscription']
+        result = self.conn.request("subscribe", keys=["sensor.clt"],
+                                   decimation=5)
+        assert(result['success'])
+        slow = result['response']['subscription']
+        assert(not self.conn.request("subscribe", keys=["bogus"])['success'])
+
+        desc, feeds = self._recv_feeds(60)
+        subs = {sub['subscription']: sub for sub in desc['subscriptions']}
+        assert(subs[fast]['keys'] == ["rpm", "sync"])
+        assert(subs[slow]['decimation'] == 5)
+
+        # Each subscription is sent at its own rate, with only its fields
+        fast_feeds = [v for msg, v in feeds if msg['subscription'] == fast]
+        slow_feeds = [v for msg, v in feeds if msg['subscription'] == slow]
+        assert(set(fast_feeds[0].keys()) == {"rpm", "sync"})
+        assert(slow_feeds[0] == {"sensor.clt": 50.0})
+        assert(4 <= len(fast_feeds) / len(slow_feeds) <= 6)
+
+        # The full feed resumes without subscriptions
+        assert(self.conn.request("unsubscribe", subscription=fast)['success'])
+        assert(self.conn.request("unsubscribe")['success'])
+        desc, feeds = self._recv_feeds(1)
+        assert("subscriptions" not in desc)
+        assert('subscription' not in feeds[0][0])
 
 class ConsoleUsageWhileRunning(TestCase):
 
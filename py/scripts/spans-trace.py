@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Reads engine loop spans from a target built with SPANS=1 over the console,
+and writes them as Chrome trace_event JSON, to be opened with chrome://tracing
+or Perfetto. The hosted simulator is run by default, or hardware is read
+through the proxy with --hil"""
+import argparse
+import json
+import sys
+import time
+
+from viaems.connector import HilConnector, SimConnector
+
+# The decoder runs in the trigger interrupt, the sensors in the ADC interrupt,
+# and everything else within the buffer swap
+THREADS = {"decoder": 1, "sensors": 3}
+BUFFER_SWAP_THREAD = 2
+
+
+def read_spans(conn, duration, interval):
+    """Returns the cycle length in picoseconds, the number of spans dropped,
+    and the [name, start, end] spans read over duration seconds"""
+    spans = []
+    end_time = time.time() + duration
+    while True:
+        result = conn.request("spans")
+        if not result or not result["success"]:
+            raise RuntimeError("spans request failed, was the target built "
+                               "with SPANS=1?")
+        response = result["response"]
+        spans.extend(response["spans"])
+        if time.time() >= end_time:
+            return response["cycle-ps"], response["dropped"], spans
+        conn.sleep(interval)
+
+
+def unwrap(spans):
+    """Yields (name, start, end) with 32 bit cycle counts unwrapped to 64 bits.
+    Spans are only roughly in time order, so each start is unwrapped against
+    the previous one"""
+    last = None
+    for name, start, end in spans:
+        if last is None:
+            last = start
+        diff = (start - last) & 0xffffffff
+        if diff >= 0x80000000:
+            diff -= 0x100000000
+        last += diff
+        yield name, last, last + ((end - start) & 0xffffffff)
+
+
+def trace_events(spans, cycle_ps):
+    spans = sorted(unwrap(spans), key=lambda s: s[1])
+    if not spans:
+        return []
+    origin = spans[0][1]
+    us_per_cycle = cycle_ps / 1e6
+    return [
+        {
+            "name": name,
+            "cat": "viaems",
+            "ph": "X",
+            "ts": (start - origin) * us_per_cycle,
+            "dur": (end - start) * us_per_cycle,
+            "pid": 1,
+            "tid": THREADS.get(name, BUFFER_SWAP_THREAD),
+        }
+        for name, start, end in spans
+    ]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("output", help="trace_event JSON file to write")
+    parser.add_argument("--binary", default="obj/hosted/viaems",
+                        help="hosted simulator to run")
+    parser.add_argument("--replay", help="replay file for the simulator")
+    parser.add_argument("--hil", action="store_true",
+                        help="read from hardware through obj/hosted/proxy")
+    parser.add_argument("--duration", type=float, default=5.0,
+                        help="seconds to record for")
+    parser.add_argument("--interval", type=float, default=0.01,
+                        help="seconds between reads of the span ring")
+    args = parser.parse_args()
+
+    if args.hil:
+        conn = HilConnector()
+        conn.start()
+    else:
+        conn = SimConnector(args.binary)
+        conn.start(replay=args.replay)
+
+    try:
+        cycle_ps, dropped, spans = read_spans(conn, args.duration,
+                                              args.interval)
+    finally:
+        conn.kill()
+
+    with open(args.output, "w") as out:
+        json.dump({"traceEvents": trace_events(spans, cycle_ps),
+                   "displayTimeUnit": "ns"}, out)
+    print(f"{len(spans)} spans, {dropped} dropped", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Converts a binary trace from the hosted simulator (-t tracefile) to VCD or
+CSV, chosen by the output file's extension"""
+import argparse
+import csv
+import struct
+import sys
+
+from vcd import VCDWriter
+
+HEADER = struct.Struct("<4sHHII")
+RECORD = struct.Struct("<IBBHII")
+
+TRACE_END, TRIGGER, OUTPUT, GPIO, RESCHEDULE, PLAN = range(6)
+TYPE_NAMES = {TRIGGER: "trigger", OUTPUT: "output", GPIO: "gpio",
+              RESCHEDULE: "reschedule", PLAN: "plan"}
+
+
+def read_trace(path):
+    """Returns the trace's tickrate, and an iterator of (time, type, pin, value,
+    aux) for each record, with times unwrapped to 64 bits"""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, version, record_size, tickrate, _ = HEADER.unpack_from(data, 0)
+    if magic != b"VTRC" or version != 1 or record_size != RECORD.size:
+        raise ValueError(f"{path} is not a version 1 trace")
+
+    n_records = (len(data) - HEADER.size) // RECORD.size
+    body = data[HEADER.size:HEADER.size + n_records * RECORD.size]
+
+    def records():
+        last = 0
+        for time, typ, pin, _, value, aux in RECORD.iter_unpack(body):
+            if typ == TRACE_END:
+                break
+            # Times are 32 bit ticks that wrap, and records are only roughly
+            # in time order, so unwrap against the previous record
+            diff = (time - last) & 0xffffffff
+            if diff >= 0x80000000:
+                diff -= 0x100000000
+            last += diff
+            yield last, typ, pin, value, aux
+
+    return tickrate, records()
+
+
+def write_csv(records, out):
+    writer = csv.writer(out)
+    writer.writerow(["time", "type", "pin", "value", "aux"])
+    for time, typ, pin, value, aux in records:
+        writer.writerow([time, TYPE_NAMES[typ], pin, value, aux])
+
+
+def write_vcd(records, tickrate, out):
+    ns_per_tick = 1e9 / tickrate
+    with VCDWriter(out, timescale="1 ns") as writer:
+        triggers = [writer.register_var("events", f"trigger{i}", "event")
+                    for i in range(2)]
+        outputs = writer.register_var("events", "outputs", "wire", size=16)
+        gpios = writer.register_var("events", "gpios", "wire", size=16)
+        reschedule = writer.register_var("events", "reschedule", "event")
+        plan_events = writer.register_var("plan", "events", "integer", size=32)
+
+        # VCD must be in time order
+        for time, typ, pin, value, aux in sorted(records, key=lambda r: r[0]):
+            ns = int(time * ns_per_tick)
+            if typ == TRIGGER and pin < len(triggers):
+                writer.change(triggers[pin], ns, True)
+            elif typ == OUTPUT:
+                writer.change(outputs, ns, value)
+            elif typ == GPIO:
+                writer.change(gpios, ns, value)
+            elif typ == RESCHEDULE:
+                writer.change(reschedule, ns, True)
+            elif typ == PLAN:
+                writer.change(plan_events, ns, value)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("trace")
+    parser.add_argument("output", help="output .vcd or .csv file")
+    args = parser.parse_args()
+
+    if not args.output.endswith((".csv", ".vcd")):
+        sys.exit("output must be a .vcd or .csv file")
+
+    tickrate, records = read_trace(args.trace)
+    with open(args.output, "w", newline="") as out:
+        if args.output.endswith(".csv"):
+            write_csv(records, out)
+        else:
+            write_vcd(records, tickrate, out)
+
+
+if __name__ == "__main__":
+    main()
@@ -12,25 +12,43 @@ from viaems.vcd import dump_vcd
 from viaems.validation import enrich_log
 from viaems.events import *
 
+def merge_response_chunk(result, chunk):
+    """Large responses are sent in chunks, each with part of the tree"""
+    for key, value in chunk.items():
+        if isinstance(value, dict) and isinstance(result.get(key), dict):
+            merge_response_chunk(result[key], value)
+        elif isinstance(value, list) and isinstance(result.get(key), list):
+            result[key] = result[key] + value
+        else:
+            result[key] = value
+    return result
+
+
 class ViaemsInterface:
     def recv_until_id(self, id, max_messages=1000):
+        response = {}
         while True:
             result = self.recv()
             if isinstance(result, dict) and "id" in result and int(result["id"]) == id:
-                return result
+                merge_response_chunk(response, result)
+                if not result.get("more", False):
+                    return response
             max_messages -= 1
             if max_messages == 0:
                 return None
 
-    def structure(self):
+    def structure(self, hash=None):
+        """If hash is that of the target's structure, only the hash is
+        returned, with unchanged set"""
         id = random.randint(0, 1024)
-        self.send(
-            {
-                "id": id,
-                "type": "request",
-                "method": "structure",
-            }
-        )
+        request = {
+            "id": id,
+            "type": "request",
+            "method": "structure",
+        }
+        if hash is not None:
+            request["hash"] = hash
+        self.send(request)
         result = self.recv_until_id(id)
         return result
 
@@ -61,6 +79,19 @@ class ViaemsInterface:
         result = self.recv_until_id(id)
         return result
 
+    def request(self, method, **params):
+        id = random.randint(0, 1024)
+        self.send(
+            {
+                "id": id,
+                "type": "request",
+                "method": method,
+                **params,
+            }
+        )
+        result = self.recv_until_id(id)
+        return result
+
     def sleep(self, seconds):
         now = time.time()
         while time.time() < now + seconds:
@@ -116,6 +147,10 @@ class SimConnector(ViaemsInterface):
                     adcvals = " ".join([str(v) for v in values])
                     file.write(f"a {delay} {adcvals}\n")
                     render_time = event.time
+                case SimKnockEvent(pin=pin, samples=samples):
+                    knockvals = " ".join([str(v) for v in samples])
+                    file.write(f"k {delay} {pin} {knockvals}\n")
+                    render_time = event.time
                 case SimEndEvent():
                     file.write(f"e {delay}\n")
 
@@ -2,6 +2,7 @@ from dataclasses import dataclass
 from typing import Dict, List
 from copy import copy
 import bisect
+import struct
 
 CaptureTime = int
 ScenarioTime = int
@@ -61,6 +62,11 @@ class SimToothEvent(SimEvent):
 class SimADCEvent(SimEvent):
     values: List[float]
 
+@dataclass
+class SimKnockEvent(SimEvent):
+    pin: int
+    samples: List[float]
+
 @dataclass
 class TargetFeedEvent(TargetEvent):
     values: Dict[str, float]
@@ -141,9 +147,80 @@ class Log(List[Event]):
         gpio_events = self.filter_between(0, time).filter_gpios()
         return gpio_events[-1]
 
+_packed_formats = {"uint32": "<I", "float32": "<f", "bool": "<?"}
+
+def _read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+class FeedDecoder:
+    """Decodes feed messages in any format, following the latest description.
+    Each subscription has its own layout, and the full feed has the layout
+    of the description itself"""
+    def __init__(self, desc_msg=None):
+        self.layouts = {}
+        self.bits = {}
+        if desc_msg is not None:
+            self.description(desc_msg)
+
+    def description(self, desc_msg):
+        if "subscriptions" in desc_msg:
+            self.layouts = {sub["subscription"]: sub
+                            for sub in desc_msg["subscriptions"]}
+        else:
+            self.layouts = {None: desc_msg}
+        self.bits = {}
+
+    def values(self, feed_msg) -> Dict:
+        layout = self.layouts[feed_msg.get("subscription")]
+        if "packed" in feed_msg:
+            packed = feed_msg["packed"]
+            return {name: struct.unpack_from(_packed_formats[type], packed, offset)[0]
+                    for name, type, offset in layout["fields"]}
+        if "delta" in feed_msg:
+            return self._delta_values(layout, feed_msg)
+        return dict(zip(layout["keys"], feed_msg["values"]))
+
+    def _delta_values(self, layout, feed_msg) -> Dict:
+        fields = layout["fields"]
+        sub = feed_msg.get("subscription")
+        bits = self.bits.get(sub, [])
+        if feed_msg.get("keyframe") or len(bits) != len(fields):
+            bits = [0] * len(fields)
+        self.bits[sub] = bits
+
+        data = feed_msg["delta"]
+        pos = (len(fields) + 7) // 8
+        values = {}
+        for i, (name, type, _) in enumerate(fields):
+            if data[i // 8] & (1 << (i % 8)):
+                if type == "bool":
+                    bits[i] ^= 1
+                elif type == "uint32":
+                    zigzag, pos = _read_varint(data, pos)
+                    diff = (zigzag >> 1) ^ -(zigzag & 1)
+                    bits[i] = (bits[i] + diff) & 0xffffffff
+                else:
+                    xored, pos = _read_varint(data, pos)
+                    bits[i] ^= xored
+
+            if type == "bool":
+                values[name] = bool(bits[i])
+            elif type == "float32":
+                values[name] = struct.unpack("<f", struct.pack("<I", bits[i]))[0]
+            else:
+                values[name] = bits[i]
+        return values
+
 def log_from_target_messages(msgs: List[Dict]) -> List[TargetEvent]:
-    desc_msg = next(filter(lambda m: m["type"] == "description", msgs))
-    desc_keys = desc_msg["keys"]
+    decoder = FeedDecoder(next(filter(lambda m: m["type"] == "description", msgs)))
 
     event_seq = None
     def check_seq(msg):
@@ -160,8 +237,10 @@ def log_from_target_messages(msgs: List[Dict]) -> List[TargetEvent]:
         if msg["type"] == "event":
             check_seq(msg)
 
-        if msg["type"] == "feed":
-            values = dict(zip(desc_keys, msg["values"]))
+        if msg["type"] == "description":
+            decoder.description(msg)
+        elif msg["type"] == "feed":
+            values = decoder.values(msg)
             result.append(TargetFeedEvent(time=TargetTime(time), values=values))
         elif msg["type"] == "event" and msg["event"]["type"] == "trigger": 
             result.append(TargetTriggerEvent(time=TargetTime(time),
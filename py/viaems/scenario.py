@@ -38,6 +38,17 @@ class Scenario:
                     ))
 
 
+    def add_knock_samples(self, pin, samples):
+        # Knock sensor samples are fed directly to the goertzel filter, up to
+        # 16 per event
+        for i in range(0, len(samples), 16):
+            self.events.append(
+                    SimKnockEvent(
+                        time=self.time,
+                        pin=pin,
+                        samples=samples[i:i + 16]
+                        ))
+
     def _advance(self, max_delay=None):
         # Advance the simulation. Will return after the next tooth event, or if
         # max_delay is met -- whichever is first
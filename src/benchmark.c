@@ -79,6 +79,40 @@ static uint32_t do_calculation_bench() {
   return end - start;
 }
 
+static uint32_t do_cached_calculation_bench() {
+  static struct config config;
+  config = default_config;
+  config.calculation_cache.enabled = true;
+
+  struct engine_update update = (struct engine_update){
+    .position = {
+      .rpm = 3000,
+      .tooth_rpm = 3000,
+      .valid_until = -1,
+      .has_position = true,
+    },
+    .sensors = {
+      .MAP = { .value = 80.0f },
+      .IAT = { .value = 25.0f },
+      .CLT = { .value = 90.0f },
+      .TPS = { .value = 0.0f, .derivative = 0.0f },
+      .BRV = { .value = 13.8f },
+      .FRT = { .value = 25.0f },
+    },
+    .current_time = 0,
+  };
+
+  struct calculations calcs = { 0 };
+  calculate_ignition_and_fuel(&config, &update, &calcs);
+
+  update.position.rpm += 5;
+  uint64_t start = cycle_count();
+  calculate_ignition_and_fuel(&config, &update, &calcs);
+  uint64_t end = cycle_count();
+
+  return end - start;
+}
+
 static const struct engine_update schedule_bench_update = {
   .position = {
     .rpm = 1000,
@@ -566,6 +600,8 @@ int start_benchmarks() {
 
   report_benchmark("Fuel Calculations",
                    run_benchmark(do_calculation_bench, 1000));
+  report_benchmark("Fuel Calculations (cached)",
+                   run_benchmark(do_cached_calculation_bench, 1000));
   report_benchmark("Sensors - Thermistor",
                    run_benchmark(do_sensor_single_therm, 1000));
   report_benchmark("Sensors - Linear",
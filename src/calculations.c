@@ -3,6 +3,7 @@
 
 #include "calculations.h"
 #include "config.h"
+#include "spsc.h"
 #include "util.h"
 #include "viaems.h"
 
@@ -80,62 +81,255 @@ static float calculate_tipin_enrichment(const struct config *config,
   return state->amount;
 }
 
-struct calculated_values calculate_ignition_and_fuel(
-  const struct config *config,
-  const struct engine_update *update,
-  struct calculations *state) {
+/* X-tau wall film model. A fraction X of injected fuel is deposited on the
+ * port walls, and the film evaporates into the charge with time constant
+ * tau.  The film is stepped once per injection event, and the injected
+ * quantity is corrected so that the fuel delivered to the cylinder matches the
+ * desired quantity. */
+static void calculate_wall_film(const struct config *config,
+                                struct wall_film_state *state,
+                                const struct engine_update *update,
+                                float clt,
+                                float map,
+                                float fuelvol_per_cycle) {
+
+  if (!config->fueling.wall_film) {
+    *state = (struct wall_film_state){ 0 };
+    return;
+  }
+
+  /* A new injection event starts each time the angle wraps past a multiple of
+   * the injection spacing */
+  const uint32_t injections = config->fueling.injections_per_cycle;
+  const degrees_t spacing = 720.0f / injections;
+  degrees_t angle = fmodf(
+    engine_current_angle(&update->position, update->current_time), spacing);
+  bool new_event = !state->initialized || (angle < state->angle);
+  state->angle = angle;
+  if (!new_event) {
+    return;
+  }
+
+  float dt_ms = state->initialized
+                  ? us_from_time(time_diff(update->current_time, state->time)) /
+                      1000.0f
+                  : 0.0f;
+  state->initialized = true;
+  state->time = update->current_time;
+
+  float x = interpolate_table_twoaxis(&config->wall_film_x, clt, map);
+  x = fminf(fmaxf(x, 0.0f), 0.95f);
+  float tau_ms = interpolate_table_twoaxis(&config->wall_film_tau, clt, map);
+
+  float evaporated = state->film;
+  if (tau_ms > 0.0f) {
+    evaporated = state->film * (1.0f - expf(-dt_ms / tau_ms));
+  }
+
+  float desired = fuelvol_per_cycle / injections;
+  float injected = fmaxf((desired - evaporated) / (1.0f - x), 0.0f);
+
+  state->film += (x * injected) - evaporated;
+  state->correction = (injected - desired) * injections;
+}
+
+static bool knock_window_open(const struct config *config,
+                              int output,
+                              degrees_t angle) {
+  const struct knock_control_config *kc = &config->knock_control;
+  if (config->outputs[output].type != IGNITION_EVENT) {
+    return false;
+  }
+  degrees_t since_window_open =
+    clamp_angle(angle - config->outputs[output].angle - kc->window_start, 720);
+  return since_window_open < kc->window_length;
+}
+
+/* Acts on a knock input's block once, if it is new and at or above the
+ * threshold. The block is placed at the angle it was sampled at, as it
+ * completes some time after, and outputs whose window was open then are
+ * retarded */
+static void knock_block_retard(const struct config *config,
+                               struct knock_state *state,
+                               const struct engine_position *position,
+                               const struct knock_value *block,
+                               float threshold,
+                               uint32_t *seq) {
+  if (block->seq == *seq) {
+    return;
+  }
+  *seq = block->seq;
+  if ((threshold <= 0.0f) || (block->value < threshold)) {
+    return;
+  }
 
+  const struct knock_control_config *kc = &config->knock_control;
+  degrees_t angle = engine_current_angle(position, block->time);
+  for (int i = 0; i < MAX_EVENTS; i++) {
+    if (knock_window_open(config, i, angle) && !state->window_knocked[i]) {
+      state->retard[i] =
+        fminf(state->retard[i] + kc->retard_step, kc->max_retard);
+      state->window_knocked[i] = true;
+    }
+  }
+}
+
+/* Per-output knock control. Each completed knock block at or above its
+ * threshold retards the ignition outputs whose knock window was open when it
+ * was sampled by retard_step, at most once per window. Windows may overlap,
+ * such as with a wasted spark output firing every revolution, in which case
+ * knock is credited to every output whose window was open, since it can't be
+ * told which cylinder knocked. Retard is then returned at recovery_rate
+ * degrees per second. */
+static void calculate_knock_retard(const struct config *config,
+                                   struct knock_state *state,
+                                   const struct engine_update *update,
+                                   float retard[MAX_EVENTS]) {
+  const struct knock_control_config *kc = &config->knock_control;
   const struct sensor_values *sensors = &update->sensors;
-  const struct engine_position *pos = &update->position;
-  const float iat = sensors->IAT.value;
-  const float brv = sensors->BRV.value;
-  const float map = sensors->MAP.value;
-  const float frt = sensors->FRT.value;
-  const float clt = sensors->CLT.value;
 
-  const float tps = sensors->TPS.value;
-  const float tpsrate = sensors->TPS.derivative;
+  if (!kc->enabled) {
+    /* Blocks completed while disabled are not acted on later */
+    *state = (struct knock_state){
+      .time = update->current_time,
+      .seq = { sensors->KNK1.seq, sensors->KNK2.seq },
+    };
+    for (int i = 0; i < MAX_EVENTS; i++) {
+      retard[i] = 0.0f;
+    }
+    return;
+  }
+
+  float elapsed_s = (float)time_diff(update->current_time, state->time) /
+                    (float)time_from_us(1000000);
+  state->time = update->current_time;
+  float recovery = kc->recovery_rate * elapsed_s;
+
+  degrees_t angle =
+    engine_current_angle(&update->position, update->current_time);
+  for (int i = 0; i < MAX_EVENTS; i++) {
+    state->retard[i] = fmaxf(state->retard[i] - recovery, 0.0f);
+
+    bool open = knock_window_open(config, i, angle);
+    if (open && !state->window_open[i]) {
+      state->window_knocked[i] = false;
+    }
+    state->window_open[i] = open;
+  }
+
+  knock_block_retard(config,
+                     state,
+                     &update->position,
+                     &sensors->KNK1,
+                     config->sensors.KNK1.threshold,
+                     &state->seq[0]);
+  knock_block_retard(config,
+                     state,
+                     &update->position,
+                     &sensors->KNK2,
+                     config->sensors.KNK2.threshold,
+                     &state->seq[1]);
+
+  for (int i = 0; i < MAX_EVENTS; i++) {
+    retard[i] = state->retard[i];
+  }
+}
+
+/* Returns the per-output trim: the fixed trim plus the rpm/MAP lookup from the
+ * selected trim table, if any */
+static float output_trim(const struct config *config,
+                         const struct calculation_inputs *in,
+                         float trim,
+                         uint32_t table) {
+  if ((table == 0) || (table > MAX_TRIM_TABLES)) {
+    return trim;
+  }
+  const struct table_2d *t = &config->trim_tables[table - 1];
+  if (!table_valid_twoaxis(t)) {
+    return trim;
+  }
+  return trim + interpolate_table_twoaxis(t, in->rpm, in->map);
+}
+
+/* Precompute each output's trims once per calculation, since they only depend
+ * on the slowly changing inputs */
+static void calculate_output_trims(const struct config *config,
+                                   const struct calculation_inputs *in,
+                                   struct calculated_values *values) {
+  for (int i = 0; i < MAX_EVENTS; i++) {
+    const struct output_event_config *oc = &config->outputs[i];
+    values->fuel_trim[i] = 0.0f;
+    values->timing_trim[i] = 0.0f;
+
+    switch (oc->type) {
+    case FUEL_EVENT:
+      values->fuel_trim[i] = fmaxf(
+        output_trim(config, in, oc->fuel_trim, oc->fuel_trim_table), -100.0f);
+      break;
+    case IGNITION_EVENT:
+      values->timing_trim[i] =
+        output_trim(config, in, oc->timing_trim, oc->timing_trim_table);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/* Table lookups and fuel calculations that only depend on the slowly changing
+ * engine inputs, and so can be reused while the inputs are stable */
+static struct calculated_values calculate_values(
+  const struct config *config,
+  const struct calculation_inputs *in,
+  float tipin) {
 
   float timing_advance =
-    interpolate_table_twoaxis(&config->timing, pos->rpm, map);
+    interpolate_table_twoaxis(&config->timing, in->rpm, in->map);
   float dwell_us = 0.0f;
   switch (config->ignition.dwell) {
   case DWELL_FIXED_DUTY:
-    dwell_us = time_from_rpm_diff(pos->rpm, 45) / (TICKRATE / 1000000);
+    dwell_us = time_from_rpm_diff(in->rpm, 45) / (TICKRATE / 1000000);
     break;
   case DWELL_FIXED_TIME:
     dwell_us = config->ignition.dwell_us;
     break;
   case DWELL_BRV:
-    dwell_us = 1000 * interpolate_table_oneaxis(&config->dwell, brv);
+    dwell_us = 1000 * interpolate_table_oneaxis(&config->dwell, in->brv);
     break;
   }
 
-  float ve = interpolate_table_twoaxis(&config->ve, pos->rpm, map);
+  float ve = interpolate_table_twoaxis(&config->ve, in->rpm, in->map);
   float lambda =
-    interpolate_table_twoaxis(&config->commanded_lambda, pos->rpm, map);
-  float idt = interpolate_table_oneaxis(&config->injector_deadtime_offset, brv);
-  float ete = interpolate_table_twoaxis(&config->engine_temp_enrich, clt, map);
+    interpolate_table_twoaxis(&config->commanded_lambda, in->rpm, in->map);
+  float idt =
+    interpolate_table_oneaxis(&config->injector_deadtime_offset, in->brv);
+  float ete =
+    interpolate_table_twoaxis(&config->engine_temp_enrich, in->clt, in->map);
 
   /* Cranking enrichment config overrides ETE */
-  if ((pos->rpm < config->fueling.crank_enrich_config.crank_rpm) &&
-      (clt < config->fueling.crank_enrich_config.cutoff_temperature)) {
+  if ((in->rpm < config->fueling.crank_enrich_config.crank_rpm) &&
+      (in->clt < config->fueling.crank_enrich_config.cutoff_temperature)) {
     ete = config->fueling.crank_enrich_config.enrich_amt;
   }
 
-  float tipin = calculate_tipin_enrichment(
-    config, &state->tipin, update->current_time, tps, tpsrate, pos->rpm);
-
   float airmass_per_cycle =
-    calculate_airmass(config->fueling.cylinder_cc, ve, map, iat);
+    calculate_airmass(config->fueling.cylinder_cc, ve, in->map, in->iat);
 
   float fuel_vol_at_stoich =
     calculate_fuel_volume(config->fueling.density_of_fuel,
                           config->fueling.fuel_stoich_ratio,
                           airmass_per_cycle,
-                          frt);
+                          in->frt);
+
+  /* The long term trim is learned per rpm/MAP cell, so it is looked up along
+   * with the other tables */
+  float ltt = 0.0f;
+  if (config->closed_loop.enabled) {
+    ltt = interpolate_table_twoaxis(&config->lambda_ltt, in->rpm, in->map);
+  }
 
-  float fuelvol_per_cycle = fuel_vol_at_stoich / lambda;
+  float fuelvol_per_cycle =
+    fuel_vol_at_stoich / lambda * (1.0f + (ltt / 100.0f));
 
   float raw_pw_us =
     (fuelvol_per_cycle + (tipin / 1000)) /              /* Tipin unit is mm^3 */
@@ -146,15 +340,7 @@ struct calculated_values calculate_ignition_and_fuel(
                                         raw_pw_us / 1000.0f);
   float commanded_pw_us = (raw_pw_us * ete) + (pwc * 1000.0f) + (idt * 1000.0f);
 
-  bool rpm_cut;
-  if (state->rpm_cut_triggered) {
-    rpm_cut = pos->rpm > config->rpm_start;
-  } else {
-    rpm_cut = pos->rpm > config->rpm_stop;
-  }
-  state->rpm_cut_triggered = rpm_cut;
-
-  timeval_t max_allowable_pw = time_from_rpm_diff(pos->rpm, 720) /
+  timeval_t max_allowable_pw = time_from_rpm_diff(in->rpm, 720) /
                                config->fueling.injections_per_cycle *
                                (config->fueling.max_duty_cycle / 100.0f);
 
@@ -164,7 +350,7 @@ struct calculated_values calculate_ignition_and_fuel(
   }
 
   timeval_t max_allowable_dwell_us =
-    us_from_time(time_from_rpm_diff(pos->rpm, 720) /
+    us_from_time(time_from_rpm_diff(in->rpm, 720) /
                  config->ignition.ignitions_per_cycle) -
     config->ignition.min_coil_cooldown_us;
 
@@ -176,11 +362,7 @@ struct calculated_values calculate_ignition_and_fuel(
     dwell_overduty_cut_enabled = true;
   }
 
-  bool boost_cut = map > config->boost_control.overboost;
-
-  return (struct calculated_values){
-    .rpm_limit_cut = rpm_cut,
-    .boost_cut = boost_cut,
+  struct calculated_values result = {
     .fuel_overduty_cut = fuel_overduty_cut_enabled,
     .dwell_overduty_cut = dwell_overduty_cut_enabled,
 
@@ -193,10 +375,269 @@ struct calculated_values calculate_ignition_and_fuel(
     .pwc = pwc,
     .ve = ve,
     .lambda = lambda,
+    .lambda_ltt = ltt,
     .fuelvol_per_cycle = fuelvol_per_cycle,
     .tipin = tipin,
     .airmass_per_cycle = airmass_per_cycle,
   };
+
+  calculate_output_trims(config, in, &result);
+
+  return result;
+}
+
+/* Convert each output's fuel trim to a pulsewidth from the final fueling, so
+ * that scheduling only has to add them. Deadtime is a property of the
+ * injector, only trim fuel delivered */
+static void apply_fuel_trims(struct calculated_values *values) {
+  float delivered_us =
+    fmaxf(values->fueling_us - (values->idt * 1000.0f), 0.0f);
+  for (int i = 0; i < MAX_EVENTS; i++) {
+    values->fuel_trim_us[i] = delivered_us * values->fuel_trim[i] / 100.0f;
+  }
+}
+
+static bool within_hysteresis(float value, float cached, float hysteresis) {
+  return fabsf(value - cached) < hysteresis;
+}
+
+/* Returns true if every input is within its configured hysteresis of the
+ * inputs the cached values were calculated from */
+static bool calculation_cache_matches(const struct calculation_cache_config *cc,
+                                      const struct calculation_cache *cache,
+                                      const struct calculation_inputs *in) {
+  const struct calculation_inputs *c = &cache->inputs;
+  return cache->valid &&
+         within_hysteresis((float)in->rpm, (float)c->rpm, cc->rpm) &&
+         within_hysteresis(in->map, c->map, cc->map) &&
+         within_hysteresis(in->iat, c->iat, cc->iat) &&
+         within_hysteresis(in->clt, c->clt, cc->clt) &&
+         within_hysteresis(in->brv, c->brv, cc->brv) &&
+         within_hysteresis(in->frt, c->frt, cc->frt) &&
+         within_hysteresis(in->tps, c->tps, cc->tps);
+}
+
+struct calculated_values calculate_ignition_and_fuel(
+  const struct config *config,
+  const struct engine_update *update,
+  struct calculations *state) {
+
+  const struct sensor_values *sensors = &update->sensors;
+  const struct engine_position *pos = &update->position;
+  const struct calculation_cache_config *cc = &config->calculation_cache;
+  struct calculation_cache *cache = &state->cache;
+
+  const struct calculation_inputs inputs = {
+    .rpm = pos->rpm,
+    .map = sensors->MAP.value,
+    .iat = sensors->IAT.value,
+    .clt = sensors->CLT.value,
+    .brv = sensors->BRV.value,
+    .frt = sensors->FRT.value,
+    .tps = sensors->TPS.value,
+  };
+
+  float tipin = 0.0f;
+  if (!config->fueling.wall_film) {
+    tipin = calculate_tipin_enrichment(config,
+                                       &state->tipin,
+                                       update->current_time,
+                                       inputs.tps,
+                                       sensors->TPS.derivative,
+                                       pos->rpm);
+  }
+
+  /* Tipin enrichment changes with time rather than inputs, so bypass the
+   * cache entirely while it is active */
+  struct calculated_values result;
+  if (cc->enabled && (tipin == 0.0f) &&
+      calculation_cache_matches(cc, cache, &inputs)) {
+    result = cache->values;
+    cache->hit_ratio += (1.0f - cache->hit_ratio) / 256.0f;
+  } else {
+    result = calculate_values(config, &inputs, tipin);
+    if (cc->enabled && (tipin == 0.0f)) {
+      cache->inputs = inputs;
+      cache->values = result;
+      cache->valid = true;
+    }
+    cache->hit_ratio -= cache->hit_ratio / 256.0f;
+  }
+
+  /* The short term trim changes with time rather than inputs, apply it to the
+   * fuel delivered, excluding injector dead time and correction */
+  float stt = state->closed_loop.stt;
+  if (stt != 0.0f) {
+    float delivered_us =
+      result.fueling_us - ((result.idt + result.pwc) * 1000.0f);
+    result.fueling_us =
+      fmaxf(result.fueling_us + (delivered_us * stt / 100.0f), 0.0f);
+    result.fuelvol_per_cycle *= 1.0f + (stt / 100.0f);
+  }
+  result.lambda_stt = stt;
+
+  /* The wall film changes with time rather than inputs, so its correction is
+   * applied on top of any cached calculation */
+  calculate_wall_film(config,
+                      &state->wall_film,
+                      update,
+                      inputs.clt,
+                      inputs.map,
+                      result.fuelvol_per_cycle);
+  if (state->wall_film.correction != 0.0f) {
+    float correction_us = state->wall_film.correction /
+                          config->fueling.injector_cc_per_minute * 60000000 /
+                          config->fueling.injections_per_cycle * result.ete;
+    result.wall_film_correction = state->wall_film.correction;
+    result.fueling_us = fmaxf(result.fueling_us + correction_us, 0.0f);
+  }
+  apply_fuel_trims(&result);
+
+  /* Cuts are always evaluated against the current inputs */
+  bool rpm_cut;
+  if (state->rpm_cut_triggered) {
+    rpm_cut = pos->rpm > config->rpm_start;
+  } else {
+    rpm_cut = pos->rpm > config->rpm_stop;
+  }
+  state->rpm_cut_triggered = rpm_cut;
+
+  result.rpm_limit_cut = rpm_cut;
+  result.boost_cut = inputs.map > config->boost_control.overboost +
+                                    config->boost_control.overboost_ramp;
+  calculate_cuts(&config->cuts, update, &result);
+
+  calculate_knock_retard(config, &state->knock, update, result.knock_retard);
+
+  return result;
+}
+
+#define LTT_QUEUE_SIZE 16
+
+/* Long term trim cell change, applied outside of interrupt context */
+struct ltt_update {
+  int row;
+  int col;
+  float amount;
+};
+
+static struct spsc_queue ltt_queue = {
+  .size = LTT_QUEUE_SIZE,
+};
+static struct ltt_update ltt_updates[LTT_QUEUE_SIZE];
+
+/* Move part of the integral trim into the long term trim cell nearest the
+ * current operating point. The cell is only written by
+ * closed_loop_process_ltt, so the integral is reduced by the amount queued */
+static void learn_long_term_trim(const struct config *config,
+                                 struct closed_loop_state *cl,
+                                 float rpm,
+                                 float map) {
+  const struct table_2d *ltt = &config->lambda_ltt;
+  if (!table_valid_twoaxis(ltt)) {
+    return;
+  }
+  const float max = config->closed_loop.max_trim;
+  int col = table_axis_nearest(&ltt->cols, rpm);
+  int row = table_axis_nearest(&ltt->rows, map);
+
+  float old = ltt->data[row][col];
+  float learned = old + (config->closed_loop.learn_rate * cl->integral);
+  learned = fminf(fmaxf(learned, -max), max);
+  if (learned == old) {
+    return;
+  }
+
+  /* If the queue is full the integral is kept to be learned later */
+  int idx = spsc_allocate(&ltt_queue);
+  if (idx < 0) {
+    return;
+  }
+  ltt_updates[idx] = (struct ltt_update){
+    .row = row,
+    .col = col,
+    .amount = learned - old,
+  };
+  spsc_push(&ltt_queue);
+  cl->integral -= learned - old;
+}
+
+void closed_loop_process_ltt(struct config *config,
+                             struct calculations *state) {
+  struct table_2d *ltt = &config->lambda_ltt;
+  const float max = config->closed_loop.max_trim;
+  int idx;
+  while ((idx = spsc_next(&ltt_queue)) >= 0) {
+    struct ltt_update u = ltt_updates[idx];
+    spsc_release(&ltt_queue);
+
+    /* The table may have been resized since the update was queued */
+    if ((u.row >= (int)ltt->rows.num) || (u.col >= (int)ltt->cols.num)) {
+      continue;
+    }
+    float learned = ltt->data[u.row][u.col] + u.amount;
+    ltt->data[u.row][u.col] = fminf(fmaxf(learned, -max), max);
+    state->cache.valid = false;
+  }
+}
+
+void update_closed_loop_lambda(const struct config *config,
+                               const struct engine_update *update,
+                               struct calculations *state) {
+  const struct closed_loop_config *cc = &config->closed_loop;
+  struct closed_loop_state *cl = &state->closed_loop;
+
+  cl->passes++;
+  if (cl->passes < cc->decimation) {
+    return;
+  }
+  cl->passes = 0;
+
+  const struct sensor_values *sensors = &update->sensors;
+  const uint32_t rpm = update->position.rpm;
+  bool tipin = state->tipin.active && (state->tipin.amount > 0.0f);
+  bool conditions =
+    cc->enabled &&
+    engine_position_is_synced(&update->position, update->current_time) &&
+    (rpm >= cc->min_rpm) && (sensors->CLT.value >= cc->min_clt) &&
+    (sensors->EGO.fault == FAULT_NONE) && !tipin;
+
+  if (!conditions) {
+    *cl = (struct closed_loop_state){ 0 };
+    return;
+  }
+
+  /* Fuel changes are only seen by the sensor after the exhaust from the
+   * affected cycles reaches it, so wait that long between each update */
+  timeval_t delay = (cc->delay_cycles * time_from_rpm_diff(rpm, 720)) +
+                    time_from_us(cc->sensor_delay_ms * 1000.0f);
+  if (!cl->active) {
+    cl->active = true;
+    cl->time = update->current_time;
+    return;
+  }
+  if (time_diff(update->current_time, cl->time) < delay) {
+    return;
+  }
+  cl->time = update->current_time;
+
+  const float map = sensors->MAP.value;
+  float lambda = interpolate_table_twoaxis(&config->commanded_lambda, rpm, map);
+  if (lambda <= 0.0f) {
+    return;
+  }
+
+  /* Positive error is lean, and adds fuel */
+  float error = 100.0f * ((sensors->EGO.value / lambda) - 1.0f);
+  cl->integral =
+    fminf(fmaxf(cl->integral + (cc->ki * error), -cc->max_trim), cc->max_trim);
+
+  if (cc->learn) {
+    learn_long_term_trim(config, cl, rpm, map);
+  }
+
+  cl->stt = fminf(fmaxf((cc->kp * error) + cl->integral, -cc->max_trim),
+                  cc->max_trim);
 }
 
 #ifdef UNITTEST
@@ -392,6 +833,450 @@ START_TEST(check_calculate_tipin_overriding_event) {
 }
 END_TEST
 
+/* Completes a new knock block on KNK1, sampled at the current time */
+static void complete_knock_block(struct engine_update *update, float value) {
+  update->sensors.KNK1 = (struct knock_value){
+    .time = update->current_time,
+    .seq = update->sensors.KNK1.seq + 1,
+    .value = value,
+  };
+}
+
+START_TEST(check_knock_retard) {
+  struct config config = {
+    .outputs = {
+      { .type = IGNITION_EVENT, .angle = 0 },
+      { .type = IGNITION_EVENT, .angle = 360 },
+      { .type = FUEL_EVENT, .angle = 20 },
+    },
+    .sensors = { .KNK1 = { .threshold = 10.0f } },
+    .knock_control = {
+      .enabled = true,
+      .window_start = 10,
+      .window_length = 60,
+      .retard_step = 2.0f,
+      .max_retard = 5.0f,
+      .recovery_rate = 1.0f,
+    },
+  };
+  struct knock_state state = { 0 };
+  float retard[MAX_EVENTS];
+
+  /* Knock in first output's window */
+  struct engine_update update = {
+    .position = { .last_trigger_angle = 30 },
+  };
+  complete_knock_block(&update, 20.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 0.0f, 0.001f);
+
+  /* Only one retard step per knock window */
+  update.position.last_trigger_angle = 50;
+  complete_knock_block(&update, 20.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+
+  /* Knock outside of any window is ignored */
+  update.position.last_trigger_angle = 200;
+  complete_knock_block(&update, 20.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 0.0f, 0.001f);
+
+  /* A block is only acted on once, so a window that opens after it has been
+   * seen isn't retarded */
+  update.position.last_trigger_angle = 30;
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+
+  /* Knock in second output's window */
+  update.position.last_trigger_angle = 380;
+  complete_knock_block(&update, 20.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 2.0f, 0.001f);
+
+  /* Repeated knock is limited to max_retard */
+  for (int i = 0; i < 3; i++) {
+    update.position.last_trigger_angle = 30;
+    complete_knock_block(&update, 20.0f);
+    calculate_knock_retard(&config, &state, &update, retard);
+    update.position.last_trigger_angle = 200;
+    calculate_knock_retard(&config, &state, &update, retard);
+  }
+  ck_assert_float_eq_tol(retard[0], 5.0f, 0.001f);
+
+  /* Below threshold, recover at 1 degree per second */
+  update.current_time += time_from_us(1000000);
+  update.position.last_trigger_angle = 30;
+  complete_knock_block(&update, 5.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 4.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 1.0f, 0.001f);
+
+  update.current_time += time_from_us(2000000);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 0.0f, 0.001f);
+
+  /* Disabling knock control removes all retard, and blocks seen while
+   * disabled aren't acted on once enabled */
+  config.knock_control.enabled = false;
+  complete_knock_block(&update, 20.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 0.0f, 0.001f);
+  config.knock_control.enabled = true;
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 0.0f, 0.001f);
+
+  /* Knock in overlapping windows retards every output with its window open,
+   * once per window each */
+  config.outputs[1].angle = 40;
+  update.position.last_trigger_angle = 200;
+  calculate_knock_retard(&config, &state, &update, retard);
+  update.position.last_trigger_angle = 60;
+  complete_knock_block(&update, 20.0f);
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 2.0f, 0.001f);
+
+  /* Output 0's window closes while output 1's stays open */
+  update.position.last_trigger_angle = 80;
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 2.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[2], 0.0f, 0.001f);
+
+  /* Knock is placed at the angle it was sampled at, not where the engine is
+   * when the block completes. At 6000 rpm, 2 ms before 100 degrees is 28
+   * degrees, inside only output 0's window */
+  update.position.last_trigger_angle = 200;
+  calculate_knock_retard(&config, &state, &update, retard);
+  update.position.last_trigger_angle = 30;
+  calculate_knock_retard(&config, &state, &update, retard);
+  update.position = (struct engine_position){
+    .has_position = true,
+    .has_rpm = true,
+    .rpm = 6000,
+    .time = update.current_time,
+    .last_trigger_angle = 100,
+  };
+  calculate_knock_retard(&config, &state, &update, retard);
+  update.sensors.KNK1 = (struct knock_value){
+    .time = update.current_time - time_from_us(2000),
+    .seq = update.sensors.KNK1.seq + 1,
+    .value = 20.0f,
+  };
+  calculate_knock_retard(&config, &state, &update, retard);
+  ck_assert_float_eq_tol(retard[0], 4.0f, 0.001f);
+  ck_assert_float_eq_tol(retard[1], 2.0f, 0.001f);
+}
+END_TEST
+
+START_TEST(check_calculation_cache) {
+  struct config config = default_config;
+  config.calculation_cache.enabled = true;
+  config.calculation_cache.rpm = 50;
+
+  struct calculations state = { 0 };
+  struct engine_update update = {
+    .position = { .valid_until = -1, .has_rpm = true, .rpm = 3000, .tooth_rpm = 3000 },
+    .sensors = {
+      .IAT = { .value = 30 },
+      .BRV = { .value = 14 },
+      .MAP = { .value = 60 },
+      .FRT = { .value = 15 },
+      .CLT = { .value = 85 },
+      .TPS = { .value = 20, .derivative = 0 },
+    },
+  };
+
+  struct calculated_values first =
+    calculate_ignition_and_fuel(&config, &update, &state);
+  ck_assert(state.cache.valid);
+  ck_assert_float_eq(state.cache.hit_ratio, 0.0f);
+
+  /* Within hysteresis, served from the cache */
+  update.position.rpm = 3040;
+  struct calculated_values second =
+    calculate_ignition_and_fuel(&config, &update, &state);
+  ck_assert_float_eq(second.ve, first.ve);
+  ck_assert_int_eq(second.fueling_us, first.fueling_us);
+  ck_assert_int_eq(state.cache.inputs.rpm, 3000);
+  ck_assert_float_gt(state.cache.hit_ratio, 0.0f);
+
+  /* Crossing the rpm hysteresis recalculates */
+  update.position.rpm = 3060;
+  calculate_ignition_and_fuel(&config, &update, &state);
+  ck_assert_int_eq(state.cache.inputs.rpm, 3060);
+
+  /* Cuts are evaluated even when the cache is used */
+  config.rpm_stop = 3070;
+  config.rpm_start = 3050;
+  update.position.rpm = 3080;
+  struct calculated_values cut =
+    calculate_ignition_and_fuel(&config, &update, &state);
+  ck_assert_int_eq(state.cache.inputs.rpm, 3060);
+  ck_assert(cut.rpm_limit_cut);
+
+  /* Active tipin bypasses the cache without replacing it */
+  update.sensors.TPS.derivative = 500;
+  update.position.rpm = 3060;
+  struct calculated_values tipin =
+    calculate_ignition_and_fuel(&config, &update, &state);
+  ck_assert_float_gt(tipin.tipin, 0.0f);
+  ck_assert_int_gt(tipin.fueling_us, state.cache.values.fueling_us);
+  ck_assert_float_eq(state.cache.values.tipin, 0.0f);
+
+  /* Invalidated cache always recalculates */
+  state.cache.valid = false;
+  update.sensors.TPS.derivative = 0;
+  update.current_time = time_from_us(1000000);
+  calculate_ignition_and_fuel(&config, &update, &state);
+  ck_assert(state.cache.valid);
+}
+END_TEST
+
+START_TEST(check_output_trims) {
+  struct config config = default_config;
+  struct calculations state = { 0 };
+  struct engine_update update = {
+    .position = { .valid_until = -1, .has_rpm = true, .rpm = 4000, .tooth_rpm = 4000 },
+    .sensors = {
+      .IAT = { .value = 30 },
+      .BRV = { .value = 14 },
+      .MAP = { .value = 100 },
+      .FRT = { .value = 15 },
+      .CLT = { .value = 85 },
+      .TPS = { .value = 0, .derivative = 0 },
+    },
+  };
+
+  config.calculation_cache.enabled = true;
+
+  /* Output 1 is ignition, 6 is fuel */
+  config.outputs[1].timing_trim = -2.0f;
+  config.outputs[6].fuel_trim = 10.0f;
+
+  /* Output 7 also uses a trim table of a constant 5% */
+  config.outputs[7].fuel_trim = 10.0f;
+  config.outputs[7].fuel_trim_table = 2;
+  config.trim_tables[1].data[0][0] = 5.0f;
+  config.trim_tables[1].data[0][1] = 5.0f;
+  config.trim_tables[1].data[1][0] = 5.0f;
+  config.trim_tables[1].data[1][1] = 5.0f;
+
+  struct calculated_values results =
+    calculate_ignition_and_fuel(&config, &update, &state);
+
+  ck_assert_float_eq(results.timing_trim[0], 0.0f);
+  ck_assert_float_eq(results.timing_trim[1], -2.0f);
+  ck_assert_int_eq(results.fuel_trim_us[8], 0);
+
+  float delivered = results.fueling_us - results.idt * 1000.0f;
+  ck_assert_int_eq(results.fuel_trim_us[6], (int32_t)(delivered * 0.10f));
+  ck_assert_int_eq(results.fuel_trim_us[7], (int32_t)(delivered * 0.15f));
+
+  /* Trims apply to the fueling after the short term trim, even when the rest
+   * of the calculation is cached */
+  state.closed_loop.stt = 10.0f;
+  results = calculate_ignition_and_fuel(&config, &update, &state);
+  float trimmed = results.fueling_us - results.idt * 1000.0f;
+  ck_assert_float_gt(trimmed, delivered);
+  ck_assert_int_eq(results.fuel_trim_us[6], (int32_t)(trimmed * 0.10f));
+}
+END_TEST
+
+/* Step the wall film through n engine cycles at 3000 rpm, with 4 calculation
+ * passes per cycle */
+static void run_wall_film_cycles(const struct config *config,
+                                 struct wall_film_state *state,
+                                 timeval_t *time,
+                                 float map,
+                                 float fuelvol,
+                                 int n) {
+  for (int i = 0; i < n * 4; i++) {
+    *time += time_from_rpm_diff(3000, 180);
+    struct engine_update update = {
+      .current_time = *time,
+      .position = { .time = *time,
+                    .has_position = true,
+                    .has_rpm = true,
+                    .rpm = 3000,
+                    .last_trigger_angle = (i % 4) * 180 },
+    };
+    calculate_wall_film(config, state, &update, 90, map, fuelvol);
+  }
+}
+
+START_TEST(check_wall_film) {
+  struct config config = default_config;
+  config.fueling.wall_film = true;
+
+  struct wall_film_state state = { 0 };
+  timeval_t time = 0;
+
+  /* First injection has to build the film */
+  run_wall_film_cycles(&config, &state, &time, 40, 0.05f, 1);
+  ck_assert_float_gt(state.correction, 0.0f);
+  ck_assert_float_gt(state.film, 0.0f);
+
+  /* Converges to no correction at steady state */
+  run_wall_film_cycles(&config, &state, &time, 40, 0.05f, 100);
+  ck_assert_float_eq_tol(state.correction, 0.0f, 0.0001f);
+  float steady_film = state.film;
+
+  /* Tip-in needs extra fuel to grow the film */
+  run_wall_film_cycles(&config, &state, &time, 100, 0.1f, 1);
+  ck_assert_float_gt(state.correction, 0.0f);
+
+  /* Converges to a larger film */
+  run_wall_film_cycles(&config, &state, &time, 100, 0.1f, 100);
+  ck_assert_float_eq_tol(state.correction, 0.0f, 0.0001f);
+  ck_assert_float_gt(state.film, steady_film);
+
+  /* Tip-out has the film evaporating, so less fuel is injected */
+  run_wall_film_cycles(&config, &state, &time, 40, 0.05f, 1);
+  ck_assert_float_lt(state.correction, 0.0f);
+
+  /* Only updated once per cycle with one injection per cycle */
+  float correction = state.correction;
+  struct engine_update update = {
+    .current_time = time + time_from_rpm_diff(3000, 90),
+    .position = { .time = time, .has_position = true, .has_rpm = true,
+                  .rpm = 3000, .last_trigger_angle = 540 },
+  };
+  calculate_wall_film(&config, &state, &update, 90, 100, 0.2f);
+  ck_assert_float_eq(state.correction, correction);
+}
+END_TEST
+
+/* Engine plant for the closed-loop lambda tests. The engine needs
+ * plant_error percent more fuel than the open loop calculation, and the EGO
+ * sensor sees the delivered fuel after a fixed transport delay */
+#define LAMBDA_PLANT_STEP_US 200
+#define LAMBDA_PLANT_DELAY_STEPS 650 /* 2 cycles at 3000 rpm, plus 50 ms */
+
+struct lambda_plant {
+  float error;
+  float open_loop_fuelvol;
+  float delivered[LAMBDA_PLANT_DELAY_STEPS];
+  int head;
+  timeval_t time;
+};
+
+static struct engine_update lambda_plant_update(struct lambda_plant *plant,
+                                                float ego) {
+  return (struct engine_update){
+    .current_time = plant->time,
+    .position = { .time = plant->time,
+                  .valid_until = plant->time + time_from_us(1000),
+                  .has_position = true,
+                  .has_rpm = true,
+                  .rpm = 3000,
+                  .tooth_rpm = 3000 },
+    .sensors = {
+      .IAT = { .value = 30 },
+      .BRV = { .value = 14 },
+      .MAP = { .value = 80 },
+      .FRT = { .value = 15 },
+      .CLT = { .value = 90 },
+      .EGO = { .value = ego },
+    },
+  };
+}
+
+static void lambda_plant_init(struct lambda_plant *plant,
+                              const struct config *config,
+                              float error) {
+  struct calculations state = { 0 };
+  *plant = (struct lambda_plant){ .error = error };
+  struct engine_update update = lambda_plant_update(plant, 1.0f);
+  plant->open_loop_fuelvol =
+    calculate_ignition_and_fuel(config, &update, &state).fuelvol_per_cycle;
+  for (int i = 0; i < LAMBDA_PLANT_DELAY_STEPS; i++) {
+    plant->delivered[i] = 1.0f;
+  }
+}
+
+/* Runs the plant and controller for ms, returns the last calculation */
+static struct calculated_values run_lambda_plant(struct lambda_plant *plant,
+                                                 struct config *config,
+                                                 struct calculations *state,
+                                                 int ms) {
+  struct calculated_values values = { 0 };
+  for (int i = 0; i < ms * 1000 / LAMBDA_PLANT_STEP_US; i++) {
+    plant->time += time_from_us(LAMBDA_PLANT_STEP_US);
+
+    /* Oldest entry is the fuel delivered one transport delay ago */
+    float commanded = interpolate_table_twoaxis(
+      &config->commanded_lambda, 3000, 80);
+    float ego = commanded * (1.0f + (plant->error / 100.0f)) /
+                plant->delivered[plant->head];
+
+    struct engine_update update = lambda_plant_update(plant, ego);
+    update_closed_loop_lambda(config, &update, state);
+    closed_loop_process_ltt(config, state);
+    values = calculate_ignition_and_fuel(config, &update, state);
+
+    plant->delivered[plant->head] =
+      values.fuelvol_per_cycle / plant->open_loop_fuelvol;
+    plant->head = (plant->head + 1) % LAMBDA_PLANT_DELAY_STEPS;
+  }
+  return values;
+}
+
+START_TEST(check_closed_loop_lambda) {
+  struct config config = default_config;
+  config.closed_loop.enabled = true;
+
+  struct calculations state = { 0 };
+  struct lambda_plant plant;
+  lambda_plant_init(&plant, &config, 10.0f);
+
+  /* Short term trim converges to the plant's fueling error */
+  struct calculated_values values =
+    run_lambda_plant(&plant, &config, &state, 5000);
+  ck_assert(state.closed_loop.active);
+  ck_assert_float_eq_tol(values.lambda_stt, 10.0f, 0.5f);
+  ck_assert_float_eq(values.lambda_ltt, 0.0f);
+
+  /* Evaluation is decimated */
+  uint32_t passes = state.closed_loop.passes;
+  struct engine_update update = lambda_plant_update(&plant, 1.0f);
+  update_closed_loop_lambda(&config, &update, &state);
+  ck_assert_int_eq(state.closed_loop.passes, passes + 1);
+
+  /* A faulted sensor drops back to open loop */
+  update.sensors.EGO.fault = FAULT_RANGE;
+  for (uint32_t i = 0; i < config.closed_loop.decimation; i++) {
+    update_closed_loop_lambda(&config, &update, &state);
+  }
+  ck_assert(!state.closed_loop.active);
+  ck_assert_float_eq(state.closed_loop.stt, 0.0f);
+  lambda_plant_init(&plant, &config, 10.0f);
+
+  /* With learning, the trim moves into the long term table at the operating
+   * point and the short term trim returns to zero */
+  config.closed_loop.learn = true;
+  values = run_lambda_plant(&plant, &config, &state, 30000);
+  ck_assert_float_eq_tol(values.lambda_ltt, 10.0f, 0.5f);
+  ck_assert_float_eq_tol(values.lambda_stt, 0.0f, 0.5f);
+  ck_assert_float_eq_tol(config.lambda_ltt.data[6][7], 10.0f, 0.5f);
+  ck_assert_float_eq(config.lambda_ltt.data[6][8], 0.0f);
+
+  /* Learned trim is kept when open loop */
+  config.closed_loop.learn = false;
+  lambda_plant_init(&plant, &config, 10.0f);
+  struct calculations open_loop = { 0 };
+  update = lambda_plant_update(&plant, 1.0f);
+  values = calculate_ignition_and_fuel(&config, &update, &open_loop);
+  ck_assert_float_eq_tol(values.lambda_ltt, 10.0f, 0.5f);
+  ck_assert_float_eq(values.lambda_stt, 0.0f);
+}
+END_TEST
+
 TCase *setup_calculations_tests() {
   TCase *tc = tcase_create("calculations");
   tcase_add_test(tc, check_air_density);
@@ -402,6 +1287,11 @@ TCase *setup_calculations_tests() {
   tcase_add_test(tc, check_ign_fuel_calcs);
   tcase_add_test(tc, check_calculate_tipin_newevent);
   tcase_add_test(tc, check_calculate_tipin_overriding_event);
+  tcase_add_test(tc, check_knock_retard);
+  tcase_add_test(tc, check_calculation_cache);
+  tcase_add_test(tc, check_output_trims);
+  tcase_add_test(tc, check_wall_film);
+  tcase_add_test(tc, check_closed_loop_lambda);
   return tc;
 }
 #endif
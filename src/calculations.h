@@ -1,6 +1,7 @@
 #ifndef _CALCULATIONS_H
 #define _CALCULATIONS_H
 
+#include "cuts.h"
 #include "platform.h"
 
 #include <stdbool.h>
@@ -21,6 +22,9 @@ struct fueling_config {
   } crank_enrich_config;
 
   float density_of_fuel; /* At 15 C */
+
+  /* X-tau wall film compensation, replaces tipin enrichment when enabled */
+  bool wall_film;
 };
 
 typedef enum {
@@ -38,15 +42,32 @@ struct ignition_config {
   uint32_t min_dwell_us;
 };
 
-struct calculations {
-  bool rpm_cut_triggered;
+struct knock_control_config {
+  bool enabled;
+  degrees_t window_start;  /* degrees after an output's angle to start
+                              listening for knock */
+  degrees_t window_length; /* degrees to listen for knock */
+  float retard_step;       /* degrees retarded for each knock event */
+  float max_retard;        /* maximum retard for a single output */
+  float recovery_rate;     /* degrees per second of advance returned */
+};
 
-  struct tipin_state {
-    timeval_t time;
-    timeval_t length;
-    float amount;
-    int active;
-  } tipin;
+/* Closed-loop lambda control. A PI short-term trim is updated from EGO at most
+ * once per transport delay, and the long-term trim table learns the integral
+ * of the short-term trim per rpm/MAP cell. Trims are percent of fuel added */
+struct closed_loop_config {
+  bool enabled;
+  uint32_t min_rpm;
+  float min_clt;
+  float kp;              /* Trim percent per percent lambda error */
+  float ki;              /* Integral trim percent per percent error, per update */
+  float max_trim;        /* Limit for both short and long term trims */
+  float delay_cycles;    /* Engine cycles from injection to the sensor */
+  float sensor_delay_ms; /* Fixed sensor response delay */
+  uint32_t decimation;   /* Calculation passes per controller evaluation */
+  bool learn;            /* Learn the long term trim table */
+  float learn_rate;      /* Fraction of integral trim moved to the table per
+                            update */
 };
 
 struct calculated_values {
@@ -56,22 +77,101 @@ struct calculated_values {
   bool fuel_overduty_cut;
   bool dwell_overduty_cut;
 
+  /* Partial cuts from launch control or flat shift. Each is the number of
+   * events skipped of every cuts.pattern */
+  cut_mode cut_mode;
+  uint32_t fuel_cut;
+  uint32_t spark_cut;
+  float limiter_retard; /* Degrees of retard included in timing_advance */
+
   /* Ignition */
   float timing_advance;
   uint32_t dwell_us;
+  float knock_retard[MAX_EVENTS]; /* Per-output retard from knock control */
+  float timing_trim[MAX_EVENTS];  /* Per-output advance trim */
 
   /* Fueling */
   uint32_t fueling_us;
+  float fuel_trim[MAX_EVENTS];      /* Per-output fuel trim (%) */
+  int32_t fuel_trim_us[MAX_EVENTS]; /* Per-output pulsewidth trim */
   float tipin;
+  float wall_film_correction; /* Fuel volume per cycle added (cc) */
   float airmass_per_cycle;
   float fuelvol_per_cycle;
   float idt;
   float pwc;
   float lambda;
+  float lambda_stt; /* Closed-loop short term trim (%) */
+  float lambda_ltt; /* Closed-loop long term trim (%) */
   float ve;
   float ete;
 };
 
+/* Calculations are reused until an input moves by at least its hysteresis
+ * from the inputs they were last calculated from */
+struct calculation_cache_config {
+  bool enabled;
+  float rpm;
+  float map;
+  float iat;
+  float clt;
+  float brv;
+  float frt;
+  float tps;
+};
+
+struct calculation_inputs {
+  uint32_t rpm;
+  float map;
+  float iat;
+  float clt;
+  float brv;
+  float frt;
+  float tps;
+};
+
+struct calculations {
+  bool rpm_cut_triggered;
+
+  struct tipin_state {
+    timeval_t time;
+    timeval_t length;
+    float amount;
+    int active;
+  } tipin;
+
+  struct wall_film_state {
+    bool initialized;
+    timeval_t time;   /* Time of the last injection event */
+    degrees_t angle;  /* Angle since the last injection event */
+    float film;       /* Fuel volume on the port walls (cc) */
+    float correction; /* Fuel volume per cycle added for the film (cc) */
+  } wall_film;
+
+  struct closed_loop_state {
+    bool active;
+    uint32_t passes; /* Calculation passes since the last evaluation */
+    timeval_t time;  /* Time of the last controller update */
+    float integral;
+    float stt;
+  } closed_loop;
+
+  struct knock_state {
+    timeval_t time;
+    bool window_open[MAX_EVENTS];
+    bool window_knocked[MAX_EVENTS]; /* Retarded during the open window */
+    float retard[MAX_EVENTS];
+    uint32_t seq[2]; /* Last block acted on from each knock input */
+  } knock;
+
+  struct calculation_cache {
+    bool valid;
+    struct calculation_inputs inputs;
+    struct calculated_values values; /* Calculated without tipin */
+    float hit_ratio; /* Moving average of passes served from the cache */
+  } cache;
+};
+
 static inline bool calculated_values_has_cuts(
   const struct calculated_values *values) {
   return values->rpm_limit_cut || values->boost_cut ||
@@ -86,6 +186,17 @@ struct calculated_values calculate_ignition_and_fuel(
   const struct engine_update *update,
   struct calculations *state);
 
+/* Runs the closed-loop lambda controller, updating the short term trim used by
+ * calculate_ignition_and_fuel and queueing learned long term trim. Cheap on
+ * passes between decimated evaluations */
+void update_closed_loop_lambda(const struct config *config,
+                               const struct engine_update *update,
+                               struct calculations *state);
+
+/* Applies queued long term trim to config's lambda_ltt table. Called outside
+ * of interrupt context */
+void closed_loop_process_ltt(struct config *config, struct calculations *state);
+
 #ifdef UNITTEST
 #include <check.h>
 TCase *setup_calculations_tests();
@@ -22,6 +22,7 @@ struct config default_config __attribute__((section(".configdata"))) = {
     .offset = 0,
     .trigger_min_rpm = 80,
     .trigger_max_rpm_change = 0.35f,
+    .trigger_reschedule = false,
   },
   .trigger_inputs = {
     [0] = {.edge = RISING_EDGE, .type = TRIGGER},
@@ -71,6 +72,8 @@ struct config default_config __attribute__((section(".configdata"))) = {
     .FRP = {.source=SENSOR_CONST, .const_value = 100},
     .ETH = {.pin=3, .source=SENSOR_FREQ, .method=METHOD_LINEAR,
       .raw_min=50, .raw_max=150, .range={.min=0, .max=100}},
+    .CLU = {.source=SENSOR_CONST, .const_value = 0},
+    .VSS = {.source=SENSOR_CONST, .const_value = 0},
     .KNK1 = { .frequency = 7000 },
     .KNK2 = { .frequency = 7000 },
   },
@@ -151,6 +154,17 @@ struct config default_config __attribute__((section(".configdata"))) = {
     {65.0,  45.0,  72.0,  72.0,  83.0,  83.0,  90.0,  90.0,  90.0,  90.0,  90.0,  90.0,  90.0,  90.0,  90.0,  90.0}, /* 240 */
   },
 },
+  .lambda_ltt = {
+    .title = "lambda_ltt",
+    .cols = {
+      .name = "RPM", .num = 16,
+      .values = {250, 500, 900, 1200, 1600, 2000, 2400, 3000, 3600, 4000, 4400, 5200, 5800, 6400, 6800, 7200},
+    },
+    .rows = {
+      .name = "MAP", .num = 16,
+      .values = {20, 30, 40, 50, 60, 70, 80, 90, 100, 120, 140, 160, 180, 200, 220, 240},
+    },
+  },
   .commanded_lambda = {
     .title = "lambda",
     .cols = { 
@@ -225,6 +239,52 @@ struct config default_config __attribute__((section(".configdata"))) = {
       300.0, 150.0, 80.0, 40.0
     },
   },
+  .wall_film_x = {
+    .title = "wall_film_x",
+    .cols = {
+      .name = "TEMP", .num = 4,
+      .values = {-20, 20, 60, 90},
+    },
+    .rows = {
+      .name = "MAP", .num = 3,
+      .values = {20, 60, 100},
+    },
+    .data = {
+      {0.30, 0.20, 0.12, 0.08},
+      {0.40, 0.28, 0.18, 0.12},
+      {0.50, 0.35, 0.24, 0.16},
+    },
+  },
+  .wall_film_tau = {
+    .title = "wall_film_tau",
+    .cols = {
+      .name = "TEMP", .num = 4,
+      .values = {-20, 20, 60, 90},
+    },
+    .rows = {
+      .name = "MAP", .num = 3,
+      .values = {20, 60, 100},
+    },
+    .data = {
+      {400, 200, 100, 60},
+      {500, 260, 130, 80},
+      {600, 320, 160, 100},
+    },
+  },
+  .trim_tables = {
+    [0] = {
+      .title = "trim1",
+      .cols = { .name = "RPM", .num = 2, .values = {0, 8000} },
+      .rows = { .name = "MAP", .num = 2, .values = {20, 250} },
+      .data = { {0, 0}, {0, 0} },
+    },
+    [1] = {
+      .title = "trim2",
+      .cols = { .name = "RPM", .num = 2, .values = {0, 8000} },
+      .rows = { .name = "MAP", .num = 2, .values = {20, 250} },
+      .data = { {0, 0}, {0, 0} },
+    },
+  },
   .dwell = {
     .title = "dwell",
     .cols = { 
@@ -245,6 +305,7 @@ struct config default_config __attribute__((section(".configdata"))) = {
     .max_duty_cycle = 95.0,
     .fuel_pump_pin = 0,
     .density_of_fuel = 0.755, /* g/cm^3 at 15C */
+    .wall_film = false,
     .crank_enrich_config = {
       .crank_rpm = 400,
       .cutoff_temperature = 20.0,
@@ -257,6 +318,47 @@ struct config default_config __attribute__((section(".configdata"))) = {
     .min_dwell_us = 1000,
     .ignitions_per_cycle = 2, /* Wasted spark */
   },
+  .knock_control = {
+    .enabled = false,
+    .window_start = 10,
+    .window_length = 60,
+    .retard_step = 2.0,
+    .max_retard = 10.0,
+    .recovery_rate = 1.0,
+  },
+  .calculation_cache = {
+    .enabled = false,
+    .rpm = 25,
+    .map = 0.5,
+    .iat = 0.5,
+    .clt = 0.5,
+    .brv = 0.05,
+    .frt = 0.5,
+    .tps = 0.5,
+  },
+  .closed_loop = {
+    .enabled = false,
+    .min_rpm = 800,
+    .min_clt = 60.0,
+    .kp = 0.2,
+    .ki = 0.3,
+    .max_trim = 20.0,
+    .delay_cycles = 2.0,
+    .sensor_delay_ms = 50.0,
+    .decimation = 25,
+    .learn = false,
+    .learn_rate = 0.05,
+  },
+  .ve_learn = {
+    .enabled = false,
+    .min_rpm = 800,
+    .min_clt = 60.0,
+    .max_tps_rate = 20.0,
+    .decimation = 50,
+    .rate = 0.05,
+    .confidence_samples = 100.0,
+    .min_confidence = 0.5,
+  },
   .boost_control = {
     .pwm_duty_vs_rpm = {
       .title = "boost_control",
@@ -272,6 +374,93 @@ struct config default_config __attribute__((section(".configdata"))) = {
     .control_threshold_tps = 105.0,
     .pin = 1,
     .overboost = 260.0,
+    .overboost_ramp = 20.0,
+    .closed_loop = false,
+    .target_map = {
+      .title = "boost_target",
+      .cols = { .name = "RPM", .num = 6,
+        .values = {1000.0, 2000.0, 3000.0, 4000.0, 5000.0, 6000.0},
+      },
+      .rows = { .name = "TPS", .num = 3,
+        .values = {0.0, 50.0, 100.0},
+      },
+      .data = {
+        {100, 100, 100, 100, 100, 100},
+        {150, 150, 150, 150, 150, 150},
+        {200, 200, 200, 200, 200, 200},
+      },
+    },
+    .kp = 1.0,
+    .ki = 1.0,
+    .kd = 0.01,
+    .period_ms = 20,
+  },
+  .idle_control = {
+    .enabled = false,
+    .valve = IDLE_VALVE_PWM,
+    .pin = 2,
+    .dir_pin = 4,
+    .stepper_steps = 200,
+    .stepper_rate = 400,
+    .target_rpm_vs_clt = {
+      .title = "idle_target_rpm",
+      .cols = { .name = "CLT", .num = 6,
+        .values = {-20, 0, 20, 40, 60, 80},
+      },
+      .data = {1400, 1300, 1150, 1050, 950, 850},
+    },
+    .duty_vs_clt = {
+      .title = "idle_duty",
+      .cols = { .name = "CLT", .num = 6,
+        .values = {-20, 0, 20, 40, 60, 80},
+      },
+      .data = {55, 50, 42, 36, 32, 28},
+    },
+    .kp = 0.02,
+    .ki = 0.05,
+    .kd = 0.0005,
+    .min_duty = 10.0,
+    .max_duty = 80.0,
+    .max_tps = 2.0,
+    .activation_rpm = 400.0,
+    .timing_kp = 0.02,
+    .max_timing_assist = 8.0,
+  },
+  .fan_control = {
+    .enabled = false,
+    .output = FAN_OUTPUT_GPIO,
+    .pin = 3,
+    .on_temp = 95.0,
+    .off_temp = 90.0,
+    .duty_vs_clt = {
+      .title = "fan_duty",
+      .cols = { .name = "CLT", .num = 4,
+        .values = {90, 95, 100, 105},
+      },
+      .data = {40, 60, 80, 100},
+    },
+    .run_on_ms = 60000,
+    .period_ms = 250,
+  },
+  .cuts = {
+    .output = CUT_SPARK,
+    .pattern = 8,
+    .launch = {
+      .enabled = false,
+      .rpm = 4000,
+      .retard_window = 500,
+      .max_retard = 10.0,
+      .cut_window = 200,
+    },
+    .launch_max_speed = 5.0,
+    .flat_shift = {
+      .enabled = false,
+      .rpm = 6000,
+      .retard_window = 300,
+      .max_retard = 10.0,
+      .cut_window = 200,
+    },
+    .flat_shift_min_tps = 80.0,
   },
   .cel = {
     .pin = 2,
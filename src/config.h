@@ -2,12 +2,18 @@
 #define _CONFIG_H
 
 #include "calculations.h"
+#include "cuts.h"
 #include "decoder.h"
 #include "platform.h"
 #include "scheduler.h"
 #include "sensors.h"
 #include "table.h"
 #include "tasks.h"
+#include "ve_learn.h"
+
+/* Number of rpm/MAP tables available for per-output trims. Each is a full
+ * 2.6 KB table in RAM, so only one per bank is provided */
+#define MAX_TRIM_TABLES 2
 
 struct config {
   /* Event list */
@@ -25,6 +31,7 @@ struct config {
   /* Tables */
   struct table_2d timing;
   struct table_2d ve;
+  struct table_2d lambda_ltt; /* Closed-loop long term trim (%) */
   struct table_2d commanded_lambda;
   struct table_1d injector_deadtime_offset;
   struct table_1d injector_pw_correction;
@@ -32,11 +39,21 @@ struct config {
   struct table_1d dwell;
   struct table_2d tipin_enrich_amount;
   struct table_1d tipin_enrich_duration;
+  struct table_2d wall_film_x;
+  struct table_2d wall_film_tau;
+  struct table_2d trim_tables[MAX_TRIM_TABLES];
 
   /* Fuel information */
   struct fueling_config fueling;
   struct ignition_config ignition;
+  struct knock_control_config knock_control;
+  struct calculation_cache_config calculation_cache;
+  struct closed_loop_config closed_loop;
+  struct ve_learn_config ve_learn;
   struct boost_control_config boost_control;
+  struct idle_control_config idle_control;
+  struct fan_control_config fan_control;
+  struct cut_config cuts;
   struct cel_config cel;
 
   /* Cutoffs */
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdatomic.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -8,10 +9,12 @@
 #include "calculations.h"
 #include "config.h"
 #include "console.h"
+#include "crc.h"
 #include "decoder.h"
 #include "platform.h"
 #include "sensors.h"
 #include "sim.h"
+#include "spans.h"
 #include "spsc.h"
 #include "util.h"
 #include "viaems.h"
@@ -23,6 +26,39 @@ typedef enum {
   CONSOLE_STRUCTURE,
 } console_request_type;
 
+/* Get, set and structure responses larger than CONSOLE_CHUNK_SIZE are sent as
+ * several response messages, each holding part of the tree. Every chunk
+ * renders the request again from the field the last one ended at, so only one
+ * chunk is ever buffered and other messages are sent between chunks. Fields
+ * are split down to CONSOLE_STREAM_DEPTH deep, and arrays only between maps */
+#ifndef CONSOLE_CHUNK_SIZE
+#define CONSOLE_CHUNK_SIZE 4096
+#endif
+#define CONSOLE_STREAM_DEPTH 3
+
+struct console_stream {
+  bool active;         /* A response is part way sent */
+  size_t request_size; /* Its request is kept at the start of rx_buffer */
+  uint32_t chunk;      /* Index of the chunk being rendered */
+
+  /* The first field not yet sent, as its index among its siblings at each
+   * depth, or the start of the response if resume_depth is 0 */
+  uint32_t resume[CONSOLE_STREAM_DEPTH];
+  int resume_depth;
+
+  /* The chunk being rendered, responses are only split while buffer is set */
+  uint8_t *buffer;
+  size_t buffer_size;
+  uint32_t siblings[CONSOLE_STREAM_DEPTH]; /* Fields seen in each parent */
+  uint32_t path[CONSOLE_STREAM_DEPTH];     /* Of the current field */
+  bool sent_field;                         /* A new field was rendered */
+  bool full;
+  uint32_t next[CONSOLE_STREAM_DEPTH]; /* Where the next chunk resumes */
+  int next_depth;
+};
+
+static struct console_stream console_stream;
+
 struct console_request_context {
   console_request_type type;
   CborEncoder *response;
@@ -31,6 +67,9 @@ struct console_request_context {
 
   bool is_filtered;
   bool is_completed;
+
+  struct console_stream *stream; /* NULL if the response is not split */
+  int depth;                     /* Of the fields rendered in this context */
 };
 
 struct console_enum_mapping {
@@ -116,108 +155,306 @@ static bool descend_array_field(struct console_request_context *ctx,
 static void render_description_field(CborEncoder *, const char *desc);
 static void render_type_field(CborEncoder *, const char *type);
 
-static const char *console_feed_keys[] = {
-  "cputime",
-  "ve",
-  "lambda",
-  "fuel_pulsewidth_us",
-  "temp_enrich_percent",
-  "injector_dead_time",
-  "injector_pw_correction",
-  "accel_enrich_percent",
-  "airmass_per_cycle",
-  "advance",
-  "dwell",
-  "rpm_cut",
-  "boost_cut",
-  "fuel_overduty_cut",
-  "dwell_overduty_cut",
-  "sensor.map",
-  "sensor.iat",
-  "sensor.clt",
-  "sensor.brv",
-  "sensor.tps",
-  "sensor.tps.rate",
-  "sensor.aap",
-  "sensor.frt",
-  "sensor.ego",
-  "sensor.frp",
-  "knock1.value",
-  "knock2.value",
-  "sensor.eth",
-  "sensor_faults",
-  "rpm",
-  "tooth_rpm",
-  "sync",
-  "loss",
-  "rpm_variance",
-  "last_trigger_angle",
-  "t0_count",
-  "t1_count",
+static void console_stream_begin_chunk(struct console_stream *s,
+                                       uint8_t *buffer,
+                                       size_t buffer_size);
+static bool console_stream_field(struct console_request_context *ctx);
+static uint32_t console_stream_first_field(
+  struct console_request_context *ctx);
+static void console_stream_reset(struct console_stream *s);
+static void console_stream_next_chunk(struct console_stream *s);
+
+typedef enum {
+  FEED_UINT32,
+  FEED_FLOAT,
+  FEED_BOOL,
+} console_feed_type;
+
+/* Fields are recorded from the engine update in groups, and only the groups of
+ * subscribed fields are recorded */
+typedef enum {
+  FEED_CALCS = 0x1,
+  FEED_TASKS = 0x2,
+  FEED_SENSORS = 0x4,
+  FEED_DECODER = 0x8,
+} console_feed_group;
+
+#define FEED_ALL_GROUPS (FEED_CALCS | FEED_TASKS | FEED_SENSORS | FEED_DECODER)
+
+struct console_feed_field {
+  const char *name;
+  console_feed_type type;
+  size_t offset; /* Offset of the value in struct console_feed_update */
+  uint32_t group;
+};
+
+#define FEED_FIELD(n, t, member, g)                                            \
+  {                                                                            \
+    .name = n, .type = t,                                                      \
+    .offset = offsetof(struct console_feed_update, member), .group = g,        \
+  }
+
+/* Fields of the feed, in the order they are sent */
+static const struct console_feed_field console_feed_fields[] = {
+  FEED_FIELD("cputime", FEED_UINT32, time, 0),
+  FEED_FIELD("ve", FEED_FLOAT, ve, FEED_CALCS),
+  FEED_FIELD("lambda", FEED_FLOAT, lambda, FEED_CALCS),
+  FEED_FIELD("lambda_stt", FEED_FLOAT, lambda_stt, FEED_CALCS),
+  FEED_FIELD("lambda_ltt", FEED_FLOAT, lambda_ltt, FEED_CALCS),
+  FEED_FIELD("fuel_pulsewidth_us", FEED_UINT32, fuel_pulsewidth_us, FEED_CALCS),
+  FEED_FIELD(
+    "temp_enrich_percent", FEED_FLOAT, temp_enrich_percent, FEED_CALCS),
+  FEED_FIELD("injector_dead_time", FEED_FLOAT, injector_dead_time, FEED_CALCS),
+  FEED_FIELD(
+    "injector_pw_correction", FEED_FLOAT, injector_pw_correction, FEED_CALCS),
+  FEED_FIELD(
+    "accel_enrich_percent", FEED_FLOAT, accel_enrich_percent, FEED_CALCS),
+  FEED_FIELD("airmass_per_cycle", FEED_FLOAT, airmass_per_cycle, FEED_CALCS),
+  FEED_FIELD("wall_film", FEED_FLOAT, wall_film, FEED_CALCS),
+  FEED_FIELD(
+    "wall_film_correction", FEED_FLOAT, wall_film_correction, FEED_CALCS),
+  FEED_FIELD("advance", FEED_FLOAT, advance, FEED_CALCS),
+  FEED_FIELD("dwell", FEED_UINT32, dwell_us, FEED_CALCS),
+  FEED_FIELD("rpm_cut", FEED_BOOL, rpm_cut, FEED_CALCS),
+  FEED_FIELD("boost_cut", FEED_BOOL, boost_cut, FEED_CALCS),
+  FEED_FIELD("fuel_overduty_cut", FEED_BOOL, fuel_overduty_cut, FEED_CALCS),
+  FEED_FIELD("dwell_overduty_cut", FEED_BOOL, dwell_overduty_cut, FEED_CALCS),
+  FEED_FIELD("cut_mode", FEED_UINT32, cut_mode, FEED_CALCS),
+  FEED_FIELD("fuel_cut", FEED_UINT32, fuel_cut, FEED_CALCS),
+  FEED_FIELD("spark_cut", FEED_UINT32, spark_cut, FEED_CALCS),
+  FEED_FIELD("limiter_retard", FEED_FLOAT, limiter_retard, FEED_CALCS),
+  FEED_FIELD(
+    "calc_cache_hit_ratio", FEED_FLOAT, calc_cache_hit_ratio, FEED_CALCS),
+  FEED_FIELD("boost_target", FEED_FLOAT, boost_target, FEED_TASKS),
+  FEED_FIELD("boost_duty", FEED_FLOAT, boost_duty, FEED_TASKS),
+  FEED_FIELD("idle_target_rpm", FEED_FLOAT, idle_target_rpm, FEED_TASKS),
+  FEED_FIELD("idle_duty", FEED_FLOAT, idle_duty, FEED_TASKS),
+  FEED_FIELD("idle_timing_assist", FEED_FLOAT, idle_timing_assist, FEED_TASKS),
+  FEED_FIELD("fan_duty", FEED_FLOAT, fan_duty, FEED_TASKS),
+  FEED_FIELD("sensor.map", FEED_FLOAT, map, FEED_SENSORS),
+  FEED_FIELD("sensor.map.window_min", FEED_FLOAT, map_window_min, FEED_SENSORS),
+  FEED_FIELD("sensor.map.window_max", FEED_FLOAT, map_window_max, FEED_SENSORS),
+  FEED_FIELD("sensor.map.window_min_angle",
+             FEED_FLOAT,
+             map_window_min_angle,
+             FEED_SENSORS),
+  FEED_FIELD("sensor.iat", FEED_FLOAT, iat, FEED_SENSORS),
+  FEED_FIELD("sensor.clt", FEED_FLOAT, clt, FEED_SENSORS),
+  FEED_FIELD("sensor.brv", FEED_FLOAT, brv, FEED_SENSORS),
+  FEED_FIELD("sensor.tps", FEED_FLOAT, tps, FEED_SENSORS),
+  FEED_FIELD("sensor.tps.rate", FEED_FLOAT, tpsrate, FEED_SENSORS),
+  FEED_FIELD("sensor.aap", FEED_FLOAT, aap, FEED_SENSORS),
+  FEED_FIELD("sensor.frt", FEED_FLOAT, frt, FEED_SENSORS),
+  FEED_FIELD("sensor.ego", FEED_FLOAT, ego, FEED_SENSORS),
+  FEED_FIELD("sensor.frp", FEED_FLOAT, frp, FEED_SENSORS),
+  FEED_FIELD("knock1.value", FEED_FLOAT, knock1, FEED_SENSORS),
+  FEED_FIELD("knock2.value", FEED_FLOAT, knock2, FEED_SENSORS),
+  FEED_FIELD("sensor.eth", FEED_FLOAT, eth, FEED_SENSORS),
+  FEED_FIELD("sensor.clu", FEED_FLOAT, clu, FEED_SENSORS),
+  FEED_FIELD("sensor.vss", FEED_FLOAT, vss, FEED_SENSORS),
+  FEED_FIELD("sensor_faults", FEED_UINT32, sensor_faults, FEED_SENSORS),
+  FEED_FIELD("knock_dropped", FEED_UINT32, knock_dropped, FEED_SENSORS),
+  FEED_FIELD("rpm", FEED_UINT32, rpm, FEED_DECODER),
+  FEED_FIELD("tooth_rpm", FEED_UINT32, tooth_rpm, FEED_DECODER),
+  FEED_FIELD("sync", FEED_BOOL, sync, FEED_DECODER),
+  FEED_FIELD("loss", FEED_UINT32, loss_reason, FEED_DECODER),
+  FEED_FIELD("rpm_variance", FEED_FLOAT, rpm_variance, FEED_DECODER),
+  FEED_FIELD("last_trigger_angle", FEED_FLOAT, last_angle, FEED_DECODER),
+  FEED_FIELD("t0_count", FEED_UINT32, t0_count, FEED_DECODER),
+  FEED_FIELD("t1_count", FEED_UINT32, t1_count, FEED_DECODER),
+};
+
+#define NUM_FEED_FIELDS                                                        \
+  (sizeof(console_feed_fields) / sizeof(console_feed_fields[0]))
+
+/* Bytes of the changed-field bitmask of a delta feed message */
+#define FEED_MASK_SIZE ((NUM_FEED_FIELDS + 7) / 8)
+
+/* Delta feed messages are a keyframe at least this often */
+#define FEED_KEYFRAME_INTERVAL 100
+
+/* The full feed is sent while there are no subscriptions, and is kept after
+ * them in the subscription list */
+#define FEED_FULL FEED_MAX_SUBSCRIPTIONS
+
+/* A slot is only rewritten while inactive, and its generation changes each
+ * time, so updates recorded for a previous subscription in the slot are not
+ * encoded with the new one's fields */
+struct console_feed_subscription {
+  _Atomic bool active;
+  uint32_t generation;
+  bool all_fields;
+  uint32_t decimation; /* Engine updates per feed message */
+  uint32_t updates;    /* Engine updates since the last feed message */
+  uint32_t groups;
+  size_t n_fields;
+  uint8_t fields[NUM_FEED_FIELDS]; /* Indices into console_feed_fields */
+
+  /* Delta format state, the bits of each field as last sent */
+  bool keyframe;
+  uint32_t since_keyframe;
+  uint32_t previous[NUM_FEED_FIELDS];
+};
+
+static struct {
+  console_feed_format format;
+  bool describe; /* Send a description before the next feed message */
+  bool coalesce; /* Summarize dropped updates rather than losing them */
+  struct console_feed_subscription subscriptions[FEED_MAX_SUBSCRIPTIONS + 1];
+} console_feed = {
+  .format = FEED_FORMAT_CBOR,
+  .subscriptions[FEED_FULL] = {
+    .active = true,
+    .all_fields = true,
+    .decimation = 1,
+    .groups = FEED_ALL_GROUPS,
+  },
 };
 
-#define EVENT_LOG_SIZE 32
+/* Returns whether an update recorded for subscription is still for the one in
+ * its slot, which may have been removed or replaced since */
+static bool feed_update_is_current(const struct console_feed_update *update,
+                                   int subscription) {
+  const struct console_feed_subscription *sub =
+    &console_feed.subscriptions[subscription];
+  return (update->subscriptions & (1 << subscription)) && sub->active &&
+         (update->generations[subscription] == sub->generation);
+}
+
+static bool feed_has_subscriptions(void) {
+  for (int i = 0; i < FEED_MAX_SUBSCRIPTIONS; i++) {
+    if (console_feed.subscriptions[i].active) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static size_t subscription_size(const struct console_feed_subscription *sub) {
+  return sub->all_fields ? NUM_FEED_FIELDS : sub->n_fields;
+}
+
+static size_t subscription_field_index(
+  const struct console_feed_subscription *sub,
+  size_t i) {
+  return sub->all_fields ? i : sub->fields[i];
+}
+
+static const struct console_feed_field *subscription_field(
+  const struct console_feed_subscription *sub,
+  size_t i) {
+  return &console_feed_fields[subscription_field_index(sub, i)];
+}
+
+/* Events are dropped while a producer's ring is full */
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 128
+#endif
+
+/* Each producer has its own ring, so that producers in different interrupt
+ * contexts never share a write index */
+struct event_log_ring {
+  struct spsc_queue queue;
+  _Atomic uint32_t dropped; /* Total events dropped */
+  uint32_t pending;         /* Events dropped since the last one queued */
+  struct {
+    struct logged_event ev;
+    uint32_t dropped; /* Events dropped just before this one */
+  } entries[EVENT_LOG_SIZE];
+};
 
 static struct {
   bool enabled;
-  _Atomic uint32_t read;
-  _Atomic uint32_t write;
   _Atomic uint32_t seq;
-  struct logged_event events[EVENT_LOG_SIZE];
-} event_log = { .enabled = true };
+  struct event_log_ring rings[NUM_EVENT_PRODUCERS];
+} event_log = {
+  .enabled = true,
+  .rings = {
+    [EVENT_PRODUCER_DECODER] = { .queue = { .size = EVENT_LOG_SIZE } },
+    [EVENT_PRODUCER_OUTPUTS] = { .queue = { .size = EVENT_LOG_SIZE } },
+  },
+};
 
-static uint32_t event_log_next_idx(uint32_t idx) {
-  idx += 1;
-  if (idx >= EVENT_LOG_SIZE) {
-    return 0;
-  } else {
-    return idx;
+static uint32_t event_log_dropped(void) {
+  uint32_t dropped = 0;
+  for (int i = 0; i < NUM_EVENT_PRODUCERS; i++) {
+    dropped += event_log.rings[i].dropped;
   }
+  return dropped;
 }
 
-static struct logged_event get_logged_event() {
-  uint32_t read_pos = event_log.read;
-  uint32_t write_pos = event_log.write;
-
+/* Returns the oldest event of all the rings, by sequence number, along with
+ * the number of events its producer dropped since its previous event.
+ *
+ * Ordering is best-effort: only the events already queued are compared, and a
+ * producer that is interrupted between taking its seq and queueing its event
+ * queues it after the interrupting producer's later one may have been read */
+static struct logged_event get_logged_event(uint32_t *dropped) {
+  *dropped = 0;
   if (!event_log.enabled) {
     return (struct logged_event){ .type = EVENT_NONE };
   }
 
-  if (read_pos == write_pos) {
+  struct event_log_ring *oldest = NULL;
+  int oldest_idx = -1;
+  for (int i = 0; i < NUM_EVENT_PRODUCERS; i++) {
+    struct event_log_ring *ring = &event_log.rings[i];
+    int idx = spsc_next(&ring->queue);
+    if (idx < 0) {
+      continue;
+    }
+    /* Sequence numbers wrap, so compare by difference */
+    if (!oldest || ((int32_t)(ring->entries[idx].ev.seq -
+                              oldest->entries[oldest_idx].ev.seq) < 0)) {
+      oldest = ring;
+      oldest_idx = idx;
+    }
+  }
+
+  if (!oldest) {
     return (struct logged_event){ .type = EVENT_NONE };
   }
 
-  struct logged_event ret = event_log.events[read_pos];
-  event_log.read = event_log_next_idx(read_pos);
+  struct logged_event ret = oldest->entries[oldest_idx].ev;
+  *dropped = oldest->entries[oldest_idx].dropped;
+  spsc_release(&oldest->queue);
   return ret;
 }
 
-void console_record_event(struct logged_event ev) {
-  if (!event_log.enabled) {
+/* Queues an event that already has its seq */
+static void event_log_push(struct event_log_ring *ring,
+                           const struct logged_event *ev) {
+  int idx = spsc_allocate(&ring->queue);
+  if (idx < 0) {
+    ring->dropped++;
+    ring->pending++;
     return;
   }
+  ring->entries[idx].ev = *ev;
+  ring->entries[idx].dropped = ring->pending;
+  ring->pending = 0;
+  spsc_push(&ring->queue);
+}
 
-  uint32_t seq = atomic_fetch_add(&event_log.seq, 1);
-  uint32_t read_pos = event_log.read;
-  uint32_t write_pos = event_log.write;
-  uint32_t next_write_pos = event_log_next_idx(write_pos);
-
-  if (next_write_pos != read_pos) {
-    event_log.events[write_pos] = ev;
-    event_log.events[write_pos].seq = seq;
-    event_log.write = next_write_pos;
+void console_record_event(event_producer producer, struct logged_event ev) {
+  if (!event_log.enabled) {
+    return;
   }
+
+  ev.seq = atomic_fetch_add(&event_log.seq, 1);
+  event_log_push(&event_log.rings[producer], &ev);
 }
 
 static size_t console_event_message(uint8_t *dest,
                                     size_t bsize,
-                                    struct logged_event *ev) {
+                                    struct logged_event *ev,
+                                    uint32_t dropped) {
   CborEncoder encoder;
 
   cbor_encoder_init(&encoder, dest, bsize, 0);
 
   CborEncoder top_encoder;
-  cbor_encoder_create_map(&encoder, &top_encoder, 4);
+  cbor_encoder_create_map(&encoder, &top_encoder, dropped ? 5 : 4);
   cbor_encode_text_stringz(&top_encoder, "type");
   cbor_encode_text_stringz(&top_encoder, "event");
 
@@ -227,6 +464,11 @@ static size_t console_event_message(uint8_t *dest,
   cbor_encode_text_stringz(&top_encoder, "seq");
   cbor_encode_int(&top_encoder, ev->seq);
 
+  if (dropped) {
+    cbor_encode_text_stringz(&top_encoder, "dropped");
+    cbor_encode_uint(&top_encoder, dropped);
+  }
+
   cbor_encode_text_stringz(&top_encoder, "event");
 
   CborEncoder event_encoder;
@@ -312,57 +554,263 @@ static bool console_string_matches(CborValue *val, const char *str) {
   return match;
 }
 
+/* In the packed format each update is sent as a byte string with every field
+ * in order, little-endian and without padding. Bools are a single byte */
+static size_t feed_field_packed_size(console_feed_type type) {
+  return (type == FEED_BOOL) ? 1 : 4;
+}
+
+static const char *feed_field_type_name(console_feed_type type) {
+  switch (type) {
+  case FEED_UINT32:
+    return "uint32";
+  case FEED_FLOAT:
+    return "float32";
+  case FEED_BOOL:
+    return "bool";
+  }
+  return "";
+}
+
+static const char *feed_format_name(console_feed_format format) {
+  switch (format) {
+  case FEED_FORMAT_CBOR:
+    return "cbor";
+  case FEED_FORMAT_PACKED:
+    return "packed";
+  case FEED_FORMAT_DELTA:
+    return "delta";
+  }
+  return "";
+}
+
+/* Describes the fields of a subscription, as names in the cbor format, or as
+ * [name, type, offset] along with the packed size otherwise */
+static void console_feed_describe(CborEncoder *enc,
+                                  const struct console_feed_subscription *sub) {
+  size_t n_fields = subscription_size(sub);
+
+  if (console_feed.format == FEED_FORMAT_CBOR) {
+    cbor_encode_text_stringz(enc, "keys");
+    CborEncoder key_list_encoder;
+    cbor_encoder_create_array(enc, &key_list_encoder, n_fields);
+    for (size_t i = 0; i < n_fields; i++) {
+      cbor_encode_text_stringz(&key_list_encoder,
+                               subscription_field(sub, i)->name);
+    }
+    cbor_encoder_close_container(enc, &key_list_encoder);
+    return;
+  }
+
+  cbor_encode_text_stringz(enc, "fields");
+  CborEncoder field_list_encoder;
+  cbor_encoder_create_array(enc, &field_list_encoder, n_fields);
+
+  size_t offset = 0;
+  for (size_t i = 0; i < n_fields; i++) {
+    const struct console_feed_field *field = subscription_field(sub, i);
+    CborEncoder field_encoder;
+    cbor_encoder_create_array(&field_list_encoder, &field_encoder, 3);
+    cbor_encode_text_stringz(&field_encoder, field->name);
+    cbor_encode_text_stringz(&field_encoder, feed_field_type_name(field->type));
+    cbor_encode_uint(&field_encoder, offset);
+    cbor_encoder_close_container(&field_list_encoder, &field_encoder);
+    offset += feed_field_packed_size(field->type);
+  }
+  cbor_encoder_close_container(enc, &field_list_encoder);
+
+  cbor_encode_text_stringz(enc, "size");
+  cbor_encode_uint(enc, offset);
+}
+
 static size_t console_feed_line_keys(uint8_t *dest, size_t bsize) {
   CborEncoder encoder;
   cbor_encoder_init(&encoder, dest, bsize, 0);
 
   CborEncoder top_encoder;
-  cbor_encoder_create_map(&encoder, &top_encoder, 3);
+  cbor_encoder_create_map(&encoder, &top_encoder, CborIndefiniteLength);
   cbor_encode_text_stringz(&top_encoder, "type");
   cbor_encode_text_stringz(&top_encoder, "description");
 
   cbor_encode_text_stringz(&top_encoder, "time");
   cbor_encode_int(&top_encoder, current_time());
 
-  cbor_encode_text_stringz(&top_encoder, "keys");
-  CborEncoder key_list_encoder;
-
-  const size_t count = sizeof(console_feed_keys) / sizeof(const char *);
-  cbor_encoder_create_array(&top_encoder, &key_list_encoder, count);
-  for (size_t i = 0; i < count; i++) {
-    cbor_encode_text_stringz(&key_list_encoder, console_feed_keys[i]);
+  cbor_encode_text_stringz(&top_encoder, "format");
+  cbor_encode_text_stringz(&top_encoder, feed_format_name(console_feed.format));
+
+  if (feed_has_subscriptions()) {
+    cbor_encode_text_stringz(&top_encoder, "subscriptions");
+    CborEncoder sub_list_encoder;
+    cbor_encoder_create_array(
+      &top_encoder, &sub_list_encoder, CborIndefiniteLength);
+    for (int i = 0; i < FEED_MAX_SUBSCRIPTIONS; i++) {
+      const struct console_feed_subscription *sub =
+        &console_feed.subscriptions[i];
+      if (!sub->active) {
+        continue;
+      }
+      /* "keys", or "fields" and "size" */
+      size_t n_entries = (console_feed.format == FEED_FORMAT_CBOR) ? 3 : 4;
+      CborEncoder sub_encoder;
+      cbor_encoder_create_map(&sub_list_encoder, &sub_encoder, n_entries);
+      cbor_encode_text_stringz(&sub_encoder, "subscription");
+      cbor_encode_int(&sub_encoder, i);
+      cbor_encode_text_stringz(&sub_encoder, "decimation");
+      cbor_encode_uint(&sub_encoder, sub->decimation);
+      console_feed_describe(&sub_encoder, sub);
+      cbor_encoder_close_container(&sub_list_encoder, &sub_encoder);
+    }
+    cbor_encoder_close_container(&top_encoder, &sub_list_encoder);
+  } else {
+    console_feed_describe(&top_encoder,
+                          &console_feed.subscriptions[FEED_FULL]);
   }
-  cbor_encoder_close_container(&top_encoder, &key_list_encoder);
   cbor_encoder_close_container(&encoder, &top_encoder);
+
+  /* Clients can start decoding a delta feed from any description */
+  for (int i = 0; i <= FEED_MAX_SUBSCRIPTIONS; i++) {
+    console_feed.subscriptions[i].keyframe = true;
+  }
   return cbor_encoder_get_buffer_size(&encoder, dest);
 }
 
+/* Engine updates are dropped while the queue is full, so a deeper queue rides
+ * out longer stalls of the main loop at the cost of memory */
+#ifndef FEED_QUEUE_SIZE
+#define FEED_QUEUE_SIZE 16
+#endif
+
+/* The range of each field, as its bits, over consecutive dropped updates */
+struct console_feed_summary {
+  uint32_t count;                   /* Updates summarized, none if zero */
+  uint8_t recorded[FEED_MASK_SIZE]; /* Bitmask of the fields summarized */
+  uint32_t min[NUM_FEED_FIELDS];
+  uint32_t max[NUM_FEED_FIELDS];
+};
+
 struct spsc_queue engine_update_queue = {
-  .size = 4,
+  .size = FEED_QUEUE_SIZE,
 };
-struct console_feed_update engine_update_msgs[4];
+struct console_feed_update engine_update_msgs[FEED_QUEUE_SIZE];
 
-void record_engine_update(const struct viaems *viaems,
-                          const struct engine_update *eng_update,
-                          const struct calculated_values *calcs) {
+/* Only used by record_engine_update */
+static struct {
+  uint32_t seq;
+  uint32_t dropped;
+  struct console_feed_summary summary;
+} feed_recorder;
+
+/* A summary is handed to the console along with the seq of the update it is
+ * sent with. Until the console is done with it, the recorder keeps adding
+ * dropped updates to its own summary, and hands that over with a later
+ * update, so only one is ever pending */
+static struct {
+  _Atomic bool pending;
+  uint32_t seq;
+  struct console_feed_summary summary;
+} feed_pending_summary;
+
+static uint32_t feed_field_bits(const struct console_feed_field *field,
+                                const struct console_feed_update *update) {
+  const uint8_t *value = (const uint8_t *)update + field->offset;
+  if (field->type == FEED_BOOL) {
+    return *(const bool *)value ? 1 : 0;
+  }
+  uint32_t bits;
+  memcpy(&bits, value, sizeof(bits));
+  return bits;
+}
 
-  int idx = spsc_allocate(&engine_update_queue);
-  if (idx < 0) {
-    return;
+static bool feed_field_less(const struct console_feed_field *field,
+                            uint32_t a,
+                            uint32_t b) {
+  if (field->type == FEED_FLOAT) {
+    float fa, fb;
+    memcpy(&fa, &a, sizeof(fa));
+    memcpy(&fb, &b, sizeof(fb));
+    return fa < fb;
   }
+  return a < b;
+}
 
-  struct console_feed_update *update = &engine_update_msgs[idx];
+static bool feed_summary_has_field(const struct console_feed_summary *summary,
+                                   size_t index) {
+  return summary->recorded[index / 8] & (1 << (index % 8));
+}
 
-  update->time = eng_update->current_time;
+static void feed_summary_merge_field(struct console_feed_summary *summary,
+                                     const struct console_feed_update *update,
+                                     size_t index) {
+  const struct console_feed_field *field = &console_feed_fields[index];
+  bool first = !feed_summary_has_field(summary, index);
+  uint32_t bits = feed_field_bits(field, update);
+  if (first || feed_field_less(field, bits, summary->min[index])) {
+    summary->min[index] = bits;
+  }
+  if (first || feed_field_less(field, summary->max[index], bits)) {
+    summary->max[index] = bits;
+  }
+  summary->recorded[index / 8] |= 1 << (index % 8);
+}
+
+/* Merges a dropped update into summary. Only the fields of the subscriptions
+ * it was due for are summarized, as no others will be sent */
+static void feed_summary_merge(struct console_feed_summary *summary,
+                               const struct console_feed_update *update,
+                               uint32_t due) {
+  for (int s = 0; s <= FEED_MAX_SUBSCRIPTIONS; s++) {
+    if (!(due & (1 << s))) {
+      continue;
+    }
+    const struct console_feed_subscription *sub =
+      &console_feed.subscriptions[s];
+    for (size_t i = 0; i < subscription_size(sub); i++) {
+      feed_summary_merge_field(
+        summary, update, subscription_field_index(sub, i));
+    }
+  }
+  summary->count++;
+}
+
+static void feed_summary_clear(struct console_feed_summary *summary) {
+  summary->count = 0;
+  memset(summary->recorded, 0, sizeof(summary->recorded));
+}
+
+/* Returns the summary to send with update, or NULL if there is none */
+static const struct console_feed_summary *feed_summary_for(
+  const struct console_feed_update *update) {
+  if (feed_pending_summary.pending &&
+      (feed_pending_summary.seq == update->seq)) {
+    return &feed_pending_summary.summary;
+  }
+  return NULL;
+}
+
+/* Hands the pending summary back to the recorder once the update it was for,
+ * or any later one, has been sent */
+static void feed_summary_release(const struct console_feed_update *update) {
+  if (feed_pending_summary.pending &&
+      ((int32_t)(update->seq - feed_pending_summary.seq) >= 0)) {
+    feed_pending_summary.pending = false;
+  }
+}
+
+static void record_calculations(struct console_feed_update *update,
+                                const struct viaems *viaems,
+                                const struct calculated_values *calcs) {
   if (calcs != NULL) {
     update->ve = calcs->ve;
     update->lambda = calcs->lambda;
+    update->lambda_stt = calcs->lambda_stt;
+    update->lambda_ltt = calcs->lambda_ltt;
     update->fuel_pulsewidth_us = calcs->fueling_us;
     update->temp_enrich_percent = calcs->ete;
     update->injector_dead_time = calcs->idt;
     update->injector_pw_correction = calcs->pwc;
     update->accel_enrich_percent = calcs->tipin;
     update->airmass_per_cycle = calcs->airmass_per_cycle;
+    update->wall_film_correction = calcs->wall_film_correction * 1000.0f;
 
     update->advance = calcs->timing_advance;
     update->dwell_us = calcs->dwell_us;
@@ -370,15 +818,22 @@ void record_engine_update(const struct viaems *viaems,
     update->boost_cut = calcs->boost_cut;
     update->fuel_overduty_cut = calcs->fuel_overduty_cut;
     update->dwell_overduty_cut = calcs->dwell_overduty_cut;
+    update->cut_mode = calcs->cut_mode;
+    update->fuel_cut = calcs->fuel_cut;
+    update->spark_cut = calcs->spark_cut;
+    update->limiter_retard = calcs->limiter_retard;
   } else {
     update->ve = 0;
     update->lambda = 0;
+    update->lambda_stt = 0;
+    update->lambda_ltt = 0;
     update->fuel_pulsewidth_us = 0;
     update->temp_enrich_percent = 0;
     update->injector_dead_time = 0;
     update->injector_pw_correction = 0;
     update->accel_enrich_percent = 0;
     update->airmass_per_cycle = 0;
+    update->wall_film_correction = 0;
 
     update->advance = 0;
     update->dwell_us = 0;
@@ -386,9 +841,40 @@ void record_engine_update(const struct viaems *viaems,
     update->boost_cut = false;
     update->fuel_overduty_cut = false;
     update->dwell_overduty_cut = false;
+    update->cut_mode = CUT_MODE_NONE;
+    update->fuel_cut = 0;
+    update->spark_cut = 0;
+    update->limiter_retard = 0;
   }
+  update->calc_cache_hit_ratio = viaems->calculations.cache.hit_ratio;
+  update->wall_film = viaems->calculations.wall_film.film * 1000.0f;
+}
+
+static void record_tasks(struct console_feed_update *update,
+                         const struct viaems *viaems) {
+  update->boost_target = viaems->tasks.boost.target;
+  update->boost_duty = viaems->tasks.boost_duty;
+  update->idle_target_rpm = viaems->tasks.idle.target_rpm;
+  update->idle_duty = viaems->tasks.idle.duty;
+  update->idle_timing_assist = viaems->tasks.idle.timing_assist;
+  update->fan_duty = viaems->tasks.fan.duty;
+}
 
+static void record_sensors(struct console_feed_update *update,
+                           const struct viaems *viaems,
+                           const struct engine_update *eng_update) {
   update->map = eng_update->sensors.MAP.value;
+  const struct sensor_window *map_window =
+    sensors_map_window(&viaems->sensors, 0);
+  if (map_window != NULL) {
+    update->map_window_min = map_window->min;
+    update->map_window_max = map_window->max;
+    update->map_window_min_angle = map_window->min_angle;
+  } else {
+    update->map_window_min = 0;
+    update->map_window_max = 0;
+    update->map_window_min_angle = 0;
+  }
   update->iat = eng_update->sensors.IAT.value;
   update->clt = eng_update->sensors.CLT.value;
   update->brv = eng_update->sensors.BRV.value;
@@ -398,11 +884,18 @@ void record_engine_update(const struct viaems *viaems,
   update->frt = eng_update->sensors.FRT.value;
   update->ego = eng_update->sensors.EGO.value;
   update->frp = eng_update->sensors.FRP.value;
-  update->knock1 = eng_update->sensors.KNK1;
-  update->knock2 = eng_update->sensors.KNK2;
+  update->knock1 = eng_update->sensors.KNK1.value;
+  update->knock2 = eng_update->sensors.KNK2.value;
+  update->knock_dropped = sensors_knock_dropped();
   update->eth = eng_update->sensors.ETH.value;
+  update->clu = eng_update->sensors.CLU.value;
+  update->vss = eng_update->sensors.VSS.value;
   update->sensor_faults = 0;
+}
 
+static void record_decoder(struct console_feed_update *update,
+                           const struct viaems *viaems,
+                           const struct engine_update *eng_update) {
   update->rpm = eng_update->position.rpm;
   update->tooth_rpm = eng_update->position.tooth_rpm;
   update->sync =
@@ -414,72 +907,359 @@ void record_engine_update(const struct viaems *viaems,
   update->rpm_variance = viaems->decoder.trigger_cur_rpm_change;
   update->t0_count = viaems->decoder.t0_count;
   update->t1_count = viaems->decoder.t1_count;
+}
+
+static void record_feed_update(struct console_feed_update *update,
+                               uint32_t groups,
+                               const struct viaems *viaems,
+                               const struct engine_update *eng_update,
+                               const struct calculated_values *calcs) {
+  update->time = eng_update->current_time;
+  if (groups & FEED_CALCS) {
+    record_calculations(update, viaems, calcs);
+  }
+  if (groups & FEED_TASKS) {
+    record_tasks(update, viaems);
+  }
+  if (groups & FEED_SENSORS) {
+    record_sensors(update, viaems, eng_update);
+  }
+  if (groups & FEED_DECODER) {
+    record_decoder(update, viaems, eng_update);
+  }
+}
+
+/* Returns a bitmask of the subscriptions due a feed message, along with the
+ * groups of fields they need recorded */
+static uint32_t feed_due_subscriptions(uint32_t *groups) {
+  bool subscribed = feed_has_subscriptions();
+  uint32_t due = 0;
+  *groups = 0;
+
+  for (int i = 0; i <= FEED_MAX_SUBSCRIPTIONS; i++) {
+    struct console_feed_subscription *sub = &console_feed.subscriptions[i];
+    if (!sub->active || ((i == FEED_FULL) && subscribed)) {
+      continue;
+    }
+    sub->updates++;
+    if (sub->updates < sub->decimation) {
+      continue;
+    }
+    sub->updates = 0;
+    due |= (1 << i);
+    *groups |= sub->groups;
+  }
+  return due;
+}
+
+void record_engine_update(const struct viaems *viaems,
+                          const struct engine_update *eng_update,
+                          const struct calculated_values *calcs) {
+
+  uint32_t groups;
+  uint32_t due = feed_due_subscriptions(&groups);
+  if (!due) {
+    return;
+  }
+
+  uint32_t seq = feed_recorder.seq++;
+  int idx = spsc_allocate(&engine_update_queue);
+  if (idx < 0) {
+    feed_recorder.dropped++;
+    if (console_feed.coalesce) {
+      struct console_feed_update dropped;
+      record_feed_update(&dropped, groups, viaems, eng_update, calcs);
+      feed_summary_merge(&feed_recorder.summary, &dropped, due);
+    }
+    return;
+  }
+
+  struct console_feed_update *update = &engine_update_msgs[idx];
+  record_feed_update(update, groups, viaems, eng_update, calcs);
+  update->subscriptions = due;
+  for (int i = 0; i <= FEED_MAX_SUBSCRIPTIONS; i++) {
+    update->generations[i] = console_feed.subscriptions[i].generation;
+  }
+  update->seq = seq;
+  update->dropped = feed_recorder.dropped;
+  feed_recorder.dropped = 0;
+
+  if ((feed_recorder.summary.count > 0) && !feed_pending_summary.pending) {
+    feed_pending_summary.summary = feed_recorder.summary;
+    feed_pending_summary.seq = seq;
+    feed_pending_summary.pending = true;
+    feed_summary_clear(&feed_recorder.summary);
+  }
 
   spsc_push(&engine_update_queue);
 }
 
-static size_t console_feed_line(const struct console_feed_update *update,
+static void pack_uint32_le(uint8_t *dest, uint32_t value) {
+  dest[0] = value & 0xff;
+  dest[1] = (value >> 8) & 0xff;
+  dest[2] = (value >> 16) & 0xff;
+  dest[3] = (value >> 24) & 0xff;
+}
+
+/* Packs a subscription's fields of an update into dest, returning the packed
+ * size */
+static size_t console_feed_pack(const struct console_feed_subscription *sub,
+                                const struct console_feed_update *update,
+                                uint8_t *dest) {
+  uint8_t *ptr = dest;
+  for (size_t i = 0; i < subscription_size(sub); i++) {
+    const struct console_feed_field *field = subscription_field(sub, i);
+    uint32_t bits = feed_field_bits(field, update);
+    if (field->type == FEED_BOOL) {
+      *ptr = bits;
+    } else {
+      pack_uint32_le(ptr, bits);
+    }
+    ptr += feed_field_packed_size(field->type);
+  }
+  return ptr - dest;
+}
+
+/* Unsigned LEB128, 7 bits per byte with the high bit set on all but the last */
+static size_t pack_varint(uint8_t *dest, uint32_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    dest[len++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  dest[len++] = value;
+  return len;
+}
+
+/* Encodes the fields that changed since the last update into dest, returning
+ * the encoded size. dest starts with a bitmask of the changed fields, followed
+ * by each changed field in order: the difference for integers (zigzag encoded
+ * to keep small negative differences short), and the bits XORed with the
+ * previous bits for floats, both as varints. A change to a bool can only
+ * toggle it, so bools have no value. A keyframe is encoded against all fields
+ * being zero */
+static size_t console_feed_delta(struct console_feed_subscription *sub,
+                                 const struct console_feed_update *update,
+                                 uint8_t *dest,
+                                 bool keyframe) {
+  if (keyframe) {
+    memset(sub->previous, 0, sizeof(sub->previous));
+    sub->keyframe = false;
+    sub->since_keyframe = 0;
+  }
+  sub->since_keyframe++;
+
+  size_t n_fields = subscription_size(sub);
+  uint8_t *mask = dest;
+  memset(mask, 0, (n_fields + 7) / 8);
+  uint8_t *ptr = dest + (n_fields + 7) / 8;
+
+  for (size_t i = 0; i < n_fields; i++) {
+    const struct console_feed_field *field = subscription_field(sub, i);
+    uint32_t bits = feed_field_bits(field, update);
+    uint32_t previous = sub->previous[i];
+    if (bits == previous) {
+      continue;
+    }
+    mask[i / 8] |= 1 << (i % 8);
+    sub->previous[i] = bits;
+
+    switch (field->type) {
+    case FEED_UINT32: {
+      int32_t diff = (int32_t)(bits - previous);
+      ptr += pack_varint(ptr, ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31));
+      break;
+    }
+    case FEED_FLOAT:
+      ptr += pack_varint(ptr, bits ^ previous);
+      break;
+    case FEED_BOOL:
+      break;
+    }
+  }
+  return ptr - dest;
+}
+
+static void encode_field_bits(CborEncoder *enc,
+                              const struct console_feed_field *field,
+                              uint32_t bits) {
+  switch (field->type) {
+  case FEED_UINT32:
+    cbor_encode_uint(enc, bits);
+    break;
+  case FEED_FLOAT: {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    cbor_encode_float(enc, value);
+    break;
+  }
+  case FEED_BOOL:
+    cbor_encode_boolean(enc, bits != 0);
+    break;
+  }
+}
+
+/* Encodes a subscription's fields of a summary as a list, with null for fields
+ * that were not recorded */
+static void encode_summary_list(CborEncoder *enc,
+                                const struct console_feed_subscription *sub,
+                                const struct console_feed_summary *summary,
+                                const uint32_t *bits) {
+  CborEncoder list_encoder;
+  size_t n_fields = subscription_size(sub);
+  cbor_encoder_create_array(enc, &list_encoder, n_fields);
+  for (size_t i = 0; i < n_fields; i++) {
+    size_t index = subscription_field_index(sub, i);
+    const struct console_feed_field *field = &console_feed_fields[index];
+    if (!feed_summary_has_field(summary, index)) {
+      cbor_encode_null(&list_encoder);
+    } else {
+      encode_field_bits(&list_encoder, field, bits[index]);
+    }
+  }
+  cbor_encoder_close_container(enc, &list_encoder);
+}
+
+static void encode_summary(CborEncoder *enc,
+                           const struct console_feed_subscription *sub,
+                           const struct console_feed_summary *summary) {
+  CborEncoder summary_encoder;
+  cbor_encoder_create_map(enc, &summary_encoder, 3);
+  cbor_encode_text_stringz(&summary_encoder, "count");
+  cbor_encode_uint(&summary_encoder, summary->count);
+  cbor_encode_text_stringz(&summary_encoder, "min");
+  encode_summary_list(&summary_encoder, sub, summary, summary->min);
+  cbor_encode_text_stringz(&summary_encoder, "max");
+  encode_summary_list(&summary_encoder, sub, summary, summary->max);
+  cbor_encoder_close_container(enc, &summary_encoder);
+}
+
+/* Encodes a feed message of an update for a subscription. Messages for
+ * subscriptions carry the subscription's index, and those for the full feed do
+ * not. Updates following dropped ones carry the number dropped, and the
+ * summary of them if there is one */
+static size_t console_feed_line(int subscription,
+                                const struct console_feed_update *update,
+                                const struct console_feed_summary *summary,
                                 uint8_t *dest,
                                 size_t bsize) {
+  struct console_feed_subscription *sub =
+    &console_feed.subscriptions[subscription];
   CborEncoder encoder;
 
   cbor_encoder_init(&encoder, dest, bsize, 0);
 
+  bool keyframe = (console_feed.format == FEED_FORMAT_DELTA) &&
+                  (sub->keyframe ||
+                   (sub->since_keyframe >= FEED_KEYFRAME_INTERVAL));
+  bool has_id = (subscription != FEED_FULL);
+  bool has_summary = (summary != NULL) && (summary->count > 0);
+
   CborEncoder top_encoder;
-  cbor_encoder_create_map(&encoder, &top_encoder, 3);
+  cbor_encoder_create_map(&encoder,
+                          &top_encoder,
+                          4 + (keyframe ? 1 : 0) + (has_id ? 1 : 0) +
+                            (update->dropped ? 1 : 0) + (has_summary ? 1 : 0));
   cbor_encode_text_stringz(&top_encoder, "type");
   cbor_encode_text_stringz(&top_encoder, "feed");
 
   cbor_encode_text_stringz(&top_encoder, "time");
   cbor_encode_int(&top_encoder, update->time);
 
+  cbor_encode_text_stringz(&top_encoder, "seq");
+  cbor_encode_uint(&top_encoder, update->seq);
+
+  if (has_id) {
+    cbor_encode_text_stringz(&top_encoder, "subscription");
+    cbor_encode_int(&top_encoder, subscription);
+  }
+
+  if (update->dropped) {
+    cbor_encode_text_stringz(&top_encoder, "dropped");
+    cbor_encode_uint(&top_encoder, update->dropped);
+  }
+
+  if (has_summary) {
+    cbor_encode_text_stringz(&top_encoder, "coalesced");
+    encode_summary(&top_encoder, sub, summary);
+  }
+
+  if (console_feed.format == FEED_FORMAT_DELTA) {
+    /* Varints take at most 5 bytes */
+    uint8_t delta[FEED_MASK_SIZE + NUM_FEED_FIELDS * 5];
+    size_t delta_size = console_feed_delta(sub, update, delta, keyframe);
+    if (keyframe) {
+      cbor_encode_text_stringz(&top_encoder, "keyframe");
+      cbor_encode_boolean(&top_encoder, true);
+    }
+    cbor_encode_text_stringz(&top_encoder, "delta");
+    cbor_encode_byte_string(&top_encoder, delta, delta_size);
+    cbor_encoder_close_container(&encoder, &top_encoder);
+    return cbor_encoder_get_buffer_size(&encoder, dest);
+  }
+
+  if (console_feed.format == FEED_FORMAT_PACKED) {
+    uint8_t packed[NUM_FEED_FIELDS * sizeof(uint32_t)];
+    size_t packed_size = console_feed_pack(sub, update, packed);
+    cbor_encode_text_stringz(&top_encoder, "packed");
+    cbor_encode_byte_string(&top_encoder, packed, packed_size);
+    cbor_encoder_close_container(&encoder, &top_encoder);
+    return cbor_encoder_get_buffer_size(&encoder, dest);
+  }
+
   cbor_encode_text_stringz(&top_encoder, "values");
   CborEncoder value_list_encoder;
-  const size_t count = sizeof(console_feed_keys) / sizeof(const char *);
-  cbor_encoder_create_array(&top_encoder, &value_list_encoder, count);
-  cbor_encode_uint(&value_list_encoder, update->time);
-  cbor_encode_float(&value_list_encoder, update->ve);
-  cbor_encode_float(&value_list_encoder, update->lambda);
-  cbor_encode_uint(&value_list_encoder, update->fuel_pulsewidth_us);
-  cbor_encode_float(&value_list_encoder, update->temp_enrich_percent);
-  cbor_encode_float(&value_list_encoder, update->injector_dead_time);
-  cbor_encode_float(&value_list_encoder, update->injector_pw_correction);
-  cbor_encode_float(&value_list_encoder, update->accel_enrich_percent);
-  cbor_encode_float(&value_list_encoder, update->airmass_per_cycle);
-  cbor_encode_float(&value_list_encoder, update->advance);
-  cbor_encode_uint(&value_list_encoder, update->dwell_us);
-  cbor_encode_boolean(&value_list_encoder, update->rpm_cut);
-  cbor_encode_boolean(&value_list_encoder, update->boost_cut);
-  cbor_encode_boolean(&value_list_encoder, update->fuel_overduty_cut);
-  cbor_encode_boolean(&value_list_encoder, update->dwell_overduty_cut);
-  cbor_encode_float(&value_list_encoder, update->map);
-  cbor_encode_float(&value_list_encoder, update->iat);
-  cbor_encode_float(&value_list_encoder, update->clt);
-  cbor_encode_float(&value_list_encoder, update->brv);
-  cbor_encode_float(&value_list_encoder, update->tps);
-  cbor_encode_float(&value_list_encoder, update->tpsrate);
-  cbor_encode_float(&value_list_encoder, update->aap);
-  cbor_encode_float(&value_list_encoder, update->frt);
-  cbor_encode_float(&value_list_encoder, update->ego);
-  cbor_encode_float(&value_list_encoder, update->frp);
-  cbor_encode_float(&value_list_encoder, update->knock1);
-  cbor_encode_float(&value_list_encoder, update->knock2);
-  cbor_encode_float(&value_list_encoder, update->eth);
-  cbor_encode_uint(&value_list_encoder, update->sensor_faults);
-  cbor_encode_uint(&value_list_encoder, update->rpm);
-  cbor_encode_uint(&value_list_encoder, update->tooth_rpm);
-  cbor_encode_boolean(&value_list_encoder, update->sync);
-  cbor_encode_uint(&value_list_encoder, update->loss_reason);
-  cbor_encode_float(&value_list_encoder, update->rpm_variance);
-  cbor_encode_float(&value_list_encoder, update->last_angle);
-  cbor_encode_uint(&value_list_encoder, update->t0_count);
-  cbor_encode_uint(&value_list_encoder, update->t1_count);
+  size_t n_fields = subscription_size(sub);
+  cbor_encoder_create_array(&top_encoder, &value_list_encoder, n_fields);
+  for (size_t i = 0; i < n_fields; i++) {
+    const struct console_feed_field *field = subscription_field(sub, i);
+    uint32_t bits = feed_field_bits(field, update);
+    encode_field_bits(&value_list_encoder, field, bits);
+  }
 
   cbor_encoder_close_container(&top_encoder, &value_list_encoder);
   cbor_encoder_close_container(&encoder, &top_encoder);
   return cbor_encoder_get_buffer_size(&encoder, dest);
 }
 
+void console_set_feed_format(console_feed_format format) {
+  console_feed.format = format;
+  for (int i = 0; i <= FEED_MAX_SUBSCRIPTIONS; i++) {
+    console_feed.subscriptions[i].keyframe = true;
+  }
+}
+
+size_t console_feed_encode(const struct console_feed_update *update,
+                           uint8_t *dest,
+                           size_t bsize) {
+  return console_feed_line(FEED_FULL, update, NULL, dest, bsize);
+}
+
+bool console_feed_set_field(struct console_feed_update *update,
+                            const char *name,
+                            double value) {
+  for (size_t i = 0; i < NUM_FEED_FIELDS; i++) {
+    const struct console_feed_field *field = &console_feed_fields[i];
+    if (strcmp(field->name, name) != 0) {
+      continue;
+    }
+    uint8_t *dest = (uint8_t *)update + field->offset;
+    switch (field->type) {
+    case FEED_UINT32:
+      *(uint32_t *)dest = value;
+      break;
+    case FEED_FLOAT:
+      *(float *)dest = value;
+      break;
+    case FEED_BOOL:
+      *(bool *)dest = (value != 0.0);
+      break;
+    }
+    return true;
+  }
+  return false;
+}
+
 static int console_write_full(const uint8_t *buf, size_t len) {
   size_t remaining = len;
   const uint8_t *ptr = buf;
@@ -743,6 +1523,8 @@ static bool descend_array_field(struct console_request_context *ctx,
   }
 
   *deeper_ctx = *ctx;
+  /* Arrays are sent whole */
+  deeper_ctx->depth = CONSOLE_STREAM_DEPTH;
 
   switch (ctx->type) {
   case CONSOLE_SET:
@@ -806,11 +1588,16 @@ static void render_array_object(struct console_request_context *ctx,
   ctx->response = outer;
 }
 
+/* Each map in an array is a field that can start a chunk, though the map
+ * itself is sent whole */
 static void render_map_array_field(struct console_request_context *ctx,
                                    int index,
                                    console_renderer rend,
                                    void *ptr) {
   struct console_request_context deeper;
+  if (!ctx->is_filtered && !console_stream_field(ctx)) {
+    return;
+  }
   if (descend_array_field(ctx, &deeper, index)) {
     render_map_object(&deeper, rend, ptr);
   }
@@ -852,6 +1639,72 @@ static void render_map_object(struct console_request_context *ctx,
   ctx->response = outer;
 }
 
+/* Returns true if the map field about to be rendered in ctx belongs in the
+ * current chunk: either it is new and the chunk has room, or it contains the
+ * field the chunk resumes at */
+static bool console_stream_field(struct console_request_context *ctx) {
+  struct console_stream *s = ctx->stream;
+  int depth = ctx->depth;
+  if (!s || !s->buffer || (depth >= CONSOLE_STREAM_DEPTH)) {
+    return true;
+  }
+
+  s->path[depth] = s->siblings[depth]++;
+  if (depth + 1 < CONSOLE_STREAM_DEPTH) {
+    s->siblings[depth + 1] = 0;
+  }
+
+  for (int i = 0; (i <= depth) && (i < s->resume_depth); i++) {
+    if (s->path[i] < s->resume[i]) {
+      /* Sent in an earlier chunk */
+      return false;
+    }
+    if (s->path[i] > s->resume[i]) {
+      break;
+    }
+    if ((i == depth) && (depth + 1 < s->resume_depth)) {
+      /* Contains the resumed field */
+      return true;
+    }
+  }
+
+  if (s->full) {
+    return false;
+  }
+  if (s->sent_field &&
+      (cbor_encoder_get_buffer_size(ctx->response, s->buffer) >=
+       CONSOLE_CHUNK_SIZE)) {
+    s->full = true;
+    for (int i = 0; i <= depth; i++) {
+      s->next[i] = s->path[i];
+    }
+    s->next_depth = depth + 1;
+    return false;
+  }
+  s->sent_field = true;
+  return true;
+}
+
+/* Returns the index of the first field of ctx to render. A chunk that resumes
+ * within ctx starts at the resumed field, rather than walking those already
+ * sent */
+static uint32_t console_stream_first_field(
+  struct console_request_context *ctx) {
+  struct console_stream *s = ctx->stream;
+  int depth = ctx->depth;
+  if (!s || !s->buffer || ctx->is_filtered || (depth >= s->resume_depth) ||
+      (s->siblings[depth] != 0)) {
+    return 0;
+  }
+  for (int i = 0; i < depth; i++) {
+    if (s->path[i] != s->resume[i]) {
+      return 0;
+    }
+  }
+  s->siblings[depth] = s->resume[depth];
+  return s->resume[depth];
+}
+
 static bool descend_map_field(struct console_request_context *ctx,
                               struct console_request_context *deeper_ctx,
                               const char *id) {
@@ -861,6 +1714,7 @@ static bool descend_map_field(struct console_request_context *ctx,
   }
 
   *deeper_ctx = *ctx;
+  deeper_ctx->depth = ctx->depth + 1;
 
   switch (ctx->type) {
   case CONSOLE_SET:
@@ -889,12 +1743,17 @@ static bool descend_map_field(struct console_request_context *ctx,
       deeper_ctx->is_filtered = !cbor_value_at_end(deeper_ctx->path);
       deeper_ctx->is_completed = false;
     } else {
+      if (!console_stream_field(ctx)) {
+        return false;
+      }
       cbor_encode_text_stringz(ctx->response, id);
     }
     return true;
   case CONSOLE_STRUCTURE:
   case CONSOLE_DESCRIBE:
-
+    if (!console_stream_field(ctx)) {
+      return false;
+    }
     cbor_encode_text_stringz(ctx->response, id);
     return true;
   }
@@ -1160,11 +2019,21 @@ static void render_table_1d_object(struct console_request_context *ctx,
   }
 }
 
+static void render_trim_tables(struct console_request_context *ctx,
+                               void *ptr) {
+  struct table_2d *tables = ptr;
+  for (int i = console_stream_first_field(ctx); i < MAX_TRIM_TABLES; i++) {
+    render_map_array_field(ctx, i, render_table_2d_object, &tables[i]);
+  }
+}
+
 static void render_tables(struct console_request_context *ctx, void *ptr) {
   struct config *config = (struct config *)ptr;
   render_map_map_field(ctx, "ve", render_table_2d_object, &config->ve);
   render_map_map_field(
     ctx, "lambda", render_table_2d_object, &config->commanded_lambda);
+  render_map_map_field(
+    ctx, "lambda-ltt", render_table_2d_object, &config->lambda_ltt);
   render_map_map_field(ctx, "dwell", render_table_1d_object, &config->dwell);
   render_map_map_field(ctx, "timing", render_table_2d_object, &config->timing);
   render_map_map_field(ctx,
@@ -1181,6 +2050,11 @@ static void render_tables(struct console_request_context *ctx, void *ptr) {
     ctx, "tipin-amount", render_table_2d_object, &config->tipin_enrich_amount);
   render_map_map_field(
     ctx, "tipin-time", render_table_1d_object, &config->tipin_enrich_duration);
+  render_map_map_field(
+    ctx, "wall-film-x", render_table_2d_object, &config->wall_film_x);
+  render_map_map_field(
+    ctx, "wall-film-tau", render_table_2d_object, &config->wall_film_tau);
+  render_array_map_field(ctx, "trim", render_trim_tables, config->trim_tables);
 }
 
 static void render_decoder(struct console_request_context *ctx, void *ptr) {
@@ -1234,6 +2108,11 @@ static void render_decoder(struct console_request_context *ctx, void *ptr) {
                           "rpm-window-size",
                           "rpm average window for even tooth wheel",
                           &conf->decoder.rpm_window_size);
+
+  render_bool_map_field(ctx,
+                        "trigger-reschedule",
+                        "reschedule pending outputs on each trigger",
+                        &conf->decoder.trigger_reschedule);
 }
 
 static void output_console_renderer(struct console_request_context *ctx,
@@ -1260,18 +2139,68 @@ static void output_console_renderer(struct console_request_context *ctx,
                                      { 0, NULL } },
     &type);
   ev->type = type;
+
+  render_float_map_field(
+    ctx, "fuel-trim", "fuel added for this output (%)", &ev->fuel_trim);
+  render_uint32_map_field(ctx,
+                          "fuel-trim-table",
+                          "trim table added to fuel-trim (1-2, 0 for none)",
+                          &ev->fuel_trim_table);
+  render_float_map_field(ctx,
+                         "timing-trim",
+                         "advance added for this output (degrees)",
+                         &ev->timing_trim);
+  render_uint32_map_field(ctx,
+                          "timing-trim-table",
+                          "trim table added to timing-trim (1-2, 0 for none)",
+                          &ev->timing_trim_table);
 }
 
 static void render_outputs(struct console_request_context *ctx, void *ptr) {
   struct output_event_config *outputs = (struct output_event_config *)ptr;
-  for (int i = 0; i < MAX_EVENTS; i++) {
+  for (int i = console_stream_first_field(ctx); i < MAX_EVENTS; i++) {
     render_map_array_field(ctx, i, output_console_renderer, &outputs[i]);
   }
 }
 
-static void render_sensor_object(struct console_request_context *ctx,
-                                 void *ptr) {
-
+/* The debounce count is kept within the debounce window, since a larger
+ * count could never be reached and the sensor would never fault */
+static void render_fault_debounce_window(struct console_request_context *ctx,
+                                         void *ptr) {
+  struct sensor_config *input = ptr;
+  render_uint32_object(ctx,
+                       "Samples considered for fault debounce (max 32)",
+                       &input->fault_config.debounce_window);
+  if (ctx->type == CONSOLE_SET) {
+    uint32_t limit =
+      sensor_fault_debounce_limit(input->fault_config.debounce_window);
+    if (input->fault_config.debounce_count > limit) {
+      input->fault_config.debounce_count = limit;
+    }
+  }
+}
+
+static void render_fault_debounce_count(struct console_request_context *ctx,
+                                        void *ptr) {
+  struct sensor_config *input = ptr;
+  uint32_t *count = &input->fault_config.debounce_count;
+  if ((ctx->type == CONSOLE_SET) && cbor_value_is_integer(&ctx->value)) {
+    uint32_t limit =
+      sensor_fault_debounce_limit(input->fault_config.debounce_window);
+    cbor_value_get_int_checked(&ctx->value, (int *)count);
+    if (*count > limit) {
+      *count = limit;
+    }
+    cbor_encode_int(ctx->response, *count);
+    return;
+  }
+  render_uint32_object(
+    ctx, "Out of range samples within debounce window to enter fault", count);
+}
+
+static void render_sensor_object(struct console_request_context *ctx,
+                                 void *ptr) {
+
   if (ctx->type == CONSOLE_STRUCTURE) {
     render_type_field(ctx->response, "sensor");
     return;
@@ -1338,6 +2267,10 @@ static void render_sensor_object(struct console_request_context *ctx,
                          "fault-value",
                          "Value to assume in fault condition",
                          &input->fault_config.fault_value);
+  render_custom_map_field(
+    ctx, "fault-debounce-window", render_fault_debounce_window, input);
+  render_custom_map_field(
+    ctx, "fault-debounce-count", render_fault_debounce_count, input);
 
   render_float_map_field(ctx,
                           "window-capture-opening",
@@ -1376,6 +2309,8 @@ static void render_sensors(struct console_request_context *ctx, void *ptr) {
   render_map_map_field(ctx, "ego", render_sensor_object, &sensors->EGO);
   render_map_map_field(ctx, "frp", render_sensor_object, &sensors->FRP);
   render_map_map_field(ctx, "eth", render_sensor_object, &sensors->ETH);
+  render_map_map_field(ctx, "clu", render_sensor_object, &sensors->CLU);
+  render_map_map_field(ctx, "vss", render_sensor_object, &sensors->VSS);
   render_map_map_field(ctx, "knock1", render_knock_object, &sensors->KNK1);
   render_map_map_field(ctx, "knock2", render_knock_object, &sensors->KNK2);
 }
@@ -1425,6 +2360,10 @@ static void render_fueling(struct console_request_context *ctx, void *ptr) {
                          "fuel-density",
                          "Fuel density (g/cc) at 15C",
                          &fueling->density_of_fuel);
+  render_bool_map_field(ctx,
+                        "wall-film",
+                        "X-tau wall film compensation (replaces tipin)",
+                        &fueling->wall_film);
   render_map_map_field(ctx, "crank-enrich", render_crank_enrich, fueling);
 }
 
@@ -1447,6 +2386,123 @@ static void render_ignition(struct console_request_context *ctx, void *ptr) {
     ctx, "dwell-time", "dwell time for fixed-duty (uS)", &ignition->dwell_us);
 }
 
+static void render_knock_control(struct console_request_context *ctx,
+                                 void *ptr) {
+  struct knock_control_config *knock_control =
+    (struct knock_control_config *)ptr;
+  render_bool_map_field(
+    ctx, "enabled", "Enable knock retard control", &knock_control->enabled);
+  render_float_map_field(ctx,
+                         "window-start",
+                         "Degrees after output angle to open knock window",
+                         &knock_control->window_start);
+  render_float_map_field(ctx,
+                         "window-length",
+                         "Length of knock window (degrees)",
+                         &knock_control->window_length);
+  render_float_map_field(ctx,
+                         "retard-step",
+                         "Retard added to an output per knock event (degrees)",
+                         &knock_control->retard_step);
+  render_float_map_field(ctx,
+                         "max-retard",
+                         "Maximum knock retard per output (degrees)",
+                         &knock_control->max_retard);
+  render_float_map_field(ctx,
+                         "recovery-rate",
+                         "Rate knock retard is removed (degrees/s)",
+                         &knock_control->recovery_rate);
+}
+
+static void render_calculation_cache(struct console_request_context *ctx,
+                                     void *ptr) {
+  struct calculation_cache_config *cache =
+    (struct calculation_cache_config *)ptr;
+  render_bool_map_field(ctx,
+                        "enabled",
+                        "Reuse calculations while inputs are stable",
+                        &cache->enabled);
+  render_float_map_field(
+    ctx, "rpm", "RPM change that forces recalculation", &cache->rpm);
+  render_float_map_field(
+    ctx, "map", "MAP change that forces recalculation (kPa)", &cache->map);
+  render_float_map_field(
+    ctx, "iat", "IAT change that forces recalculation (C)", &cache->iat);
+  render_float_map_field(
+    ctx, "clt", "CLT change that forces recalculation (C)", &cache->clt);
+  render_float_map_field(
+    ctx, "brv", "BRV change that forces recalculation (V)", &cache->brv);
+  render_float_map_field(
+    ctx, "frt", "FRT change that forces recalculation (C)", &cache->frt);
+  render_float_map_field(
+    ctx, "tps", "TPS change that forces recalculation (%)", &cache->tps);
+}
+
+static void render_closed_loop(struct console_request_context *ctx,
+                               void *ptr) {
+  struct closed_loop_config *cl = (struct closed_loop_config *)ptr;
+  render_bool_map_field(
+    ctx, "enabled", "Enable closed-loop lambda control", &cl->enabled);
+  render_uint32_map_field(
+    ctx, "min-rpm", "Minimum RPM for closed-loop", &cl->min_rpm);
+  render_float_map_field(
+    ctx, "min-clt", "Minimum CLT for closed-loop (C)", &cl->min_clt);
+  render_float_map_field(
+    ctx, "kp", "Proportional trim (% per % lambda error)", &cl->kp);
+  render_float_map_field(ctx,
+                         "ki",
+                         "Integral trim (% per % lambda error per update)",
+                         &cl->ki);
+  render_float_map_field(
+    ctx, "max-trim", "Limit of short and long term trims (%)", &cl->max_trim);
+  render_float_map_field(ctx,
+                         "delay-cycles",
+                         "Engine cycles from injection to EGO sensor",
+                         &cl->delay_cycles);
+  render_float_map_field(ctx,
+                         "sensor-delay",
+                         "EGO sensor response delay (ms)",
+                         &cl->sensor_delay_ms);
+  render_uint32_map_field(ctx,
+                          "decimation",
+                          "Calculation passes per controller evaluation",
+                          &cl->decimation);
+  render_bool_map_field(
+    ctx, "learn", "Learn the long term trim table", &cl->learn);
+  render_float_map_field(ctx,
+                         "learn-rate",
+                         "Fraction of integral trim learned per update",
+                         &cl->learn_rate);
+}
+
+static void render_ve_learn(struct console_request_context *ctx, void *ptr) {
+  struct ve_learn_config *vl = (struct ve_learn_config *)ptr;
+  render_bool_map_field(
+    ctx, "enabled", "Learn VE from EGO at steady state", &vl->enabled);
+  render_uint32_map_field(
+    ctx, "min-rpm", "Minimum RPM for VE learning", &vl->min_rpm);
+  render_float_map_field(
+    ctx, "min-clt", "Minimum CLT for VE learning (C)", &vl->min_clt);
+  render_float_map_field(ctx,
+                         "max-tps-rate",
+                         "Maximum TPS rate for VE learning (%/s)",
+                         &vl->max_tps_rate);
+  render_uint32_map_field(ctx,
+                          "decimation",
+                          "Calculation passes per sampled operating point",
+                          &vl->decimation);
+  render_float_map_field(
+    ctx, "rate", "Fraction of VE error corrected per sample", &vl->rate);
+  render_float_map_field(ctx,
+                         "confidence-samples",
+                         "Weighted samples for a cell to reach 63% confidence",
+                         &vl->confidence_samples);
+  render_float_map_field(ctx,
+                         "min-confidence",
+                         "Minimum cell confidence to commit (0-1)",
+                         &vl->min_confidence);
+}
+
 static void render_boost_control(struct console_request_context *ctx,
                                  void *ptr) {
   struct boost_control_config *boost_control =
@@ -1468,10 +2524,169 @@ static void render_boost_control(struct console_request_context *ctx,
                          &boost_control->control_threshold_tps);
   render_float_map_field(ctx,
                          "overboost",
-                         "High threshold for boost cut (kpa)",
+                         "MAP above which duty ramps down (kpa)",
                          &boost_control->overboost);
+  render_float_map_field(ctx,
+                         "overboost-ramp",
+                         "MAP over overboost for zero duty and boost cut (kpa)",
+                         &boost_control->overboost_ramp);
+  render_bool_map_field(ctx,
+                        "closed-loop",
+                        "Control MAP to the target table",
+                        &boost_control->closed_loop);
+  render_float_map_field(
+    ctx, "kp", "Duty % per kPa of error", &boost_control->kp);
+  render_float_map_field(
+    ctx, "ki", "Duty % per kPa of error per second", &boost_control->ki);
+  render_float_map_field(
+    ctx, "kd", "Duty % per kPa/s of MAP change", &boost_control->kd);
+  render_uint32_map_field(ctx,
+                          "period",
+                          "Closed loop control period (ms)",
+                          &boost_control->period_ms);
   render_map_map_field(
     ctx, "pwm", render_table_1d_object, &boost_control->pwm_duty_vs_rpm);
+  render_map_map_field(
+    ctx, "target", render_table_2d_object, &boost_control->target_map);
+}
+
+static void render_idle_control(struct console_request_context *ctx,
+                                void *ptr) {
+  struct idle_control_config *idle = (struct idle_control_config *)ptr;
+  render_bool_map_field(
+    ctx, "enabled", "Enable idle speed control", &idle->enabled);
+
+  int valve = idle->valve;
+  render_enum_map_field(ctx,
+                        "valve",
+                        "Idle valve type",
+                        (struct console_enum_mapping[]){
+                          { IDLE_VALVE_PWM, "pwm" },
+                          { IDLE_VALVE_STEPPER, "stepper" },
+                          { 0, NULL } },
+                        &valve);
+  idle->valve = valve;
+
+  render_uint32_map_field(
+    ctx, "pin", "PWM output, or stepper step GPIO", &idle->pin);
+  render_uint32_map_field(ctx,
+                          "dir-pin",
+                          "Stepper direction GPIO (high opens)",
+                          &idle->dir_pin);
+  render_uint32_map_field(ctx,
+                          "stepper-steps",
+                          "Stepper steps from closed to fully open",
+                          &idle->stepper_steps);
+  render_uint32_map_field(ctx,
+                          "stepper-rate",
+                          "Maximum stepper steps per second",
+                          &idle->stepper_rate);
+  render_float_map_field(ctx, "kp", "Duty % per rpm of error", &idle->kp);
+  render_float_map_field(
+    ctx, "ki", "Duty % per rpm of error per second", &idle->ki);
+  render_float_map_field(
+    ctx, "kd", "Duty % per rpm/s of rpm change", &idle->kd);
+  render_float_map_field(
+    ctx, "min-duty", "Minimum valve duty (%)", &idle->min_duty);
+  render_float_map_field(
+    ctx, "max-duty", "Maximum valve duty (%)", &idle->max_duty);
+  render_float_map_field(
+    ctx, "max-tps", "Idle control is active below this TPS", &idle->max_tps);
+  render_float_map_field(ctx,
+                         "activation-rpm",
+                         "Idle control is active below target plus this rpm",
+                         &idle->activation_rpm);
+  render_float_map_field(ctx,
+                         "timing-kp",
+                         "Degrees of advance per rpm of error",
+                         &idle->timing_kp);
+  render_float_map_field(ctx,
+                         "max-timing-assist",
+                         "Limit of idle timing advance or retard",
+                         &idle->max_timing_assist);
+  render_map_map_field(
+    ctx, "target-rpm", render_table_1d_object, &idle->target_rpm_vs_clt);
+  render_map_map_field(ctx, "duty", render_table_1d_object, &idle->duty_vs_clt);
+}
+
+static void render_fan_control(struct console_request_context *ctx,
+                               void *ptr) {
+  struct fan_control_config *fan = (struct fan_control_config *)ptr;
+  render_bool_map_field(ctx, "enabled", "Enable fan control", &fan->enabled);
+
+  int output = fan->output;
+  render_enum_map_field(ctx,
+                        "output",
+                        "Fan output type",
+                        (struct console_enum_mapping[]){
+                          { FAN_OUTPUT_GPIO, "gpio" },
+                          { FAN_OUTPUT_PWM, "pwm" },
+                          { 0, NULL } },
+                        &output);
+  fan->output = output;
+
+  render_uint32_map_field(ctx, "pin", "GPIO or PWM output", &fan->pin);
+  render_float_map_field(
+    ctx, "on-temp", "CLT to turn the fan on (C)", &fan->on_temp);
+  render_float_map_field(
+    ctx, "off-temp", "CLT to turn the fan off (C)", &fan->off_temp);
+  render_uint32_map_field(ctx,
+                          "run-on",
+                          "Time the fan may run after engine stop (ms)",
+                          &fan->run_on_ms);
+  render_uint32_map_field(
+    ctx, "period", "Fan update period (ms)", &fan->period_ms);
+  render_map_map_field(ctx, "duty", render_table_1d_object, &fan->duty_vs_clt);
+}
+
+static void render_rpm_limit(struct console_request_context *ctx,
+                             void *ptr) {
+  struct rpm_limit_config *limit = (struct rpm_limit_config *)ptr;
+  render_bool_map_field(ctx, "enabled", "Enable limit", &limit->enabled);
+  render_uint32_map_field(ctx, "rpm", "Engine speed limit", &limit->rpm);
+  render_uint32_map_field(ctx,
+                          "retard-window",
+                          "RPM below the limit to start retarding",
+                          &limit->retard_window);
+  render_float_map_field(ctx,
+                         "max-retard",
+                         "Degrees of retard at the limit",
+                         &limit->max_retard);
+  render_uint32_map_field(ctx,
+                          "cut-window",
+                          "RPM above the limit to reach a full cut",
+                          &limit->cut_window);
+}
+
+static void render_cuts(struct console_request_context *ctx, void *ptr) {
+  struct cut_config *cuts = (struct cut_config *)ptr;
+
+  int output = cuts->output;
+  render_enum_map_field(ctx,
+                        "output",
+                        "Events cut by launch control and flat shift",
+                        (struct console_enum_mapping[]){
+                          { CUT_SPARK, "spark" },
+                          { CUT_FUEL, "fuel" },
+                          { CUT_FUEL_AND_SPARK, "fuel-and-spark" },
+                          { 0, NULL } },
+                        &output);
+  cuts->output = output;
+
+  render_uint32_map_field(ctx,
+                          "pattern",
+                          "Events per partial cut pattern",
+                          &cuts->pattern);
+  render_map_map_field(ctx, "launch", render_rpm_limit, &cuts->launch);
+  render_float_map_field(ctx,
+                         "launch-max-speed",
+                         "Launch control with clutch pressed below this speed",
+                         &cuts->launch_max_speed);
+  render_map_map_field(ctx, "flat-shift", render_rpm_limit, &cuts->flat_shift);
+  render_float_map_field(ctx,
+                         "flat-shift-min-tps",
+                         "Flat shift with clutch pressed above this TPS",
+                         &cuts->flat_shift_min_tps);
 }
 
 static void render_cel(struct console_request_context *ctx, void *ptr) {
@@ -1521,7 +2736,7 @@ static void render_trigger_input_object(struct console_request_context *ctx,
 static void render_trigger_list(struct console_request_context *ctx,
                                 void *ptr) {
   struct trigger_input *trigger_inputs = (struct trigger_input *)ptr;
-  for (int i = 0; i < 4; i++) {
+  for (int i = console_stream_first_field(ctx); i < 4; i++) {
     render_map_array_field(
       ctx, i, render_trigger_input_object, &trigger_inputs[i]);
   }
@@ -1532,6 +2747,13 @@ static void render_test(struct console_request_context *ctx, void *ptr) {
   render_bool_map_field(
     ctx, "event-logging", "Enable event logging", &event_log.enabled);
 
+  /* Read only, a set is ignored */
+  uint32_t dropped = event_log_dropped();
+  render_uint32_map_field(ctx,
+                          "event-log-dropped",
+                          "Events dropped with a full event log",
+                          &dropped);
+
   /* Workaround to support the getter/setters */
   uint32_t old_rpm = get_test_trigger_rpm();
   uint32_t rpm = old_rpm;
@@ -1573,23 +2795,61 @@ static void render_info(struct console_request_context *ctx, void *ptr) {
   render_custom_map_field(ctx, "version", render_version, NULL);
 }
 
+/* Top level fields, each rendered from the config at offset */
+struct console_toplevel_field {
+  const char *id;
+  bool is_array;
+  console_renderer rend;
+  size_t offset;
+};
+
+#define TOPLEVEL_MAP(i, r, member)                                             \
+  { .id = i, .rend = r, .offset = offsetof(struct config, member) }
+#define TOPLEVEL_ARRAY(i, r, member)                                           \
+  {                                                                            \
+    .id = i, .is_array = true, .rend = r,                                      \
+    .offset = offsetof(struct config, member),                                 \
+  }
+
+static const struct console_toplevel_field console_toplevel_fields[] = {
+  /* The decoder and tables use the whole config */
+  { .id = "decoder", .rend = render_decoder },
+  TOPLEVEL_MAP("sensors", render_sensors, sensors),
+  TOPLEVEL_ARRAY("outputs", render_outputs, outputs),
+  TOPLEVEL_MAP("fueling", render_fueling, fueling),
+  TOPLEVEL_MAP("ignition", render_ignition, ignition),
+  TOPLEVEL_MAP("knock-control", render_knock_control, knock_control),
+  TOPLEVEL_MAP(
+    "calculation-cache", render_calculation_cache, calculation_cache),
+  TOPLEVEL_MAP("closed-loop-lambda", render_closed_loop, closed_loop),
+  TOPLEVEL_MAP("ve-learn", render_ve_learn, ve_learn),
+  { .id = "tables", .rend = render_tables },
+  TOPLEVEL_MAP("boost-control", render_boost_control, boost_control),
+  TOPLEVEL_MAP("idle-control", render_idle_control, idle_control),
+  TOPLEVEL_MAP("fan-control", render_fan_control, fan_control),
+  TOPLEVEL_MAP("cuts", render_cuts, cuts),
+  TOPLEVEL_MAP("check-engine-light", render_cel, cel),
+  TOPLEVEL_ARRAY("trigger", render_trigger_list, trigger_inputs),
+  /* Not part of the config */
+  { .id = "test", .rend = render_test },
+  { .id = "info", .rend = render_info },
+};
+
 static void console_toplevel_request(struct console_request_context *ctx,
                                      void *ptr) {
-  struct config *config = ptr;
-
-  render_map_map_field(ctx, "decoder", render_decoder, config);
-  render_map_map_field(ctx, "sensors", render_sensors, &config->sensors);
-  render_array_map_field(ctx, "outputs", render_outputs, &config->outputs);
-  render_map_map_field(ctx, "fueling", render_fueling, &config->fueling);
-  render_map_map_field(ctx, "ignition", render_ignition, &config->ignition);
-  render_map_map_field(ctx, "tables", render_tables, config);
-  render_map_map_field(
-    ctx, "boost-control", render_boost_control, &config->boost_control);
-  render_map_map_field(ctx, "check-engine-light", render_cel, &config->cel);
-  render_array_map_field(
-    ctx, "trigger", render_trigger_list, &config->trigger_inputs);
-  render_map_map_field(ctx, "test", render_test, NULL);
-  render_map_map_field(ctx, "info", render_info, NULL);
+  struct viaems *viaems = ptr;
+  const size_t n_fields =
+    sizeof(console_toplevel_fields) / sizeof(console_toplevel_fields[0]);
+
+  for (size_t i = console_stream_first_field(ctx); i < n_fields; i++) {
+    const struct console_toplevel_field *f = &console_toplevel_fields[i];
+    void *field = (char *)viaems->config + f->offset;
+    if (f->is_array) {
+      render_array_map_field(ctx, f->id, f->rend, field);
+    } else {
+      render_map_map_field(ctx, f->id, f->rend, field);
+    }
+  }
 }
 
 static void console_toplevel_types(struct console_request_context *ctx,
@@ -1603,54 +2863,146 @@ static void console_toplevel_types(struct console_request_context *ctx,
   render_map_map_field(ctx, "table2d", render_table_2d_object, &config->ve);
 }
 
-static void console_request_structure(CborEncoder *enc, struct config *config) {
-
+static void console_render_structure(CborEncoder *enc, struct viaems *viaems) {
   struct console_request_context structure_ctx = {
     .type = CONSOLE_STRUCTURE,
     .response = enc,
     .is_filtered = false,
+    .stream = &console_stream,
   };
   render_map_map_field(
-    &structure_ctx, "response", console_toplevel_request, config);
+    &structure_ctx, "response", console_toplevel_request, viaems);
 
   struct console_request_context type_ctx = {
     .type = CONSOLE_DESCRIBE,
     .response = enc,
     .is_filtered = false,
+    .stream = &console_stream,
   };
-  render_map_map_field(&type_ctx, "types", console_toplevel_types, config);
+  render_map_map_field(
+    &type_ctx, "types", console_toplevel_types, viaems->config);
+}
+
+/* The structure only changes with the firmware, so it is hashed once, at the
+ * first structure request. The hash lets a client skip fetching a structure it
+ * has, and the structure itself is rendered again for each chunk sent */
+static struct {
+  bool rendered; /* Hashing has been tried */
+  bool valid;    /* and every chunk fit */
+  uint32_t hash;
+} structure_hash;
+
+/* Renders each chunk of the structure into the unused end of the response
+ * buffer to hash it, so that no copy of the structure is kept */
+static void structure_hash_render(CborEncoder *enc, struct viaems *viaems) {
+  struct console_stream *s = &console_stream;
+  uint8_t *response_buffer = s->buffer;
+  size_t response_size = s->buffer_size;
+  size_t used = cbor_encoder_get_buffer_size(enc, response_buffer);
+  uint8_t *scratch = response_buffer + used;
+  bool fit = true;
+
+  struct crc32 crc;
+  crc32_init(&crc);
+  structure_hash.rendered = true;
+  do {
+    CborEncoder scratch_enc;
+    cbor_encoder_init(&scratch_enc, scratch, response_size - used, 0);
+    console_stream_begin_chunk(s, scratch, response_size - used);
+    console_render_structure(&scratch_enc, viaems);
+    if (cbor_encoder_get_extra_bytes_needed(&scratch_enc)) {
+      fit = false;
+      break;
+    }
+    crc32_add_bytes(
+      &crc, cbor_encoder_get_buffer_size(&scratch_enc, scratch), scratch);
+    console_stream_next_chunk(s);
+  } while (s->active);
+
+  structure_hash.valid = fit;
+  structure_hash.hash = crc32_finish(&crc);
+  console_stream_reset(s);
+  console_stream_begin_chunk(s, response_buffer, response_size);
+}
+
+static bool structure_hash_matches(CborValue *request) {
+  CborValue hash_value;
+  uint64_t hash;
+  if (!request ||
+      (cbor_value_map_find_value(request, "hash", &hash_value) !=
+       CborNoError) ||
+      !cbor_value_is_unsigned_integer(&hash_value) ||
+      (cbor_value_get_uint64(&hash_value, &hash) != CborNoError)) {
+    return false;
+  }
+  return hash == structure_hash.hash;
+}
+
+static void console_request_structure(CborEncoder *enc,
+                                      CborValue *request,
+                                      struct viaems *viaems) {
+  struct console_stream *s = &console_stream;
+
+  /* Only responses being sent are chunked, and so hashed */
+  if (s->buffer && !s->active && !structure_hash.rendered) {
+    structure_hash_render(enc, viaems);
+  }
+  if (s->buffer && structure_hash.valid) {
+    cbor_encode_text_stringz(enc, "hash");
+    cbor_encode_uint(enc, structure_hash.hash);
+
+    if (!s->active && structure_hash_matches(request)) {
+      cbor_encode_text_stringz(enc, "unchanged");
+      cbor_encode_boolean(enc, true);
+      report_success(enc, true);
+      return;
+    }
+  }
 
+  console_render_structure(enc, viaems);
   report_success(enc, true);
 }
 
 static void console_request_get(CborEncoder *enc,
                                 CborValue *pathlist,
-                                struct config *config) {
+                                struct viaems *viaems) {
   struct console_request_context ctx = {
     .type = CONSOLE_GET,
     .response = enc,
     .path = pathlist,
     .is_filtered = !cbor_value_at_end(pathlist),
+    .stream = &console_stream,
   };
   cbor_encode_text_stringz(enc, "response");
-  render_map_object(&ctx, console_toplevel_request, config);
+  render_map_object(&ctx, console_toplevel_request, viaems);
   report_success(enc, true);
 }
 
+/* The whole set is applied with the first chunk, so the engine never runs on
+ * a partly set config, and the response is the resulting values as for a get
+ * of the same path */
 static void console_request_set(CborEncoder *enc,
                                 CborValue *pathlist,
                                 CborValue *value,
-                                struct config *config) {
-  struct console_request_context ctx = {
-    .type = CONSOLE_SET,
-    .response = enc,
-    .path = pathlist,
-    .is_filtered = !cbor_value_at_end(pathlist),
-    .value = *value,
-  };
-  cbor_encode_text_stringz(enc, "response");
-  render_map_object(&ctx, console_toplevel_request, config);
-  report_success(enc, true);
+                                struct viaems *viaems) {
+  if (!console_stream.active) {
+    /* Only the size of the unsplit response is counted */
+    CborEncoder discard;
+    cbor_encoder_init(&discard, NULL, 0, 0);
+    CborValue path = *pathlist;
+    struct console_request_context ctx = {
+      .type = CONSOLE_SET,
+      .response = &discard,
+      .path = &path,
+      .is_filtered = !cbor_value_at_end(&path),
+      .value = *value,
+    };
+    render_map_object(&ctx, console_toplevel_request, viaems);
+
+    /* Anything cached from the previous config is stale */
+    viaems->calculations.cache.valid = false;
+  }
+  console_request_get(enc, pathlist, viaems);
 }
 
 static void console_request_flash(CborEncoder *response) {
@@ -1658,6 +3010,407 @@ static void console_request_flash(CborEncoder *response) {
   report_success(response, true);
 }
 
+/* Learned VE, per-cell hits and confidence, as arrays of rows matching
+ * tables/ve */
+static void console_request_ve_learn(CborEncoder *enc,
+                                     const struct ve_learn *state) {
+  const struct table_2d *t = &state->table;
+  const uint32_t rows = state->initialized ? t->rows.num : 0;
+  const uint32_t cols = state->initialized ? t->cols.num : 0;
+
+  cbor_encode_text_stringz(enc, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(enc, &result, 5);
+
+  cbor_encode_text_stringz(&result, "samples");
+  cbor_encode_uint(&result, state->samples);
+  cbor_encode_text_stringz(&result, "dropped");
+  cbor_encode_uint(&result, state->dropped);
+
+  CborEncoder rowlist;
+  CborEncoder row;
+  cbor_encode_text_stringz(&result, "ve");
+  cbor_encoder_create_array(&result, &rowlist, rows);
+  for (uint32_t r = 0; r < rows; r++) {
+    cbor_encoder_create_array(&rowlist, &row, cols);
+    for (uint32_t c = 0; c < cols; c++) {
+      cbor_encode_float(&row, t->data[r][c]);
+    }
+    cbor_encoder_close_container(&rowlist, &row);
+  }
+  cbor_encoder_close_container(&result, &rowlist);
+
+  cbor_encode_text_stringz(&result, "hits");
+  cbor_encoder_create_array(&result, &rowlist, rows);
+  for (uint32_t r = 0; r < rows; r++) {
+    cbor_encoder_create_array(&rowlist, &row, cols);
+    for (uint32_t c = 0; c < cols; c++) {
+      cbor_encode_uint(&row, state->hits[r][c]);
+    }
+    cbor_encoder_close_container(&rowlist, &row);
+  }
+  cbor_encoder_close_container(&result, &rowlist);
+
+  cbor_encode_text_stringz(&result, "confidence");
+  cbor_encoder_create_array(&result, &rowlist, rows);
+  for (uint32_t r = 0; r < rows; r++) {
+    cbor_encoder_create_array(&rowlist, &row, cols);
+    for (uint32_t c = 0; c < cols; c++) {
+      cbor_encode_float(&row, state->confidence[r][c]);
+    }
+    cbor_encoder_close_container(&rowlist, &row);
+  }
+  cbor_encoder_close_container(&result, &rowlist);
+
+  cbor_encoder_close_container(enc, &result);
+  report_success(enc, true);
+}
+
+static void console_request_ve_learn_commit(CborEncoder *enc,
+                                            struct viaems *viaems) {
+  uint32_t committed = ve_learn_commit(viaems->config, &viaems->ve_learn);
+  viaems->calculations.cache.valid = false;
+
+  cbor_encode_text_stringz(enc, "response");
+  cbor_encode_uint(enc, committed);
+  report_success(enc, true);
+}
+
+static void console_request_ve_learn_reset(CborEncoder *enc,
+                                           struct viaems *viaems) {
+  ve_learn_reset(&viaems->ve_learn);
+  report_success(enc, true);
+}
+
+/* Per-task run counts and execution times (ns), keyed by task name */
+static void console_request_tasks(CborEncoder *enc, const struct tasks *tasks) {
+  cbor_encode_text_stringz(enc, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(enc, &result, NUM_TASKS);
+
+  for (int i = 0; i < NUM_TASKS; i++) {
+    const struct task_stats *stats = &tasks->stats[i];
+    cbor_encode_text_stringz(&result, task_table[i].name);
+
+    CborEncoder task;
+    cbor_encoder_create_map(&result, &task, 4);
+    cbor_encode_text_stringz(&task, "period");
+    cbor_encode_uint(&task, task_table[i].period);
+    cbor_encode_text_stringz(&task, "runs");
+    cbor_encode_uint(&task, stats->runs);
+    cbor_encode_text_stringz(&task, "last-ns");
+    cbor_encode_uint(&task, cycles_to_ns(stats->last_cycles));
+    cbor_encode_text_stringz(&task, "max-ns");
+    cbor_encode_uint(&task, cycles_to_ns(stats->max_cycles));
+    cbor_encoder_close_container(&result, &task);
+  }
+
+  cbor_encoder_close_container(enc, &result);
+  report_success(enc, true);
+}
+
+#ifdef SPANS
+/* Limits a response while spans are recorded faster than they are read */
+#define SPANS_PER_RESPONSE 256
+
+/* Dequeues the recorded spans as [name, start, end] cycle counts, along with
+ * the length of a cycle in picoseconds and the total spans dropped */
+static void console_request_spans(CborEncoder *enc) {
+  cbor_encode_text_stringz(enc, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(enc, &result, 3);
+  cbor_encode_text_stringz(&result, "cycle-ps");
+  cbor_encode_uint(&result, cycles_to_ns(1000));
+  cbor_encode_text_stringz(&result, "dropped");
+  cbor_encode_uint(&result, span_dropped());
+
+  cbor_encode_text_stringz(&result, "spans");
+  CborEncoder spans;
+  cbor_encoder_create_array(&result, &spans, CborIndefiniteLength);
+  struct span s;
+  for (int i = 0; (i < SPANS_PER_RESPONSE) && span_next(&s); i++) {
+    CborEncoder span;
+    cbor_encoder_create_array(&spans, &span, 3);
+    cbor_encode_text_stringz(&span, span_names[s.id]);
+    cbor_encode_uint(&span, s.start);
+    cbor_encode_uint(&span, s.end);
+    cbor_encoder_close_container(&spans, &span);
+  }
+  cbor_encoder_close_container(&result, &spans);
+
+  cbor_encoder_close_container(enc, &result);
+  report_success(enc, true);
+}
+#endif
+
+/* Log2 histograms of each span's duration in cycles, with the longest in ns.
+ * They are cleared after being reported if 'reset' is set */
+static void console_request_stats(CborEncoder *enc, CborValue *request) {
+  bool reset = false;
+  CborValue reset_value;
+  cbor_value_map_find_value(request, "reset", &reset_value);
+  if (cbor_value_is_boolean(&reset_value)) {
+    cbor_value_get_boolean(&reset_value, &reset);
+  }
+
+  cbor_encode_text_stringz(enc, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(enc, &result, NUM_SPANS + 1);
+  cbor_encode_text_stringz(&result, "cycle-ps");
+  cbor_encode_uint(&result, cycles_to_ns(1000));
+
+  for (int i = 0; i < NUM_SPANS; i++) {
+    struct span_histogram h = *span_histogram(i);
+    cbor_encode_text_stringz(&result, span_names[i]);
+
+    CborEncoder stats;
+    cbor_encoder_create_map(&result, &stats, 3);
+    cbor_encode_text_stringz(&stats, "count");
+    cbor_encode_uint(&stats, h.count);
+    cbor_encode_text_stringz(&stats, "max-ns");
+    cbor_encode_uint(&stats, cycles_to_ns(h.max_cycles));
+    cbor_encode_text_stringz(&stats, "buckets");
+    CborEncoder buckets;
+    cbor_encoder_create_array(&stats, &buckets, SPAN_HISTOGRAM_BUCKETS);
+    for (int b = 0; b < SPAN_HISTOGRAM_BUCKETS; b++) {
+      cbor_encode_uint(&buckets, h.buckets[b]);
+    }
+    cbor_encoder_close_container(&stats, &buckets);
+    cbor_encoder_close_container(&result, &stats);
+  }
+  cbor_encoder_close_container(enc, &result);
+
+  if (reset) {
+    span_histograms_reset();
+  }
+  report_success(enc, true);
+}
+
+static void encode_sensor_fault_stats(CborEncoder *enc,
+                                      const char *name,
+                                      const struct sensor_state *sensor) {
+  const struct sensor_fault_stats *stats = &sensor->fault_stats;
+  cbor_encode_text_stringz(enc, name);
+  CborEncoder map;
+  cbor_encoder_create_map(enc, &map, 4);
+  cbor_encode_text_stringz(&map, "active");
+  cbor_encode_boolean(&map, stats->active);
+  cbor_encode_text_stringz(&map, "total");
+  cbor_encode_uint(&map, stats->total);
+  cbor_encode_text_stringz(&map, "longest-us");
+  cbor_encode_uint(&map, us_from_time(stats->longest));
+  cbor_encode_text_stringz(&map, "last");
+  cbor_encode_uint(&map, stats->start);
+  cbor_encoder_close_container(enc, &map);
+}
+
+/* Fault statistics of each sensor since startup. They are runtime state, so
+ * they are kept out of the config tree */
+static void console_request_sensor_faults(CborEncoder *enc,
+                                          const struct sensors *sensors) {
+  cbor_encode_text_stringz(enc, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(enc, &result, 12);
+  encode_sensor_fault_stats(&result, "map", &sensors->MAP);
+  encode_sensor_fault_stats(&result, "iat", &sensors->IAT);
+  encode_sensor_fault_stats(&result, "clt", &sensors->CLT);
+  encode_sensor_fault_stats(&result, "brv", &sensors->BRV);
+  encode_sensor_fault_stats(&result, "tps", &sensors->TPS);
+  encode_sensor_fault_stats(&result, "aap", &sensors->AAP);
+  encode_sensor_fault_stats(&result, "frt", &sensors->FRT);
+  encode_sensor_fault_stats(&result, "ego", &sensors->EGO);
+  encode_sensor_fault_stats(&result, "frp", &sensors->FRP);
+  encode_sensor_fault_stats(&result, "eth", &sensors->ETH);
+  encode_sensor_fault_stats(&result, "clu", &sensors->CLU);
+  encode_sensor_fault_stats(&result, "vss", &sensors->VSS);
+  cbor_encoder_close_container(enc, &result);
+  report_success(enc, true);
+}
+
+/* The most recent completed MAP windows, collected from the sensors every
+ * console pass */
+static struct sensor_window_history console_map_windows;
+
+/* Returns the statistics of the last 'count' completed MAP windows, or all of
+ * those kept, newest first */
+static void console_request_map_windows(CborEncoder *enc, CborValue *request) {
+  uint64_t count = SENSOR_WINDOW_HISTORY;
+  CborValue count_value;
+  cbor_value_map_find_value(request, "count", &count_value);
+  if (cbor_value_is_unsigned_integer(&count_value)) {
+    cbor_value_get_uint64(&count_value, &count);
+  }
+
+  sensors_collect_map_windows(&console_map_windows);
+
+  cbor_encode_text_stringz(enc, "response");
+  CborEncoder windows;
+  cbor_encoder_create_array(enc, &windows, CborIndefiniteLength);
+  for (uint32_t age = 0; age < count; age++) {
+    const struct sensor_window *w =
+      sensor_window_get(&console_map_windows, age);
+    if (!w) {
+      break;
+    }
+    CborEncoder window;
+    cbor_encoder_create_map(&windows, &window, 6);
+    cbor_encode_text_stringz(&window, "start");
+    cbor_encode_float(&window, w->start);
+    cbor_encode_text_stringz(&window, "min");
+    cbor_encode_float(&window, w->min);
+    cbor_encode_text_stringz(&window, "min-angle");
+    cbor_encode_float(&window, w->min_angle);
+    cbor_encode_text_stringz(&window, "max");
+    cbor_encode_float(&window, w->max);
+    cbor_encode_text_stringz(&window, "mean");
+    cbor_encode_float(&window, w->mean);
+    cbor_encode_text_stringz(&window, "samples");
+    cbor_encode_uint(&window, w->sample_count);
+    cbor_encoder_close_container(&windows, &window);
+  }
+  cbor_encoder_close_container(enc, &windows);
+  report_success(enc, true);
+}
+
+/* Selects the feed format if a 'format' is provided, and whether dropped
+ * updates are coalesced if 'coalesce' is, and responds with the settings in
+ * use */
+static void console_request_feed(CborEncoder *response, CborValue *request) {
+  CborValue format_value, coalesce_value;
+  cbor_value_map_find_value(request, "format", &format_value);
+  if (cbor_value_is_text_string(&format_value)) {
+    if (console_string_matches(&format_value, "cbor")) {
+      console_feed.format = FEED_FORMAT_CBOR;
+    } else if (console_string_matches(&format_value, "packed")) {
+      console_feed.format = FEED_FORMAT_PACKED;
+    } else if (console_string_matches(&format_value, "delta")) {
+      console_feed.format = FEED_FORMAT_DELTA;
+    } else {
+      report_parsing_error(response, "unknown 'format'");
+      return;
+    }
+    /* Clients must see the new layout before any feed in it */
+    console_feed.describe = true;
+  }
+
+  cbor_value_map_find_value(request, "coalesce", &coalesce_value);
+  if (cbor_value_is_boolean(&coalesce_value)) {
+    cbor_value_get_boolean(&coalesce_value, &console_feed.coalesce);
+  }
+
+  cbor_encode_text_stringz(response, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(response, &result, 2);
+  cbor_encode_text_stringz(&result, "format");
+  cbor_encode_text_stringz(&result, feed_format_name(console_feed.format));
+  cbor_encode_text_stringz(&result, "coalesce");
+  cbor_encode_boolean(&result, console_feed.coalesce);
+  cbor_encoder_close_container(response, &result);
+  report_success(response, true);
+}
+
+/* Subscribes to the feed fields in 'keys', sent every 'decimation' engine
+ * updates, and responds with the subscription's index */
+static void console_request_subscribe(CborEncoder *response,
+                                      CborValue *request) {
+  CborValue keys_value, decimation_value;
+  cbor_value_map_find_value(request, "keys", &keys_value);
+  if (!cbor_value_is_array(&keys_value)) {
+    report_parsing_error(response, "no 'keys' provided");
+    return;
+  }
+
+  int decimation = 1;
+  cbor_value_map_find_value(request, "decimation", &decimation_value);
+  if (cbor_value_is_integer(&decimation_value)) {
+    cbor_value_get_int_checked(&decimation_value, &decimation);
+  }
+  if (decimation < 1) {
+    report_parsing_error(response, "invalid 'decimation'");
+    return;
+  }
+
+  int id;
+  for (id = 0; id < FEED_MAX_SUBSCRIPTIONS; id++) {
+    if (!console_feed.subscriptions[id].active) {
+      break;
+    }
+  }
+  if (id == FEED_MAX_SUBSCRIPTIONS) {
+    report_parsing_error(response, "too many subscriptions");
+    return;
+  }
+
+  /* The subscription is inactive, and so untouched by
+   * record_engine_update, until it is complete */
+  struct console_feed_subscription *sub = &console_feed.subscriptions[id];
+  *sub = (struct console_feed_subscription){
+    .decimation = decimation,
+    .generation = sub->generation + 1,
+  };
+
+  CborValue key;
+  cbor_value_enter_container(&keys_value, &key);
+  while (!cbor_value_at_end(&key)) {
+    size_t field;
+    for (field = 0; field < NUM_FEED_FIELDS; field++) {
+      if (console_string_matches(&key, console_feed_fields[field].name)) {
+        break;
+      }
+    }
+    if (field == NUM_FEED_FIELDS) {
+      report_parsing_error(response, "unknown key");
+      return;
+    }
+
+    bool duplicate = false;
+    for (size_t i = 0; i < sub->n_fields; i++) {
+      duplicate |= (sub->fields[i] == field);
+    }
+    if (!duplicate) {
+      sub->fields[sub->n_fields++] = field;
+      sub->groups |= console_feed_fields[field].group;
+    }
+    cbor_value_advance(&key);
+  }
+
+  atomic_store_explicit(&sub->active, true, memory_order_release);
+  console_feed.describe = true;
+
+  cbor_encode_text_stringz(response, "response");
+  CborEncoder result;
+  cbor_encoder_create_map(response, &result, 1);
+  cbor_encode_text_stringz(&result, "subscription");
+  cbor_encode_int(&result, id);
+  cbor_encoder_close_container(response, &result);
+  report_success(response, true);
+}
+
+/* Removes the subscription 'subscription', or all of them if none is given.
+ * Without subscriptions the full feed resumes */
+static void console_request_unsubscribe(CborEncoder *response,
+                                        CborValue *request) {
+  CborValue id_value;
+  cbor_value_map_find_value(request, "subscription", &id_value);
+  if (cbor_value_is_integer(&id_value)) {
+    int id;
+    cbor_value_get_int_checked(&id_value, &id);
+    if ((id < 0) || (id >= FEED_MAX_SUBSCRIPTIONS) ||
+        !console_feed.subscriptions[id].active) {
+      report_parsing_error(response, "invalid 'subscription'");
+      return;
+    }
+    console_feed.subscriptions[id].active = false;
+  } else {
+    for (int i = 0; i < FEED_MAX_SUBSCRIPTIONS; i++) {
+      console_feed.subscriptions[i].active = false;
+    }
+  }
+
+  console_feed.describe = true;
+  report_success(response, true);
+}
+
 static void console_request_bootloader(CborEncoder *response) {
   report_success(response, true);
   platform_reset_into_bootloader();
@@ -1665,7 +3418,7 @@ static void console_request_bootloader(CborEncoder *response) {
 
 static void console_process_request(CborValue *request,
                                     CborEncoder *response,
-                                    struct config *config) {
+                                    struct viaems *viaems) {
   cbor_encode_text_stringz(response, "type");
   cbor_encode_text_stringz(response, "response");
 
@@ -1697,7 +3450,7 @@ static void console_process_request(CborValue *request,
 
   cbor_value_text_string_equals(&request_method_value, "structure", &match);
   if (match) {
-    console_request_structure(response, config);
+    console_request_structure(response, request, viaems);
     return;
   }
 
@@ -1713,6 +3466,77 @@ static void console_process_request(CborValue *request,
     return;
   }
 
+  cbor_value_text_string_equals(&request_method_value, "ve-learn", &match);
+  if (match) {
+    console_request_ve_learn(response, &viaems->ve_learn);
+    return;
+  }
+
+  cbor_value_text_string_equals(
+    &request_method_value, "ve-learn-commit", &match);
+  if (match) {
+    console_request_ve_learn_commit(response, viaems);
+    return;
+  }
+
+  cbor_value_text_string_equals(
+    &request_method_value, "ve-learn-reset", &match);
+  if (match) {
+    console_request_ve_learn_reset(response, viaems);
+    return;
+  }
+
+  cbor_value_text_string_equals(&request_method_value, "tasks", &match);
+  if (match) {
+    console_request_tasks(response, &viaems->tasks);
+    return;
+  }
+
+#ifdef SPANS
+  cbor_value_text_string_equals(&request_method_value, "spans", &match);
+  if (match) {
+    console_request_spans(response);
+    return;
+  }
+#endif
+
+  cbor_value_text_string_equals(&request_method_value, "stats", &match);
+  if (match) {
+    console_request_stats(response, request);
+    return;
+  }
+
+  cbor_value_text_string_equals(
+    &request_method_value, "sensor-faults", &match);
+  if (match) {
+    console_request_sensor_faults(response, &viaems->sensors);
+    return;
+  }
+
+  cbor_value_text_string_equals(&request_method_value, "map-windows", &match);
+  if (match) {
+    console_request_map_windows(response, request);
+    return;
+  }
+
+  cbor_value_text_string_equals(&request_method_value, "feed", &match);
+  if (match) {
+    console_request_feed(response, request);
+    return;
+  }
+
+  cbor_value_text_string_equals(&request_method_value, "subscribe", &match);
+  if (match) {
+    console_request_subscribe(response, request);
+    return;
+  }
+
+  cbor_value_text_string_equals(&request_method_value, "unsubscribe", &match);
+  if (match) {
+    console_request_unsubscribe(response, request);
+    return;
+  }
+
   CborValue path, pathlist;
   cbor_value_map_find_value(request, "path", &path);
   if (cbor_value_is_array(&path)) {
@@ -1724,7 +3548,7 @@ static void console_process_request(CborValue *request,
 
   cbor_value_text_string_equals(&request_method_value, "get", &match);
   if (match) {
-    console_request_get(response, &pathlist, config);
+    console_request_get(response, &pathlist, viaems);
     return;
   }
 
@@ -1737,15 +3561,65 @@ static void console_process_request(CborValue *request,
 
   cbor_value_text_string_equals(&request_method_value, "set", &match);
   if (match) {
-    console_request_set(response, &pathlist, &set_value, config);
+    console_request_set(response, &pathlist, &set_value, viaems);
+    return;
+  }
+}
+
+static void console_stream_begin_chunk(struct console_stream *s,
+                                       uint8_t *buffer,
+                                       size_t buffer_size) {
+  s->buffer = buffer;
+  s->buffer_size = buffer_size;
+  /* A filtered get starts counting fields below the top */
+  for (int i = 0; i < CONSOLE_STREAM_DEPTH; i++) {
+    s->siblings[i] = 0;
+  }
+  s->sent_field = false;
+  s->full = false;
+}
+
+static void console_stream_reset(struct console_stream *s) {
+  s->active = false;
+  s->chunk = 0;
+  s->resume_depth = 0;
+}
+
+/* Moves on to the next chunk if the last one was full, or finishes */
+static void console_stream_next_chunk(struct console_stream *s) {
+  if (s->full) {
+    s->active = true;
+    s->chunk++;
+    for (int i = 0; i < s->next_depth; i++) {
+      s->resume[i] = s->next[i];
+    }
+    s->resume_depth = s->next_depth;
+  } else {
+    console_stream_reset(s);
+  }
+}
+
+/* Marks a chunked response with its chunk index and whether more follow, and
+ * sets where the next chunk resumes */
+static void console_stream_end_chunk(struct console_stream *s,
+                                     CborEncoder *response) {
+  s->buffer = NULL;
+  if (!s->full && !s->active) {
     return;
   }
+
+  cbor_encode_text_stringz(response, "chunk");
+  cbor_encode_uint(response, s->chunk);
+  cbor_encode_text_stringz(response, "more");
+  cbor_encode_boolean(response, s->full);
+
+  console_stream_next_chunk(s);
 }
 
 static void console_process_request_raw(uint8_t respbuffer[],
                                         size_t resplen,
                                         int len,
-                                        struct config *config) {
+                                        struct viaems *viaems) {
   CborParser parser;
   CborValue value;
   CborError err;
@@ -1765,7 +3639,9 @@ static void console_process_request_raw(uint8_t respbuffer[],
     return;
   }
 
-  console_process_request(&value, &response_map, config);
+  console_stream_begin_chunk(&console_stream, respbuffer, resplen);
+  console_process_request(&value, &response_map, viaems);
+  console_stream_end_chunk(&console_stream, &response_map);
 
   if (cbor_encoder_close_container(&encoder, &response_map)) {
     return;
@@ -1775,44 +3651,68 @@ static void console_process_request_raw(uint8_t respbuffer[],
   console_write_full(respbuffer, write_size);
 }
 
-void console_process(struct config *config, timeval_t now) {
+void console_process(struct viaems *viaems, timeval_t now) {
   static timeval_t last_desc_time = 0;
   static uint8_t txbuffer[16384];
 
-  size_t read_size;
-  if ((read_size = console_try_read())) {
+  /* Send the next chunk of a large response before reading another request,
+   * its request is kept until the last chunk is sent */
+  size_t read_size = console_stream.active ? console_stream.request_size
+                                           : console_try_read();
+  if (read_size) {
     /* Parse a request from the client */
-    console_process_request_raw(txbuffer, sizeof(txbuffer), read_size, config);
-    console_shift_rx_buffer(read_size);
+    console_stream.request_size = read_size;
+    console_process_request_raw(txbuffer, sizeof(txbuffer), read_size, viaems);
+    if (!console_stream.active) {
+      console_shift_rx_buffer(read_size);
+    }
   }
 
+  sensors_collect_map_windows(&console_map_windows);
+
   /* Process any outstanding event messages */
-  struct logged_event ev = get_logged_event();
+  uint32_t dropped;
+  struct logged_event ev = get_logged_event(&dropped);
   if (ev.type != EVENT_NONE) {
     uint8_t *txptr = txbuffer;
     size_t txsize = 0;
 
     do {
       size_t txremaining = sizeof(txbuffer) - txsize;
-      size_t write_size = console_event_message(txptr, txremaining, &ev);
+      size_t write_size =
+        console_event_message(txptr, txremaining, &ev, dropped);
       txsize += write_size;
       txptr += write_size;
-      ev = get_logged_event();
+      ev = get_logged_event(&dropped);
     } while (ev.type != EVENT_NONE);
 
     console_write_full(txbuffer, txsize);
   }
 
   /* Try to ensure we send a description message at 10 hz */
-  if (time_diff(now, last_desc_time) > time_from_us(100000)) {
+  if (console_feed.describe ||
+      (time_diff(now, last_desc_time) > time_from_us(100000))) {
     size_t write_size = console_feed_line_keys(txbuffer, sizeof(txbuffer));
     console_write_full(txbuffer, write_size);
     last_desc_time = now;
+    console_feed.describe = false;
   } else {
     int idx = spsc_next(&engine_update_queue);
     if (idx >= 0) {
       struct console_feed_update *update = &engine_update_msgs[idx];
-      size_t write_size = console_feed_line(update, txbuffer, sizeof(txbuffer));
+      const struct console_feed_summary *summary = feed_summary_for(update);
+      size_t write_size = 0;
+      for (int i = 0; i <= FEED_MAX_SUBSCRIPTIONS; i++) {
+        if (!feed_update_is_current(update, i)) {
+          continue;
+        }
+        write_size += console_feed_line(i,
+                                        update,
+                                        summary,
+                                        txbuffer + write_size,
+                                        sizeof(txbuffer) - write_size);
+      }
+      feed_summary_release(update);
       spsc_release(&engine_update_queue);
       console_write_full(txbuffer, write_size);
     }
@@ -1939,7 +3839,8 @@ END_TEST
 START_TEST(test_smoke_console_request_structure) {
   CborEncoder structure_enc;
   cbor_encoder_create_map(&test_ctx.top_encoder, &structure_enc, 1);
-  console_request_structure(&structure_enc, &default_config);
+  struct viaems viaems = { .config = &default_config };
+  console_request_structure(&structure_enc, NULL, &viaems);
   cbor_encoder_close_container(&test_ctx.top_encoder, &structure_enc);
   finish_writing();
 
@@ -1973,14 +3874,123 @@ START_TEST(test_smoke_console_request_structure) {
 }
 END_TEST
 
+/* Requests the structure as console_process_request_raw does, copying any
+ * spliced fields into place in test_ctx.buf */
+static void request_structure(struct viaems *viaems,
+                              bool with_hash,
+                              uint32_t hash) {
+  CborEncoder enc, map;
+  cbor_encoder_init(&enc, test_ctx.pathbuf, sizeof(test_ctx.pathbuf), 0);
+  cbor_encoder_create_map(&enc, &map, CborIndefiniteLength);
+  if (with_hash) {
+    cbor_encode_text_stringz(&map, "hash");
+    cbor_encode_uint(&map, hash);
+  }
+  cbor_encoder_close_container(&enc, &map);
+  CborValue request;
+  cbor_parser_init(test_ctx.pathbuf,
+                   sizeof(test_ctx.pathbuf),
+                   0,
+                   &test_ctx.path_parser,
+                   &request);
+
+  init_console_tests();
+  cbor_encoder_create_map(&test_ctx.top_encoder, &map, CborIndefiniteLength);
+  console_stream_begin_chunk(
+    &console_stream, test_ctx.buf, sizeof(test_ctx.buf));
+  console_request_structure(&map, &request, viaems);
+  console_stream_end_chunk(&console_stream, &map);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &map);
+  finish_writing();
+  ck_assert(cbor_value_validate_basic(&test_ctx.top_value) == CborNoError);
+}
+
+static uint64_t response_uint(const char *key) {
+  CborValue value;
+  uint64_t result = UINT64_MAX;
+  cbor_value_map_find_value(&test_ctx.top_value, key, &value);
+  cbor_value_get_uint64(&value, &result);
+  return result;
+}
+
+START_TEST(test_console_structure_hashed) {
+  struct viaems viaems = { .config = &default_config };
+  structure_hash.rendered = false;
+
+  uint32_t chunks = 0;
+  CborValue value;
+  do {
+    request_structure(&viaems, false, 0);
+    ck_assert(structure_hash.valid);
+    ck_assert_uint_eq(response_uint("hash"), structure_hash.hash);
+    ck_assert_uint_eq(response_uint("chunk"), chunks);
+
+    if (chunks == 0) {
+      CborValue decoder, offset, type;
+      cbor_value_map_find_value(&test_ctx.top_value, "response", &value);
+      cbor_value_map_find_value(&value, "decoder", &decoder);
+      cbor_value_map_find_value(&decoder, "offset", &offset);
+      cbor_value_map_find_value(&offset, "_type", &type);
+      ck_assert(console_string_matches(&type, "float"));
+    }
+    chunks++;
+  } while (console_stream.active && (chunks < 32));
+
+  ck_assert(!console_stream.active);
+  ck_assert_int_gt(chunks, 2);
+
+  /* The types are last */
+  CborValue table2d;
+  cbor_value_map_find_value(&test_ctx.top_value, "types", &value);
+  cbor_value_map_find_value(&value, "table2d", &table2d);
+  ck_assert(cbor_value_is_map(&table2d));
+
+  /* The structure does not depend on the configuration */
+  uint32_t hash = structure_hash.hash;
+  static struct config config;
+  config = default_config;
+  config.decoder.offset = 12.0f;
+  config.ve.cols.num = 2;
+  strcpy(config.ve.title, "changed");
+  viaems.config = &config;
+  structure_hash.rendered = false;
+  request_structure(&viaems, false, 0);
+  ck_assert_uint_eq(structure_hash.hash, hash);
+  console_stream_reset(&console_stream);
+
+  /* A client that has the structure is only sent the hash */
+  request_structure(&viaems, true, hash);
+  ck_assert(!console_stream.active);
+  ck_assert_uint_eq(response_uint("hash"), hash);
+  cbor_value_map_find_value(&test_ctx.top_value, "unchanged", &value);
+  ck_assert(cbor_value_is_boolean(&value));
+  cbor_value_map_find_value(&test_ctx.top_value, "response", &value);
+  ck_assert(!cbor_value_is_valid(&value));
+
+  request_structure(&viaems, true, hash + 1);
+  cbor_value_map_find_value(&test_ctx.top_value, "response", &value);
+  ck_assert(cbor_value_is_map(&value));
+  ck_assert(console_stream.active);
+  console_stream_reset(&console_stream);
+}
+END_TEST
+
 START_TEST(test_smoke_console_request_get_full) {
 
   render_path("");
 
+  /* A full get is larger than the transmit buffer, so is sent in chunks */
   CborEncoder get_enc;
-  cbor_encoder_create_map(&test_ctx.top_encoder, &get_enc, 1);
-  console_request_get(&get_enc, &test_ctx.path_value, &default_config);
+  cbor_encoder_create_map(
+    &test_ctx.top_encoder, &get_enc, CborIndefiniteLength);
+  struct viaems viaems = { .config = &default_config };
+  console_stream_begin_chunk(
+    &console_stream, test_ctx.buf, sizeof(test_ctx.buf));
+  console_request_get(&get_enc, &test_ctx.path_value, &viaems);
+  console_stream_end_chunk(&console_stream, &get_enc);
   cbor_encoder_close_container(&test_ctx.top_encoder, &get_enc);
+  ck_assert(console_stream.active);
+  console_stream_reset(&console_stream);
   finish_writing();
 
   ck_assert(cbor_value_validate_basic(&test_ctx.top_value) == CborNoError);
@@ -2004,76 +4014,956 @@ START_TEST(test_smoke_console_request_get_full) {
 }
 END_TEST
 
+START_TEST(test_console_set_invalidates_calculation_cache) {
+  static struct config config;
+  config = default_config;
+  config.calculation_cache.enabled = true;
+  static struct viaems viaems;
+  viaems = (struct viaems){ .config = &config };
+
+  struct engine_update update = {
+    .position = {
+      .valid_until = -1,
+      .has_rpm = true,
+      .rpm = 3000,
+      .tooth_rpm = 3000,
+    },
+    .sensors = {
+      .IAT = { .value = 30 },
+      .BRV = { .value = 14 },
+      .MAP = { .value = 60 },
+      .FRT = { .value = 15 },
+      .CLT = { .value = 85 },
+      .TPS = { .value = 20, .derivative = 0 },
+    },
+  };
+  struct calculated_values before =
+    calculate_ignition_and_fuel(&config, &update, &viaems.calculations);
+  ck_assert(viaems.calculations.cache.valid);
+
+  /* A get leaves the cache alone */
+  render_path("");
+  CborEncoder enc;
+  cbor_encoder_create_map(&test_ctx.top_encoder, &enc, CborIndefiniteLength);
+  console_request_get(&enc, &test_ctx.path_value, &viaems);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &enc);
+  ck_assert(viaems.calculations.cache.valid);
+
+  /* Set every timing cell at the same inputs */
+  static uint8_t valuebuf[8192];
+  CborEncoder value_enc, rows;
+  cbor_encoder_init(&value_enc, valuebuf, sizeof(valuebuf), 0);
+  cbor_encoder_create_array(&value_enc, &rows, config.timing.rows.num);
+  for (unsigned r = 0; r < config.timing.rows.num; r++) {
+    CborEncoder cols;
+    cbor_encoder_create_array(&rows, &cols, config.timing.cols.num);
+    for (unsigned c = 0; c < config.timing.cols.num; c++) {
+      cbor_encode_float(&cols, before.timing_advance + 5.0f);
+    }
+    cbor_encoder_close_container(&rows, &cols);
+  }
+  cbor_encoder_close_container(&value_enc, &rows);
+  CborParser value_parser;
+  CborValue value;
+  cbor_parser_init(valuebuf, sizeof(valuebuf), 0, &value_parser, &value);
+
+  init_console_tests();
+  render_path("sss", "tables", "timing", "data");
+  cbor_encoder_create_map(&test_ctx.top_encoder, &enc, CborIndefiniteLength);
+  console_request_set(&enc, &test_ctx.path_value, &value, &viaems);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &enc);
+  ck_assert(!viaems.calculations.cache.valid);
+
+  struct calculated_values after =
+    calculate_ignition_and_fuel(&config, &update, &viaems.calculations);
+  ck_assert_float_eq_tol(
+    after.timing_advance, before.timing_advance + 5.0f, 0.01f);
+}
+END_TEST
+
+/* Sets tables to value, sending one chunk of the response */
+static void set_tables_chunk(struct viaems *viaems, CborValue *value) {
+  init_console_tests();
+  render_path("s", "tables");
+  CborEncoder enc;
+  cbor_encoder_create_map(&test_ctx.top_encoder, &enc, CborIndefiniteLength);
+  console_stream_begin_chunk(
+    &console_stream, test_ctx.buf, sizeof(test_ctx.buf));
+  console_request_set(&enc, &test_ctx.path_value, value, viaems);
+  console_stream_end_chunk(&console_stream, &enc);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &enc);
+  finish_writing();
+}
+
+START_TEST(test_console_set_chunked) {
+  static struct config config;
+  config = default_config;
+  static struct viaems viaems;
+  viaems = (struct viaems){ .config = &config };
+
+  /* Retitle every table */
+  init_console_tests();
+  render_path("s", "tables");
+  CborEncoder enc;
+  cbor_encoder_create_map(&test_ctx.top_encoder, &enc, CborIndefiniteLength);
+  console_request_get(&enc, &test_ctx.path_value, &viaems);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &enc);
+  finish_writing();
+
+  static uint8_t valuebuf[4096];
+  CborEncoder value_enc, tables_enc;
+  cbor_encoder_init(&value_enc, valuebuf, sizeof(valuebuf), 0);
+  cbor_encoder_create_map(&value_enc, &tables_enc, CborIndefiniteLength);
+  CborValue response, table;
+  cbor_value_map_find_value(&test_ctx.top_value, "response", &response);
+  cbor_value_enter_container(&response, &table);
+  int n_tables = 0;
+  while (!cbor_value_at_end(&table)) {
+    char name[MAX_TABLE_TITLE_SIZE + 1];
+    size_t len = sizeof(name);
+    cbor_value_copy_text_string(&table, name, &len, &table);
+    cbor_value_advance(&table);
+
+    CborEncoder fields;
+    cbor_encode_text_stringz(&tables_enc, name);
+    cbor_encoder_create_map(&tables_enc, &fields, 1);
+    cbor_encode_text_stringz(&fields, "title");
+    cbor_encode_text_stringz(&fields, "chunked");
+    cbor_encoder_close_container(&tables_enc, &fields);
+    n_tables++;
+  }
+  cbor_encoder_close_container(&value_enc, &tables_enc);
+  ck_assert_int_gt(n_tables, 2);
+
+  CborParser value_parser;
+  CborValue value;
+  cbor_parser_init(valuebuf, sizeof(valuebuf), 0, &value_parser, &value);
+
+  /* Every table is set with the first chunk of the response */
+  set_tables_chunk(&viaems, &value);
+  ck_assert(console_stream.active);
+  ck_assert_str_eq(config.ve.title, "chunked");
+  ck_assert_str_eq(config.lambda_ltt.title, "chunked");
+  ck_assert_str_eq(config.commanded_lambda.title, "chunked");
+
+  /* and the later chunks only send the response */
+  strcpy(config.ve.title, "changed");
+  int chunks = 1;
+  while (console_stream.active && (chunks < 32)) {
+    set_tables_chunk(&viaems, &value);
+    chunks++;
+  }
+  ck_assert(!console_stream.active);
+  ck_assert_int_gt(chunks, 1);
+  ck_assert_str_eq(config.ve.title, "changed");
+}
+END_TEST
+
+/* Counts the fields of a table */
+static size_t count_fields(CborValue *table) {
+  CborValue field;
+  size_t count = 0;
+  cbor_value_enter_container(table, &field);
+  while (!cbor_value_at_end(&field)) {
+    cbor_value_advance(&field);
+    cbor_value_advance(&field);
+    count++;
+  }
+  return count;
+}
+
+/* Counts the fields of each table in a map of tables, and in arrays of them */
+static size_t count_table_fields(CborValue *tables) {
+  CborValue table, element;
+  if (!cbor_value_is_map(tables)) {
+    return 0;
+  }
+
+  size_t count = 0;
+  cbor_value_enter_container(tables, &table);
+  while (!cbor_value_at_end(&table)) {
+    /* Skip the key */
+    cbor_value_advance(&table);
+    if (cbor_value_is_array(&table)) {
+      cbor_value_enter_container(&table, &element);
+      while (!cbor_value_at_end(&element)) {
+        count += count_fields(&element);
+        cbor_value_advance(&element);
+      }
+    } else {
+      count += count_fields(&table);
+    }
+    cbor_value_advance(&table);
+  }
+  return count;
+}
+
+/* Gets all of the tables, or everything, one chunk at a time until the last,
+ * returning the number of chunks. *fields counts the table fields sent */
+static uint32_t get_chunked(struct viaems *viaems,
+                            bool tables_only,
+                            size_t *fields) {
+  uint32_t chunks = 0;
+  *fields = 0;
+  do {
+    init_console_tests();
+    if (tables_only) {
+      render_path("s", "tables");
+    } else {
+      render_path("");
+    }
+    CborEncoder get_enc;
+    cbor_encoder_create_map(
+      &test_ctx.top_encoder, &get_enc, CborIndefiniteLength);
+    console_stream_begin_chunk(
+      &console_stream, test_ctx.buf, sizeof(test_ctx.buf));
+    console_request_get(&get_enc, &test_ctx.path_value, viaems);
+    console_stream_end_chunk(&console_stream, &get_enc);
+    cbor_encoder_close_container(&test_ctx.top_encoder, &get_enc);
+
+    /* Bounded by the chunk size, and the largest unsplit field */
+    ck_assert_int_lt(
+      cbor_encoder_get_buffer_size(&test_ctx.top_encoder, test_ctx.buf),
+      CONSOLE_CHUNK_SIZE + 4096);
+    finish_writing();
+    ck_assert(cbor_value_validate_basic(&test_ctx.top_value) == CborNoError);
+
+    CborValue chunk_value, more_value;
+    uint64_t chunk;
+    bool more;
+    cbor_value_map_find_value(&test_ctx.top_value, "chunk", &chunk_value);
+    cbor_value_get_uint64(&chunk_value, &chunk);
+    ck_assert_int_eq(chunk, chunks);
+    cbor_value_map_find_value(&test_ctx.top_value, "more", &more_value);
+    cbor_value_get_boolean(&more_value, &more);
+    ck_assert(more == console_stream.active);
+
+    CborValue response, tables;
+    cbor_value_map_find_value(&test_ctx.top_value, "response", &response);
+    if (tables_only) {
+      tables = response;
+    } else {
+      cbor_value_map_find_value(&response, "tables", &tables);
+    }
+    *fields += count_table_fields(&tables);
+    chunks++;
+  } while (console_stream.active && (chunks < 32));
+
+  ck_assert(!console_stream.active);
+  return chunks;
+}
+
+START_TEST(test_console_get_chunked) {
+  struct viaems viaems = { .config = &default_config };
+
+  /* Not split outside of processing a request */
+  render_path("");
+  CborEncoder get_enc;
+  cbor_encoder_create_map(
+    &test_ctx.top_encoder, &get_enc, CborIndefiniteLength);
+  console_request_get(&get_enc, &test_ctx.path_value, &viaems);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &get_enc);
+  finish_writing();
+  ck_assert(!console_stream.active);
+
+  CborValue response, tables;
+  cbor_value_map_find_value(&test_ctx.top_value, "response", &response);
+  cbor_value_map_find_value(&response, "tables", &tables);
+  size_t full_fields = count_table_fields(&tables);
+  ck_assert_int_gt(full_fields, 0);
+
+  /* Tables are split at their fields, so each field is sent once */
+  size_t fields;
+  ck_assert_int_gt(get_chunked(&viaems, false, &fields), 2);
+  ck_assert_int_eq(fields, full_fields);
+
+  ck_assert_int_gt(get_chunked(&viaems, true, &fields), 1);
+  ck_assert_int_eq(fields, full_fields);
+}
+END_TEST
+
+START_TEST(test_console_get_chunked_array) {
+  static struct config config;
+  config = default_config;
+  struct viaems viaems = { .config = &config };
+
+  /* Full trim tables don't fit together in a chunk that is half used, so are
+   * split between them, and each table is sent once */
+  for (int i = 0; i < MAX_TRIM_TABLES; i++) {
+    config.trim_tables[i].rows.num = MAX_AXIS_SIZE;
+    config.trim_tables[i].cols.num = MAX_AXIS_SIZE;
+  }
+  static const uint8_t padding[CONSOLE_CHUNK_SIZE / 2];
+  uint32_t chunks = 0;
+  size_t tables = 0;
+  do {
+    init_console_tests();
+    render_path("ss", "tables", "trim");
+    CborEncoder get_enc;
+    cbor_encoder_create_map(
+      &test_ctx.top_encoder, &get_enc, CborIndefiniteLength);
+    cbor_encode_text_stringz(&get_enc, "padding");
+    cbor_encode_byte_string(&get_enc, padding, sizeof(padding));
+    console_stream_begin_chunk(
+      &console_stream, test_ctx.buf, sizeof(test_ctx.buf));
+    console_request_get(&get_enc, &test_ctx.path_value, &viaems);
+    console_stream_end_chunk(&console_stream, &get_enc);
+    cbor_encoder_close_container(&test_ctx.top_encoder, &get_enc);
+    finish_writing();
+
+    CborValue response, table;
+    cbor_value_map_find_value(&test_ctx.top_value, "response", &response);
+    ck_assert(cbor_value_is_array(&response));
+    cbor_value_enter_container(&response, &table);
+    while (!cbor_value_at_end(&table)) {
+      CborValue title;
+      ck_assert(cbor_value_is_map(&table));
+      cbor_value_map_find_value(&table, "title", &title);
+      ck_assert(cbor_value_is_text_string(&title));
+      cbor_value_advance(&table);
+      tables++;
+    }
+    chunks++;
+  } while (console_stream.active && (chunks < 32));
+
+  ck_assert(!console_stream.active);
+  ck_assert_int_eq(chunks, MAX_TRIM_TABLES);
+  ck_assert_int_eq(tables, MAX_TRIM_TABLES);
+}
+END_TEST
+
 START_TEST(test_console_event_log) {
   event_log.enabled = true;
-
-  ck_assert(event_log.read == 0);
-  ck_assert(event_log.write == 0);
+  uint32_t dropped;
+  while (get_logged_event(&dropped).type != EVENT_NONE) {
+  }
 
   /* Empty queue should return none */
-  ck_assert(get_logged_event().type == EVENT_NONE);
-  ck_assert(get_logged_event().type == EVENT_NONE);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
 
-  uint32_t seq = 0;
+  uint32_t seq = event_log.seq;
   /* Push and pop single event, confirm empty after */
-  console_record_event((struct logged_event){
-    .type = EVENT_TRIGGER,
-    .time = 1,
-  });
-  struct logged_event ret = get_logged_event();
+  console_record_event(EVENT_PRODUCER_DECODER,
+                       (struct logged_event){
+                         .type = EVENT_TRIGGER,
+                         .time = 1,
+                       });
+  struct logged_event ret = get_logged_event(&dropped);
   ck_assert(ret.type == EVENT_TRIGGER);
   ck_assert(ret.time == 1);
   ck_assert(ret.seq == seq);
-  ck_assert(get_logged_event().type == EVENT_NONE);
+  ck_assert_int_eq(dropped, 0);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
   seq += 1;
 
   /* Push 16 and pop 16 */
   for (int i = 0; i < 16; i++) {
-    console_record_event((struct logged_event){
-      .type = EVENT_TRIGGER,
-      .time = i,
-    });
+    console_record_event(EVENT_PRODUCER_DECODER,
+                         (struct logged_event){
+                           .type = EVENT_TRIGGER,
+                           .time = i,
+                         });
   }
   for (int i = 0; i < 16; i++) {
-    ret = get_logged_event();
+    ret = get_logged_event(&dropped);
     ck_assert(ret.type == EVENT_TRIGGER);
     ck_assert(ret.time == (uint32_t)i);
     ck_assert(ret.seq == (uint32_t)i + seq);
   }
   seq += 16;
 
-  ck_assert(get_logged_event().type == EVENT_NONE);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
 
-  /* Push 64 to trigger overflow behavior */
-  for (int i = 0; i < 64; i++) {
-    console_record_event((struct logged_event){
-      .type = EVENT_TRIGGER,
-      .time = i,
-    });
+  /* Events from different producers are merged in order */
+  for (int i = 0; i < 6; i++) {
+    console_record_event((i % 3) ? EVENT_PRODUCER_OUTPUTS
+                                 : EVENT_PRODUCER_DECODER,
+                         (struct logged_event){
+                           .type = (i % 3) ? EVENT_OUTPUT : EVENT_TRIGGER,
+                           .time = i,
+                         });
   }
+  for (int i = 0; i < 6; i++) {
+    ret = get_logged_event(&dropped);
+    ck_assert(ret.type == ((i % 3) ? EVENT_OUTPUT : EVENT_TRIGGER));
+    ck_assert(ret.time == (uint32_t)i);
+    ck_assert(ret.seq == (uint32_t)i + seq);
+  }
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
+  seq += 6;
+
+  /* Overflow one producer's ring, the other is unaffected */
+  for (int i = 0; i < 2 * EVENT_LOG_SIZE; i++) {
+    console_record_event(EVENT_PRODUCER_DECODER,
+                         (struct logged_event){
+                           .type = EVENT_TRIGGER,
+                           .time = i,
+                         });
+  }
+  console_record_event(EVENT_PRODUCER_OUTPUTS,
+                       (struct logged_event){
+                         .type = EVENT_OUTPUT,
+                         .time = 1000,
+                       });
   for (int i = 0; i < EVENT_LOG_SIZE - 1; i++) {
-    ret = get_logged_event();
+    ret = get_logged_event(&dropped);
     ck_assert(ret.type == EVENT_TRIGGER);
     ck_assert(ret.time == (uint32_t)i);
     ck_assert(ret.seq == (uint32_t)i + seq);
   }
-  ck_assert(get_logged_event().type == EVENT_NONE);
-  seq += 64;
-
-  console_record_event((struct logged_event){
-    .type = EVENT_TRIGGER,
-    .time = 99,
-  });
-
-  ret = get_logged_event();
+  ret = get_logged_event(&dropped);
+  ck_assert(ret.type == EVENT_OUTPUT);
+  ck_assert_int_eq(dropped, 0);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
+  ck_assert_int_eq(event_log_dropped(), EVENT_LOG_SIZE + 1);
+  seq += 2 * EVENT_LOG_SIZE + 1;
+
+  /* The next event carries the number dropped before it */
+  console_record_event(EVENT_PRODUCER_DECODER,
+                       (struct logged_event){
+                         .type = EVENT_TRIGGER,
+                         .time = 99,
+                       });
+
+  ret = get_logged_event(&dropped);
   ck_assert(ret.type == EVENT_TRIGGER);
   ck_assert(ret.time == 99);
   ck_assert(ret.seq == seq);
-  ck_assert(get_logged_event().type == EVENT_NONE);
+  ck_assert_int_eq(dropped, EVENT_LOG_SIZE + 1);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
   seq += 1;
 }
 END_TEST
 
+START_TEST(test_console_event_log_order_best_effort) {
+  event_log.enabled = true;
+  uint32_t dropped;
+  while (get_logged_event(&dropped).type != EVENT_NONE) {
+  }
+
+  /* An output event takes its seq, then is interrupted by a trigger event that
+   * is read before the output event is queued */
+  struct logged_event output = {
+    .type = EVENT_OUTPUT,
+    .time = 10,
+    .seq = atomic_fetch_add(&event_log.seq, 1),
+  };
+  console_record_event(EVENT_PRODUCER_DECODER,
+                       (struct logged_event){
+                         .type = EVENT_TRIGGER,
+                         .time = 11,
+                       });
+  struct logged_event ret = get_logged_event(&dropped);
+  ck_assert(ret.type == EVENT_TRIGGER);
+  ck_assert(ret.seq == output.seq + 1);
+
+  /* So the output event is sent after it, despite its lower seq */
+  event_log_push(&event_log.rings[EVENT_PRODUCER_OUTPUTS], &output);
+  ret = get_logged_event(&dropped);
+  ck_assert(ret.type == EVENT_OUTPUT);
+  ck_assert(ret.seq == output.seq);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
+
+  /* Had both been queued before reading, they would be sent in seq order */
+  output.seq = atomic_fetch_add(&event_log.seq, 1);
+  console_record_event(EVENT_PRODUCER_DECODER,
+                       (struct logged_event){
+                         .type = EVENT_TRIGGER,
+                         .time = 11,
+                       });
+  event_log_push(&event_log.rings[EVENT_PRODUCER_OUTPUTS], &output);
+  ck_assert(get_logged_event(&dropped).type == EVENT_OUTPUT);
+  ck_assert(get_logged_event(&dropped).type == EVENT_TRIGGER);
+  ck_assert(get_logged_event(&dropped).type == EVENT_NONE);
+}
+END_TEST
+
+/* Finds a field's packed offset from the fields of a packed description */
+static uint32_t packed_field_offset(CborValue *fields, const char *name) {
+  CborValue field;
+  cbor_value_enter_container(fields, &field);
+  while (!cbor_value_at_end(&field)) {
+    CborValue entry;
+    cbor_value_enter_container(&field, &entry);
+    bool match = console_string_matches(&entry, name);
+    cbor_value_advance(&entry);
+    cbor_value_advance(&entry);
+    int offset;
+    cbor_value_get_int(&entry, &offset);
+    if (match) {
+      return offset;
+    }
+    cbor_value_advance(&field);
+  }
+  ck_abort_msg("field %s not found", name);
+  return 0;
+}
+
+static uint32_t unpack_uint32_le(const uint8_t *src) {
+  return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+START_TEST(test_console_feed_packed) {
+  console_feed.format = FEED_FORMAT_PACKED;
+
+  size_t len = console_feed_line_keys(test_ctx.buf, sizeof(test_ctx.buf));
+  cbor_parser_init(
+    test_ctx.buf, len, 0, &test_ctx.top_parser, &test_ctx.top_value);
+  CborValue fields, size_value, format_value;
+  ck_assert(cbor_value_map_find_value(
+              &test_ctx.top_value, "fields", &fields) == CborNoError);
+  ck_assert(cbor_value_is_array(&fields));
+  ck_assert(cbor_value_map_find_value(
+              &test_ctx.top_value, "size", &size_value) == CborNoError);
+  ck_assert(cbor_value_map_find_value(
+              &test_ctx.top_value, "format", &format_value) == CborNoError);
+  ck_assert(console_string_matches(&format_value, "packed"));
+
+  int size;
+  cbor_value_get_int(&size_value, &size);
+  uint32_t cputime_offset = packed_field_offset(&fields, "cputime");
+  uint32_t ve_offset = packed_field_offset(&fields, "ve");
+  uint32_t rpm_cut_offset = packed_field_offset(&fields, "rpm_cut");
+  uint32_t boost_cut_offset = packed_field_offset(&fields, "boost_cut");
+  uint32_t rpm_offset = packed_field_offset(&fields, "rpm");
+  uint32_t t1_offset = packed_field_offset(&fields, "t1_count");
+  ck_assert_int_eq(cputime_offset, 0);
+  ck_assert_int_eq(boost_cut_offset, rpm_cut_offset + 1);
+  ck_assert_int_eq(t1_offset, size - 4);
+
+  struct console_feed_update update = {
+    .time = 0x12345678,
+    .ve = 55.5f,
+    .rpm_cut = true,
+    .rpm = 3000,
+    .t1_count = 7,
+  };
+  len = console_feed_line(
+    FEED_FULL, &update, NULL, test_ctx.buf, sizeof(test_ctx.buf));
+  console_feed.format = FEED_FORMAT_CBOR;
+
+  cbor_parser_init(
+    test_ctx.buf, len, 0, &test_ctx.top_parser, &test_ctx.top_value);
+  CborValue packed_value;
+  ck_assert(cbor_value_map_find_value(
+              &test_ctx.top_value, "packed", &packed_value) == CborNoError);
+  ck_assert(cbor_value_is_byte_string(&packed_value));
+
+  uint8_t packed[512];
+  size_t packed_len = sizeof(packed);
+  ck_assert(cbor_value_copy_byte_string(
+              &packed_value, packed, &packed_len, NULL) == CborNoError);
+  ck_assert_int_eq(packed_len, size);
+
+  ck_assert_int_eq(unpack_uint32_le(&packed[cputime_offset]), 0x12345678);
+  uint32_t ve_bits = unpack_uint32_le(&packed[ve_offset]);
+  float ve;
+  memcpy(&ve, &ve_bits, sizeof(ve));
+  ck_assert_float_eq(ve, 55.5f);
+  ck_assert_int_eq(packed[rpm_cut_offset], 1);
+  ck_assert_int_eq(packed[boost_cut_offset], 0);
+  ck_assert_int_eq(unpack_uint32_le(&packed[rpm_offset]), 3000);
+  ck_assert_int_eq(unpack_uint32_le(&packed[t1_offset]), 7);
+}
+END_TEST
+
+static size_t feed_field_index(const char *name) {
+  for (size_t i = 0; i < NUM_FEED_FIELDS; i++) {
+    if (strcmp(console_feed_fields[i].name, name) == 0) {
+      return i;
+    }
+  }
+  ck_abort_msg("field %s not found", name);
+  return 0;
+}
+
+static bool delta_field_changed(const uint8_t *delta, const char *name) {
+  size_t i = feed_field_index(name);
+  return delta[i / 8] & (1 << (i % 8));
+}
+
+static size_t delta_changed_count(const uint8_t *delta) {
+  size_t count = 0;
+  for (size_t i = 0; i < NUM_FEED_FIELDS; i++) {
+    count += (delta[i / 8] & (1 << (i % 8))) ? 1 : 0;
+  }
+  return count;
+}
+
+/* Encodes a delta feed line, returning the delta bytes and keyframe flag */
+static size_t encode_delta_line(const struct console_feed_update *update,
+                                uint8_t *delta,
+                                bool *keyframe) {
+  size_t len = console_feed_encode(update, test_ctx.buf, sizeof(test_ctx.buf));
+  cbor_parser_init(
+    test_ctx.buf, len, 0, &test_ctx.top_parser, &test_ctx.top_value);
+
+  CborValue keyframe_value, delta_value;
+  cbor_value_map_find_value(&test_ctx.top_value, "keyframe", &keyframe_value);
+  *keyframe = cbor_value_is_boolean(&keyframe_value);
+  ck_assert(cbor_value_map_find_value(
+              &test_ctx.top_value, "delta", &delta_value) == CborNoError);
+  ck_assert(cbor_value_is_byte_string(&delta_value));
+
+  size_t delta_len = FEED_MASK_SIZE + NUM_FEED_FIELDS * 5;
+  ck_assert(cbor_value_copy_byte_string(
+              &delta_value, delta, &delta_len, NULL) == CborNoError);
+  return delta_len;
+}
+
+START_TEST(test_console_feed_delta) {
+  uint8_t delta[FEED_MASK_SIZE + NUM_FEED_FIELDS * 5];
+  bool keyframe;
+  console_set_feed_format(FEED_FORMAT_DELTA);
+
+  /* Keyframes carry every non-zero field against zero */
+  struct console_feed_update update = {
+    .time = 1000,
+    .ve = 50.0f,
+    .rpm = 3000,
+    .sync = true,
+  };
+  size_t len = encode_delta_line(&update, delta, &keyframe);
+  ck_assert(keyframe);
+  ck_assert_int_eq(delta_changed_count(delta), 4);
+  ck_assert(delta_field_changed(delta, "cputime"));
+  ck_assert(delta_field_changed(delta, "ve"));
+  ck_assert(delta_field_changed(delta, "rpm"));
+  ck_assert(delta_field_changed(delta, "sync"));
+  /* cputime and rpm are 2 byte varints, and ve 5 */
+  ck_assert_int_eq(len, FEED_MASK_SIZE + 2 + 5 + 2);
+
+  /* Small integer changes are a byte each, in either direction. The toggled
+   * bool has no value */
+  update.time = 1010;
+  update.rpm = 2990;
+  update.sync = false;
+  len = encode_delta_line(&update, delta, &keyframe);
+  ck_assert(!keyframe);
+  ck_assert_int_eq(delta_changed_count(delta), 3);
+  ck_assert(delta_field_changed(delta, "sync"));
+  ck_assert_int_eq(len, FEED_MASK_SIZE + 2);
+  ck_assert_int_eq(delta[FEED_MASK_SIZE], 20);
+  ck_assert_int_eq(delta[FEED_MASK_SIZE + 1], 19);
+
+  /* Nothing changed */
+  len = encode_delta_line(&update, delta, &keyframe);
+  ck_assert_int_eq(delta_changed_count(delta), 0);
+  ck_assert_int_eq(len, FEED_MASK_SIZE);
+
+  /* Floats are XORed with the previous bits */
+  update.ve = 50.5f;
+  len = encode_delta_line(&update, delta, &keyframe);
+  ck_assert_int_eq(delta_changed_count(delta), 1);
+  uint32_t before, after;
+  float ve = 50.0f;
+  memcpy(&before, &ve, sizeof(before));
+  memcpy(&after, &update.ve, sizeof(after));
+  uint32_t xored = 0;
+  for (size_t i = FEED_MASK_SIZE; i < len; i++) {
+    xored |= (delta[i] & 0x7f) << (7 * (i - FEED_MASK_SIZE));
+  }
+  ck_assert_int_eq(xored, before ^ after);
+
+  /* Keyframes are periodic */
+  for (int i = 4; i < FEED_KEYFRAME_INTERVAL; i++) {
+    encode_delta_line(&update, delta, &keyframe);
+    ck_assert(!keyframe);
+  }
+  encode_delta_line(&update, delta, &keyframe);
+  ck_assert(keyframe);
+  ck_assert_int_eq(delta_changed_count(delta), 3);
+
+  console_set_feed_format(FEED_FORMAT_CBOR);
+}
+END_TEST
+
+/* Sends a subscribe request, returning the subscription or -1 on failure */
+static int request_subscribe(const char *const *keys,
+                             size_t n_keys,
+                             int decimation) {
+  uint8_t reqbuf[256];
+  CborEncoder enc, map, key_list;
+  cbor_encoder_init(&enc, reqbuf, sizeof(reqbuf), 0);
+  cbor_encoder_create_map(&enc, &map, 2);
+  cbor_encode_text_stringz(&map, "keys");
+  cbor_encoder_create_array(&map, &key_list, n_keys);
+  for (size_t i = 0; i < n_keys; i++) {
+    cbor_encode_text_stringz(&key_list, keys[i]);
+  }
+  cbor_encoder_close_container(&map, &key_list);
+  cbor_encode_text_stringz(&map, "decimation");
+  cbor_encode_int(&map, decimation);
+  cbor_encoder_close_container(&enc, &map);
+
+  CborParser parser;
+  CborValue request;
+  cbor_parser_init(
+    reqbuf, cbor_encoder_get_buffer_size(&enc, reqbuf), 0, &parser, &request);
+
+  init_console_tests();
+  CborEncoder response;
+  cbor_encoder_create_map(
+    &test_ctx.top_encoder, &response, CborIndefiniteLength);
+  console_request_subscribe(&response, &request);
+  cbor_encoder_close_container(&test_ctx.top_encoder, &response);
+  finish_writing();
+
+  CborValue success_value, response_value, id_value;
+  bool success;
+  cbor_value_map_find_value(&test_ctx.top_value, "success", &success_value);
+  cbor_value_get_boolean(&success_value, &success);
+  if (!success) {
+    return -1;
+  }
+  cbor_value_map_find_value(&test_ctx.top_value, "response", &response_value);
+  cbor_value_map_find_value(&response_value, "subscription", &id_value);
+  int id;
+  cbor_value_get_int(&id_value, &id);
+  return id;
+}
+
+/* Records an engine update, returning the subscriptions it was sent to */
+static uint32_t record_subscribed_update(void) {
+  static struct viaems viaems = { 0 };
+  struct engine_update eng_update = { 0 };
+  record_engine_update(&viaems, &eng_update, NULL);
+
+  int idx = spsc_next(&engine_update_queue);
+  if (idx < 0) {
+    return 0;
+  }
+  uint32_t subscriptions = engine_update_msgs[idx].subscriptions;
+  spsc_release(&engine_update_queue);
+  return subscriptions;
+}
+
+START_TEST(test_console_feed_subscribe) {
+  const char *const fast_keys[] = { "rpm", "sync", "rpm" };
+  const char *const slow_keys[] = { "sensor.map" };
+  const char *const bad_keys[] = { "rpm", "not-a-key" };
+
+  int fast = request_subscribe(fast_keys, 3, 1);
+  int slow = request_subscribe(slow_keys, 1, 4);
+  ck_assert_int_eq(fast, 0);
+  ck_assert_int_eq(slow, 1);
+  ck_assert_int_eq(request_subscribe(bad_keys, 2, 1), -1);
+  ck_assert_int_eq(request_subscribe(slow_keys, 1, 0), -1);
+  ck_assert(!console_feed.subscriptions[2].active);
+
+  /* Duplicate keys are only sent once */
+  ck_assert_int_eq(console_feed.subscriptions[fast].n_fields, 2);
+  ck_assert_int_eq(console_feed.subscriptions[fast].groups, FEED_DECODER);
+  ck_assert_int_eq(console_feed.subscriptions[slow].groups, FEED_SENSORS);
+
+  /* Each subscription is sent at its own rate, and the full feed not at all */
+  uint32_t counts[FEED_MAX_SUBSCRIPTIONS + 1] = { 0 };
+  for (int i = 0; i < 8; i++) {
+    uint32_t subscriptions = record_subscribed_update();
+    for (int s = 0; s <= FEED_MAX_SUBSCRIPTIONS; s++) {
+      counts[s] += (subscriptions & (1 << s)) ? 1 : 0;
+    }
+  }
+  ck_assert_int_eq(counts[fast], 8);
+  ck_assert_int_eq(counts[slow], 2);
+  ck_assert_int_eq(counts[FEED_FULL], 0);
+
+  /* The description lists the subscriptions */
+  size_t len = console_feed_line_keys(test_ctx.buf, sizeof(test_ctx.buf));
+  cbor_parser_init(
+    test_ctx.buf, len, 0, &test_ctx.top_parser, &test_ctx.top_value);
+  CborValue subs_value, sub_value, keys_value;
+  ck_assert(cbor_value_map_find_value(&test_ctx.top_value,
+                                      "subscriptions",
+                                      &subs_value) == CborNoError);
+  cbor_value_enter_container(&subs_value, &sub_value);
+  cbor_value_map_find_value(&sub_value, "keys", &keys_value);
+  size_t n_keys;
+  cbor_value_get_array_length(&keys_value, &n_keys);
+  ck_assert_int_eq(n_keys, 2);
+  size_t n_subs = 0;
+  while (!cbor_value_at_end(&sub_value)) {
+    n_subs++;
+    cbor_value_advance(&sub_value);
+  }
+  ck_assert_int_eq(n_subs, 2);
+
+  /* Feed messages carry only the subscribed fields */
+  struct console_feed_update update = { .rpm = 3000, .sync = true };
+  len = console_feed_line(
+    fast, &update, NULL, test_ctx.buf, sizeof(test_ctx.buf));
+  cbor_parser_init(
+    test_ctx.buf, len, 0, &test_ctx.top_parser, &test_ctx.top_value);
+  CborValue id_value, values_value, value;
+  cbor_value_map_find_value(&test_ctx.top_value, "subscription", &id_value);
+  int id;
+  cbor_value_get_int(&id_value, &id);
+  ck_assert_int_eq(id, fast);
+  cbor_value_map_find_value(&test_ctx.top_value, "values", &values_value);
+  size_t n_values;
+  cbor_value_get_array_length(&values_value, &n_values);
+  ck_assert_int_eq(n_values, 2);
+  cbor_value_enter_container(&values_value, &value);
+  int rpm;
+  cbor_value_get_int(&value, &rpm);
+  ck_assert_int_eq(rpm, 3000);
+
+  /* Without subscriptions the full feed resumes */
+  for (int i = 0; i < FEED_MAX_SUBSCRIPTIONS; i++) {
+    console_feed.subscriptions[i].active = false;
+  }
+  ck_assert_int_eq(record_subscribed_update(), 1 << FEED_FULL);
+}
+END_TEST
+
+static void record_rpm_update(uint32_t rpm) {
+  static struct viaems viaems = { 0 };
+  struct engine_update eng_update = { .position = { .rpm = rpm } };
+  record_engine_update(&viaems, &eng_update, NULL);
+}
+
+static void drain_engine_update_queue(void) {
+  int idx;
+  while ((idx = spsc_next(&engine_update_queue)) >= 0) {
+    feed_summary_release(&engine_update_msgs[idx]);
+    spsc_release(&engine_update_queue);
+  }
+}
+
+START_TEST(test_console_feed_resubscribe) {
+  const char *const rpm_keys[] = { "rpm" };
+  const char *const map_keys[] = { "sensor.map" };
+  for (int i = 0; i < FEED_MAX_SUBSCRIPTIONS; i++) {
+    console_feed.subscriptions[i].active = false;
+  }
+  drain_engine_update_queue();
+
+  int id = request_subscribe(rpm_keys, 1, 1);
+  static struct viaems viaems = { 0 };
+  struct engine_update eng_update = { 0 };
+  record_engine_update(&viaems, &eng_update, NULL);
+
+  /* An update queued before the slot is replaced is not sent to the new
+   * subscription, as its fields weren't recorded */
+  console_feed.subscriptions[id].active = false;
+  ck_assert_int_eq(request_subscribe(map_keys, 1, 1), id);
+  int idx = spsc_next(&engine_update_queue);
+  ck_assert_int_ge(idx, 0);
+  ck_assert(!feed_update_is_current(&engine_update_msgs[idx], id));
+  spsc_release(&engine_update_queue);
+
+  record_engine_update(&viaems, &eng_update, NULL);
+  idx = spsc_next(&engine_update_queue);
+  ck_assert_int_ge(idx, 0);
+  ck_assert(feed_update_is_current(&engine_update_msgs[idx], id));
+  spsc_release(&engine_update_queue);
+
+  console_feed.subscriptions[id].active = false;
+}
+END_TEST
+
+START_TEST(test_console_feed_dropped) {
+  drain_engine_update_queue();
+  console_feed.coalesce = true;
+
+  /* Fill the queue, then overflow it by three updates */
+  for (int i = 0; i < FEED_QUEUE_SIZE - 1; i++) {
+    record_rpm_update(2500);
+  }
+  uint32_t first_seq = engine_update_msgs[spsc_next(&engine_update_queue)].seq;
+  record_rpm_update(1000);
+  record_rpm_update(3000);
+  record_rpm_update(2000);
+  drain_engine_update_queue();
+
+  /* The next update counts and summarizes them */
+  record_rpm_update(1500);
+  int idx = spsc_next(&engine_update_queue);
+  ck_assert_int_ge(idx, 0);
+  const struct console_feed_update *update = &engine_update_msgs[idx];
+  const struct console_feed_summary *summary = feed_summary_for(update);
+  ck_assert_ptr_nonnull(summary);
+  ck_assert_int_eq(update->seq, first_seq + FEED_QUEUE_SIZE - 1 + 3);
+  ck_assert_int_eq(update->dropped, 3);
+  ck_assert_int_eq(summary->count, 3);
+  size_t rpm = feed_field_index("rpm");
+  ck_assert_int_eq(summary->min[rpm], 1000);
+  ck_assert_int_eq(summary->max[rpm], 3000);
+
+  size_t len = console_feed_line(
+    FEED_FULL, update, summary, test_ctx.buf, sizeof(test_ctx.buf));
+  feed_summary_release(update);
+  spsc_release(&engine_update_queue);
+  cbor_parser_init(
+    test_ctx.buf, len, 0, &test_ctx.top_parser, &test_ctx.top_value);
+  CborValue dropped_value, coalesced_value, max_value, value;
+  int dropped;
+  cbor_value_map_find_value(&test_ctx.top_value, "dropped", &dropped_value);
+  cbor_value_get_int(&dropped_value, &dropped);
+  ck_assert_int_eq(dropped, 3);
+  ck_assert(cbor_value_map_find_value(&test_ctx.top_value,
+                                      "coalesced",
+                                      &coalesced_value) == CborNoError);
+  cbor_value_map_find_value(&coalesced_value, "max", &max_value);
+  cbor_value_enter_container(&max_value, &value);
+  for (size_t i = 0; i < rpm; i++) {
+    cbor_value_advance(&value);
+  }
+  int max_rpm;
+  cbor_value_get_int(&value, &max_rpm);
+  ck_assert_int_eq(max_rpm, 3000);
+
+  /* Updates dropped while a summary is pending are summarized with a later
+   * update, so only one summary is pending at a time */
+  for (int i = 0; i < FEED_QUEUE_SIZE - 1; i++) {
+    record_rpm_update(2500);
+  }
+  record_rpm_update(1000);
+  spsc_next(&engine_update_queue);
+  spsc_release(&engine_update_queue);
+  record_rpm_update(1500);
+  record_rpm_update(700);
+  spsc_next(&engine_update_queue);
+  spsc_release(&engine_update_queue);
+  record_rpm_update(2000);
+
+  int summarized = 0;
+  while ((idx = spsc_next(&engine_update_queue)) >= 0) {
+    update = &engine_update_msgs[idx];
+    summary = feed_summary_for(update);
+    if (summary) {
+      ck_assert_int_eq(summary->count, 1);
+      ck_assert_int_eq(summary->min[rpm], 1000);
+      summarized++;
+    }
+    feed_summary_release(update);
+    spsc_release(&engine_update_queue);
+  }
+  ck_assert_int_eq(summarized, 1);
+
+  record_rpm_update(2500);
+  idx = spsc_next(&engine_update_queue);
+  summary = feed_summary_for(&engine_update_msgs[idx]);
+  ck_assert_ptr_nonnull(summary);
+  ck_assert_int_eq(summary->min[rpm], 700);
+  feed_summary_release(&engine_update_msgs[idx]);
+  spsc_release(&engine_update_queue);
+
+  /* Without coalescing, dropped updates are only counted */
+  console_feed.coalesce = false;
+  for (int i = 0; i < FEED_QUEUE_SIZE; i++) {
+    record_rpm_update(2500);
+  }
+  drain_engine_update_queue();
+  record_rpm_update(2500);
+  idx = spsc_next(&engine_update_queue);
+  ck_assert_int_eq(engine_update_msgs[idx].dropped, 1);
+  ck_assert_ptr_null(feed_summary_for(&engine_update_msgs[idx]));
+  spsc_release(&engine_update_queue);
+}
+END_TEST
+
 TCase *setup_console_tests() {
   TCase *console_tests = tcase_create("console");
   tcase_add_checked_fixture(
@@ -2088,8 +4978,20 @@ TCase *setup_console_tests() {
   /* Real access / integration tests */
   tcase_add_test(console_tests, test_smoke_console_request_structure);
   tcase_add_test(console_tests, test_smoke_console_request_get_full);
+  tcase_add_test(console_tests, test_console_get_chunked);
+  tcase_add_test(console_tests, test_console_get_chunked_array);
+  tcase_add_test(console_tests, test_console_structure_hashed);
+  tcase_add_test(console_tests,
+                 test_console_set_invalidates_calculation_cache);
+  tcase_add_test(console_tests, test_console_set_chunked);
 
   tcase_add_test(console_tests, test_console_event_log);
+  tcase_add_test(console_tests, test_console_event_log_order_best_effort);
+  tcase_add_test(console_tests, test_console_feed_packed);
+  tcase_add_test(console_tests, test_console_feed_delta);
+  tcase_add_test(console_tests, test_console_feed_subscribe);
+  tcase_add_test(console_tests, test_console_feed_resubscribe);
+  tcase_add_test(console_tests, test_console_feed_dropped);
   return console_tests;
 }
 
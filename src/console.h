@@ -5,17 +5,29 @@
 
 #include "platform.h"
 
+/* Clients can subscribe to subsets of the feed fields, each sent every
+ * decimation engine updates */
+#define FEED_MAX_SUBSCRIPTIONS 4
+
 struct console_feed_update {
   timeval_t time;
+  uint32_t subscriptions; /* Bitmask of the subscriptions sent this update */
+  uint32_t generations[FEED_MAX_SUBSCRIPTIONS + 1]; /* Of each subscription */
+  uint32_t seq;           /* Counts every update, including dropped ones */
+  uint32_t dropped;       /* Updates dropped just before this one */
 
   float ve;
   float lambda;
+  float lambda_stt;
+  float lambda_ltt;
   uint32_t fuel_pulsewidth_us;
   float temp_enrich_percent;
   float injector_dead_time;
   float injector_pw_correction;
   float accel_enrich_percent;
   float airmass_per_cycle;
+  float wall_film;
+  float wall_film_correction;
 
   float advance;
   uint32_t dwell_us;
@@ -23,8 +35,22 @@ struct console_feed_update {
   bool boost_cut;
   bool fuel_overduty_cut;
   bool dwell_overduty_cut;
+  uint32_t cut_mode;
+  uint32_t fuel_cut;
+  uint32_t spark_cut;
+  float limiter_retard;
+  float calc_cache_hit_ratio;
+  float boost_target;
+  float boost_duty;
+  float idle_target_rpm;
+  float idle_duty;
+  float idle_timing_assist;
+  float fan_duty;
 
   float map;
+  float map_window_min;
+  float map_window_max;
+  float map_window_min_angle;
   float iat;
   float clt;
   float brv;
@@ -37,7 +63,10 @@ struct console_feed_update {
   float knock1;
   float knock2;
   float eth;
+  float clu;
+  float vss;
   uint32_t sensor_faults;
+  uint32_t knock_dropped;
 
   uint32_t rpm;
   uint32_t tooth_rpm;
@@ -61,13 +90,40 @@ struct logged_event {
   uint32_t value;
 };
 
-struct config;
-void console_process(struct config *config, timeval_t now);
-void console_record_event(struct logged_event);
+/* Interrupt contexts that record events, each with its own event log ring */
+typedef enum {
+  EVENT_PRODUCER_DECODER,
+  EVENT_PRODUCER_OUTPUTS,
+  NUM_EVENT_PRODUCERS,
+} event_producer;
+
+struct viaems;
+struct engine_update;
+struct calculated_values;
+void console_process(struct viaems *viaems, timeval_t now);
+void console_record_event(event_producer producer, struct logged_event ev);
 void record_engine_update(const struct viaems *viaems,
                           const struct engine_update *eng_update,
                           const struct calculated_values *calcs);
 
+typedef enum {
+  FEED_FORMAT_CBOR,
+  FEED_FORMAT_PACKED,
+  FEED_FORMAT_DELTA,
+} console_feed_format;
+
+/* Encode feed updates outside of console_process, as used by the hosted feed
+ * benchmark. Setting the format restarts a delta feed with a keyframe */
+void console_set_feed_format(console_feed_format format);
+size_t console_feed_encode(const struct console_feed_update *update,
+                           uint8_t *dest,
+                           size_t bsize);
+
+/* Sets the feed field with the given key, returns false if there is none */
+bool console_feed_set_field(struct console_feed_update *update,
+                            const char *name,
+                            double value);
+
 #ifdef UNITTEST
 #include <check.h>
 TCase *setup_console_tests(void);
@@ -0,0 +1,235 @@
+#include <math.h>
+
+#include "calculations.h"
+#include "config.h"
+#include "cuts.h"
+#include "viaems.h"
+
+/* The clutch input reads above this while the pedal is pressed */
+#define CLUTCH_PRESSED 0.5f
+
+static cut_mode determine_cut_mode(const struct cut_config *config,
+                                   const struct sensor_values *sensors) {
+  if ((sensors->CLU.fault != FAULT_NONE) ||
+      (sensors->VSS.fault != FAULT_NONE) ||
+      (sensors->CLU.value < CLUTCH_PRESSED)) {
+    return CUT_MODE_NONE;
+  }
+
+  if (sensors->VSS.value < config->launch_max_speed) {
+    return config->launch.enabled ? CUT_MODE_LAUNCH : CUT_MODE_NONE;
+  }
+
+  if (config->flat_shift.enabled &&
+      (sensors->TPS.value >= config->flat_shift_min_tps)) {
+    return CUT_MODE_FLAT_SHIFT;
+  }
+  return CUT_MODE_NONE;
+}
+
+static float limit_retard(const struct rpm_limit_config *limit, float rpm) {
+  float start = (float)limit->rpm - (float)limit->retard_window;
+  if (rpm <= start) {
+    return 0.0f;
+  }
+  if ((rpm >= limit->rpm) || (limit->retard_window == 0)) {
+    return limit->max_retard;
+  }
+  return limit->max_retard * (rpm - start) / limit->retard_window;
+}
+
+static uint32_t limit_cut_level(const struct rpm_limit_config *limit,
+                                uint32_t pattern,
+                                float rpm) {
+  if (rpm <= limit->rpm) {
+    return 0;
+  }
+  if (limit->cut_window == 0) {
+    return pattern;
+  }
+  float over = (rpm - limit->rpm) / limit->cut_window;
+  uint32_t level = ceilf(over * pattern);
+  return (level > pattern) ? pattern : level;
+}
+
+void calculate_cuts(const struct cut_config *config,
+                    const struct engine_update *update,
+                    struct calculated_values *calcs) {
+  calcs->cut_mode = determine_cut_mode(config, &update->sensors);
+  calcs->fuel_cut = 0;
+  calcs->spark_cut = 0;
+  calcs->limiter_retard = 0.0f;
+
+  const struct rpm_limit_config *limit;
+  switch (calcs->cut_mode) {
+  case CUT_MODE_LAUNCH:
+    limit = &config->launch;
+    break;
+  case CUT_MODE_FLAT_SHIFT:
+    limit = &config->flat_shift;
+    break;
+  default:
+    return;
+  }
+
+  float rpm = update->position.rpm;
+  calcs->limiter_retard = limit_retard(limit, rpm);
+  calcs->timing_advance -= calcs->limiter_retard;
+
+  uint32_t level = limit_cut_level(limit, config->pattern, rpm);
+  if (config->output != CUT_FUEL) {
+    calcs->spark_cut = level;
+  }
+  if (config->output != CUT_SPARK) {
+    calcs->fuel_cut = level;
+  }
+}
+
+bool cut_skips_event(uint32_t level,
+                     uint32_t pattern,
+                     uint32_t cycle,
+                     uint32_t index) {
+  if ((level == 0) || (pattern == 0)) {
+    return false;
+  }
+  if (level >= pattern) {
+    return true;
+  }
+
+  /* Cuts are spread evenly over consecutive outputs, level of every pattern.
+   * Each cycle the pattern advances by one output, so that the cut rotates
+   * through the cylinders rather than starving the same ones */
+  uint32_t n = (cycle + index) % pattern;
+  return ((n * level) % pattern) < level;
+}
+
+#ifdef UNITTEST
+#include <check.h>
+
+START_TEST(check_cut_skips_event) {
+  /* Exactly level of every pattern consecutive events are cut */
+  for (uint32_t level = 0; level <= 8; level++) {
+    uint32_t skipped = 0;
+    for (uint32_t index = 0; index < 8; index++) {
+      skipped += cut_skips_event(level, 8, 5, index) ? 1 : 0;
+    }
+    ck_assert_int_eq(skipped, level);
+  }
+
+  /* With one of four cut on four cylinders, one is cut each cycle, and each
+   * cylinder once every four cycles */
+  uint32_t per_output[4] = { 0 };
+  for (uint32_t cycle = 0; cycle < 4; cycle++) {
+    uint32_t skipped = 0;
+    for (uint32_t index = 0; index < 4; index++) {
+      if (cut_skips_event(1, 4, cycle, index)) {
+        skipped++;
+        per_output[index]++;
+      }
+    }
+    ck_assert_int_eq(skipped, 1);
+  }
+  for (int i = 0; i < 4; i++) {
+    ck_assert_int_eq(per_output[i], 1);
+  }
+}
+END_TEST
+
+START_TEST(check_calculate_cuts_launch) {
+  struct cut_config config = default_config.cuts;
+  config.launch.enabled = true;
+  config.output = CUT_SPARK;
+
+  struct engine_update update = {
+    .position = { .rpm = 3000 },
+    .sensors = { .CLU = { .value = 1.0f }, .VSS = { .value = 0.0f } },
+  };
+  struct calculated_values calcs = { .timing_advance = 20.0f };
+
+  /* Below the retard window, nothing happens */
+  update.position.rpm = config.launch.rpm - config.launch.retard_window - 10;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.cut_mode, CUT_MODE_LAUNCH);
+  ck_assert_float_eq(calcs.limiter_retard, 0.0f);
+  ck_assert_float_eq(calcs.timing_advance, 20.0f);
+
+  /* Retard ramps in approaching the limit */
+  calcs.timing_advance = 20.0f;
+  update.position.rpm = config.launch.rpm - config.launch.retard_window / 2;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_float_eq_tol(
+    calcs.limiter_retard, config.launch.max_retard / 2, 0.01);
+  ck_assert_float_eq_tol(
+    calcs.timing_advance, 20.0f - config.launch.max_retard / 2, 0.01);
+  ck_assert_int_eq(calcs.spark_cut, 0);
+
+  /* Cuts increase above the limit */
+  update.position.rpm = config.launch.rpm + 1;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_float_eq(calcs.limiter_retard, config.launch.max_retard);
+  ck_assert_int_eq(calcs.spark_cut, 1);
+  ck_assert_int_eq(calcs.fuel_cut, 0);
+
+  update.position.rpm = config.launch.rpm + config.launch.cut_window / 2;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.spark_cut, config.pattern / 2);
+
+  update.position.rpm = config.launch.rpm + config.launch.cut_window + 100;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.spark_cut, config.pattern);
+
+  /* Both outputs can be cut */
+  config.output = CUT_FUEL_AND_SPARK;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.spark_cut, config.pattern);
+  ck_assert_int_eq(calcs.fuel_cut, config.pattern);
+
+  /* Releasing the clutch ends launch control */
+  update.sensors.CLU.value = 0.0f;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.cut_mode, CUT_MODE_NONE);
+  ck_assert_int_eq(calcs.spark_cut, 0);
+  ck_assert_int_eq(calcs.fuel_cut, 0);
+  ck_assert_float_eq(calcs.limiter_retard, 0.0f);
+}
+END_TEST
+
+START_TEST(check_calculate_cuts_flat_shift) {
+  struct cut_config config = default_config.cuts;
+  config.launch.enabled = true;
+  config.flat_shift.enabled = true;
+
+  struct engine_update update = {
+    .position = { .rpm = config.flat_shift.rpm + 1 },
+    .sensors = { .CLU = { .value = 1.0f },
+                 .VSS = { .value = config.launch_max_speed + 10 },
+                 .TPS = { .value = config.flat_shift_min_tps + 10 } },
+  };
+  struct calculated_values calcs = { 0 };
+
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.cut_mode, CUT_MODE_FLAT_SHIFT);
+  ck_assert_int_eq(calcs.spark_cut, 1);
+
+  /* Not while lifting off the throttle */
+  update.sensors.TPS.value = 0.0f;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.cut_mode, CUT_MODE_NONE);
+
+  /* A faulted speed input disables both */
+  update.sensors.TPS.value = 100.0f;
+  update.sensors.VSS.fault = FAULT_RANGE;
+  calculate_cuts(&config, &update, &calcs);
+  ck_assert_int_eq(calcs.cut_mode, CUT_MODE_NONE);
+}
+END_TEST
+
+TCase *setup_cuts_tests() {
+  TCase *tc = tcase_create("cuts");
+  tcase_add_test(tc, check_cut_skips_event);
+  tcase_add_test(tc, check_calculate_cuts_launch);
+  tcase_add_test(tc, check_calculate_cuts_flat_shift);
+  return tc;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef CUTS_H
+#define CUTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+  CUT_SPARK,
+  CUT_FUEL,
+  CUT_FUEL_AND_SPARK,
+} cut_output;
+
+typedef enum {
+  CUT_MODE_NONE,
+  CUT_MODE_LAUNCH,
+  CUT_MODE_FLAT_SHIFT,
+} cut_mode;
+
+/* Engine speed limit with a soft limit ahead of it. Ignition is retarded up to
+ * max_retard over the retard_window rpm below the limit, and above the limit
+ * an increasing share of events are cut, reaching a full cut at cut_window rpm
+ * over the limit */
+struct rpm_limit_config {
+  bool enabled;
+  uint32_t rpm;
+  uint32_t retard_window;
+  float max_retard;
+  uint32_t cut_window;
+};
+
+struct cut_config {
+  cut_output output;
+  uint32_t pattern; /* Events per cut pattern, partial cuts skip 1 to pattern
+                       events of every pattern */
+
+  /* Launch control is active while the clutch is pressed below
+   * launch_max_speed, and flat shift while it is pressed above it with
+   * throttle of at least flat_shift_min_tps */
+  struct rpm_limit_config launch;
+  float launch_max_speed;
+  struct rpm_limit_config flat_shift;
+  float flat_shift_min_tps;
+};
+
+struct engine_update;
+struct calculated_values;
+
+/* Applies the active launch or flat shift limit to calcs, retarding ignition
+ * and setting the fuel and spark cut levels */
+void calculate_cuts(const struct cut_config *config,
+                    const struct engine_update *update,
+                    struct calculated_values *calcs);
+
+/* Returns true if an output's event is skipped in the given cycle with level
+ * of every pattern events cut. index orders the outputs of one type */
+bool cut_skips_event(uint32_t level,
+                     uint32_t pattern,
+                     uint32_t cycle,
+                     uint32_t index);
+
+#ifdef UNITTEST
+#include <check.h>
+TCase *setup_cuts_tests(void);
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include "platform.h"
 #include "scheduler.h"
 #include "sensors.h"
+#include "spans.h"
 #include "util.h"
 
 #include <assert.h>
@@ -402,12 +403,14 @@ void decoder_init(const struct decoder_config *conf, struct decoder *state) {
 
 /* When decoder has new information, reschedule everything */
 void decoder_update(struct decoder *state, struct trigger_event *ev) {
+  uint32_t start = span_start();
 
-  console_record_event((struct logged_event){
-    .type = EVENT_TRIGGER,
-    .value = ev->type == TRIGGER ? 0 : 1,
-    .time = ev->time,
-  });
+  console_record_event(EVENT_PRODUCER_DECODER,
+                       (struct logged_event){
+                         .type = EVENT_TRIGGER,
+                         .value = ev->type == TRIGGER ? 0 : 1,
+                         .time = ev->time,
+                       });
 
   if (ev->type == TRIGGER) {
     state->t0_count++;
@@ -431,6 +434,8 @@ void decoder_update(struct decoder *state, struct trigger_event *ev) {
   default:
     break;
   }
+
+  span_end(SPAN_DECODER, start);
 }
 
 struct engine_position decoder_get_engine_position(
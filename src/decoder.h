@@ -49,6 +49,10 @@ struct decoder_config {
   uint32_t num_triggers;
   degrees_t degrees_per_trigger;
   uint32_t rpm_window_size;
+
+  /* Reschedule not-yet-output events from each trigger with the most recent
+   * calculations, rather than only once per output buffer */
+  bool trigger_reschedule;
 };
 
 struct engine_position {
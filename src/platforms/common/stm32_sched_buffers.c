@@ -3,6 +3,8 @@
 #include "platform.h"
 #include "scheduler.h"
 #include "sensors.h"
+#include "spans.h"
+#include "util.h"
 
 #include "stm32_sched_buffers.h"
 #include "viaems.h"
@@ -19,6 +21,7 @@ struct output_buffer output_buffers[2] = {
   }},
 };
 static uint32_t current_buffer = 0;
+static volatile bool swap_in_progress = false;
 
 uint32_t stm32_current_buffer() {
   return current_buffer;
@@ -65,6 +68,18 @@ static void retire_output_buffer(struct output_buffer *buf) {
   }
 }
 
+/* Clear the dma bits for all submitted events in a buffer that has not started
+ * yet, leaving the entries for a reschedule */
+static void unpopulate_output_buffer(struct output_buffer *buf) {
+  for (int i = 0; i < buf->plan.n_events; i++) {
+    struct schedule_entry *entry = buf->plan.schedule[i];
+
+    timeval_t offset_from_start = entry->time - buf->plan.schedulable_start;
+    platform_output_slot_unset(
+      buf->slots, offset_from_start, entry->pin, entry->val);
+  }
+}
+
 /* Any scheduled start/stop event in the time range for the new buffer can be
  * "submitted" and the dma bits set */
 static void populate_output_buffer(struct output_buffer *buf) {
@@ -83,6 +98,8 @@ void set_pwm(int output, float value);
 
 void stm32_buffer_swap(struct viaems *viaems,
                        const struct engine_update *update) {
+  uint32_t start = span_start();
+  swap_in_progress = true;
   struct output_buffer *buf = &output_buffers[current_buffer];
   current_buffer = (current_buffer + 1) % 2;
 
@@ -103,4 +120,33 @@ void stm32_buffer_swap(struct viaems *viaems,
   }
 
   populate_output_buffer(buf);
+  swap_in_progress = false;
+  span_end(SPAN_BUFFER_SWAP, start);
+}
+
+void stm32_trigger_reschedule(struct viaems *viaems) {
+  if (!viaems->config->decoder.trigger_reschedule) {
+    return;
+  }
+
+  /* The trigger interrupt preempts the buffer swap, don't touch events while
+   * it is rescheduling them */
+  if (swap_in_progress) {
+    return;
+  }
+
+  /* The buffer that is not currently being output is the next one */
+  struct output_buffer *buf = &output_buffers[(current_buffer + 1) % 2];
+
+  /* Leave enough margin that the DMA can't start on the buffer while we're
+   * modifying it */
+  timeval_t now = current_time();
+  if (!time_before(now, buf->plan.schedulable_start) ||
+      (time_diff(buf->plan.schedulable_start, now) < NUM_SLOTS / 2)) {
+    return;
+  }
+
+  unpopulate_output_buffer(buf);
+  viaems_reschedule_on_trigger(viaems, &buf->plan);
+  populate_output_buffer(buf);
 }
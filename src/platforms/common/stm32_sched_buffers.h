@@ -33,6 +33,10 @@ struct engine_update;
 void stm32_buffer_swap(struct viaems *viaems,
                        const struct engine_update *update);
 
+/* Reschedule events in the next, not yet started, buffer from the latest
+ * trigger.  Called from the trigger interrupt after decoder updates. */
+void stm32_trigger_reschedule(struct viaems *viaems);
+
 /* Returns the current buffer being used for outputs */
 uint32_t stm32_current_buffer(void);
 
@@ -183,9 +183,16 @@ void TIMER1_IRQHandler(void) {
     sensor_update_freq(&gd32f4_viaems.sensors, &pos, &update);
   }
 
+  bool triggered = cc0_fired || cc1_fired;
+
   if (TIMER_INTF(TIMER1) & TIMER_INTF_CH3IF) {
     TIMER_INTF(TIMER1) = ~TIMER_INTF_CH3IF;
     sim_wakeup_callback(&gd32f4_viaems.decoder);
+    triggered = true;
+  }
+
+  if (triggered) {
+    stm32_trigger_reschedule(&gd32f4_viaems);
   }
 }
 
@@ -113,7 +113,7 @@ void DMA1_Channel0_IRQHandler(void) {
     struct engine_position pos =
       decoder_get_engine_position(&gd32f4_viaems.decoder);
     sensor_update_adc(&gd32f4_viaems.sensors, &pos, &update);
-    process_knock_inputs(&gd32f4_viaems.sensors, sequence);
+    process_knock_inputs(sequence);
   }
 }
 
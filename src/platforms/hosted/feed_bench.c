@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cbor.h>
+
+#include "console.h"
+#include "platform.h"
+
+/* Host benchmark of the console feed formats.  A recorded console stream, such
+ * as the output of the simulator replaying a scenario, is decoded back into
+ * feed updates.  The updates are then encoded in each feed format, and the
+ * bytes per update and encode time are reported.
+ *
+ * Only feed messages in the default cbor format are decoded from the log.
+ */
+
+#define MAX_KEYS 128
+#define MAX_KEY_LENGTH 64
+
+static char keys[MAX_KEYS][MAX_KEY_LENGTH];
+static size_t n_keys = 0;
+
+static struct console_feed_update *updates = NULL;
+static size_t n_updates = 0;
+
+static void load_keys(CborValue *msg) {
+  CborValue keys_value, key;
+  if ((cbor_value_map_find_value(msg, "keys", &keys_value) != CborNoError) ||
+      !cbor_value_is_array(&keys_value)) {
+    return;
+  }
+
+  n_keys = 0;
+  cbor_value_enter_container(&keys_value, &key);
+  while (!cbor_value_at_end(&key) && (n_keys < MAX_KEYS)) {
+    size_t len = MAX_KEY_LENGTH;
+    if (cbor_value_copy_text_string(&key, keys[n_keys], &len, NULL) !=
+        CborNoError) {
+      return;
+    }
+    n_keys++;
+    cbor_value_advance(&key);
+  }
+}
+
+static bool value_as_double(CborValue *value, double *result) {
+  if (cbor_value_is_float(value)) {
+    float f;
+    cbor_value_get_float(value, &f);
+    *result = f;
+  } else if (cbor_value_is_unsigned_integer(value)) {
+    uint64_t u;
+    cbor_value_get_uint64(value, &u);
+    *result = u;
+  } else if (cbor_value_is_boolean(value)) {
+    bool b;
+    cbor_value_get_boolean(value, &b);
+    *result = b ? 1.0 : 0.0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void load_update(CborValue *msg) {
+  CborValue values_value, value;
+  if ((cbor_value_map_find_value(msg, "values", &values_value) !=
+       CborNoError) ||
+      !cbor_value_is_array(&values_value) || (n_keys == 0)) {
+    return;
+  }
+
+  struct console_feed_update update = { 0 };
+  cbor_value_enter_container(&values_value, &value);
+  for (size_t i = 0; (i < n_keys) && !cbor_value_at_end(&value); i++) {
+    double v;
+    if (value_as_double(&value, &v)) {
+      console_feed_set_field(&update, keys[i], v);
+    }
+    cbor_value_advance(&value);
+  }
+
+  if ((n_updates % 1024) == 0) {
+    updates = realloc(updates, (n_updates + 1024) * sizeof(*updates));
+    if (!updates) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  updates[n_updates++] = update;
+}
+
+static int load_log(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror("fopen");
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  uint8_t *buf = malloc(size);
+  if (!buf || (fread(buf, 1, size, f) != (size_t)size)) {
+    fclose(f);
+    free(buf);
+    return -1;
+  }
+  fclose(f);
+
+  const uint8_t *ptr = buf;
+  const uint8_t *end = buf + size;
+  while (ptr < end) {
+    CborParser parser;
+    CborValue msg, type;
+    if (cbor_parser_init(ptr, end - ptr, 0, &parser, &msg) != CborNoError) {
+      break;
+    }
+
+    if (cbor_value_is_map(&msg) &&
+        (cbor_value_map_find_value(&msg, "type", &type) == CborNoError)) {
+      bool match;
+      cbor_value_text_string_equals(&type, "description", &match);
+      if (match) {
+        load_keys(&msg);
+      }
+      cbor_value_text_string_equals(&type, "feed", &match);
+      if (match) {
+        load_update(&msg);
+      }
+    }
+
+    if (cbor_value_advance(&msg) != CborNoError) {
+      break;
+    }
+    ptr = cbor_value_get_next_byte(&msg);
+  }
+  free(buf);
+  return n_updates > 0 ? 0 : -1;
+}
+
+static void run_format(const char *name, console_feed_format format) {
+  static uint8_t buf[4096];
+  uint64_t bytes = 0;
+  uint64_t total_cycles = 0;
+  uint64_t max_cycles = 0;
+
+  console_set_feed_format(format);
+  for (size_t i = 0; i < n_updates; i++) {
+    uint64_t start = cycle_count();
+    size_t size = console_feed_encode(&updates[i], buf, sizeof(buf));
+    uint64_t cycles = cycle_count() - start;
+
+    bytes += size;
+    total_cycles += cycles;
+    if (cycles > max_cycles) {
+      max_cycles = cycles;
+    }
+  }
+
+  printf("%-40s%-16.1f%-12u%u\n",
+         name,
+         (double)bytes / n_updates,
+         (unsigned int)cycles_to_ns(total_cycles / n_updates),
+         (unsigned int)cycles_to_ns(max_cycles));
+}
+
+int start_feed_bench(const char *path) {
+  if (load_log(path) < 0) {
+    fprintf(stderr, "Unable to load feed updates from %s\n", path);
+    return -1;
+  }
+
+  printf("%zu feed updates\n\n", n_updates);
+  printf("Format                                  Bytes/update    Avg ns      "
+         "Max ns\n");
+  run_format("cbor", FEED_FORMAT_CBOR);
+  run_format("packed", FEED_FORMAT_PACKED);
+  run_format("delta", FEED_FORMAT_DELTA);
+
+  console_set_feed_format(FEED_FORMAT_CBOR);
+  free(updates);
+  return 0;
+}
@@ -17,6 +17,8 @@
 #include "scheduler.h"
 #include "sensors.h"
 #include "sim.h"
+#include "spans.h"
+#include "trace.h"
 #include "util.h"
 #include "viaems.h"
 
@@ -62,11 +64,17 @@ void set_sim_wakeup(timeval_t t) {
 void set_gpio(uint16_t new_gpios, timeval_t when) {
   static uint16_t gpios = 0;
   if (gpios != new_gpios) {
-    console_record_event((struct logged_event){
+    trace_record((struct trace_record){
+      .type = TRACE_GPIO,
       .time = when,
       .value = new_gpios,
-      .type = EVENT_GPIO,
     });
+    console_record_event(EVENT_PRODUCER_OUTPUTS,
+                         (struct logged_event){
+                           .time = when,
+                           .value = new_gpios,
+                           .type = EVENT_GPIO,
+                         });
   }
 
   gpios = new_gpios;
@@ -137,11 +145,20 @@ static void retire_plan(struct platform_plan *plan) {
 }
 
 static void report_output_event(timeval_t time, uint16_t outputs) {
-  console_record_event((struct logged_event){
-    .time = time,
-    .value = outputs,
-    .type = EVENT_OUTPUT,
-  });
+  console_record_event(EVENT_PRODUCER_OUTPUTS,
+                       (struct logged_event){
+                         .time = time,
+                         .value = outputs,
+                         .type = EVENT_OUTPUT,
+                       });
+}
+
+/* Mark all entries in a plan as submitted, they may not be changed except by a
+ * trigger reschedule */
+static void submit_plan(struct platform_plan *plan) {
+  for (int i = 0; i < plan->n_events; i++) {
+    plan->schedule[i]->state = SCHED_SUBMITTED;
+  }
 }
 
 static void execute_plan(struct platform_plan *plan) {
@@ -149,9 +166,6 @@ static void execute_plan(struct platform_plan *plan) {
         plan->n_events,
         sizeof(struct schedule_entry *),
         schedule_entry_compare);
-  for (int i = 0; i < plan->n_events; i++) {
-    plan->schedule[i]->state = SCHED_SUBMITTED;
-  }
 
   for (int i = 0; i < plan->n_events; i++) {
     const struct schedule_entry *s = plan->schedule[i];
@@ -161,6 +175,13 @@ static void execute_plan(struct platform_plan *plan) {
     } else {
       cur_outputs &= ~(1 << s->pin);
     }
+    trace_record((struct trace_record){
+      .type = TRACE_OUTPUT,
+      .time = s->time,
+      .pin = s->pin,
+      .value = cur_outputs,
+      .aux = s->val,
+    });
 
     if ((i != plan->n_events - 1) && (s->time == (s + 1)->time)) {
       /* This isn't the last event, and the next event is the same time,
@@ -181,14 +202,55 @@ static void handle_replay_events(timeval_t until_time);
  * responsible for triggering event timer, buffer swap, and trigger events
  */
 
+/* Like the DMA-based platforms, plans are made one buffer ahead: while one
+ * 200 uS buffer is output, the next one is already planned and submitted.
+ * Triggers that occur in the meantime may reschedule that pending plan */
+static struct platform_plan pending_plan = {
+  .schedulable_start = 800,
+  .schedulable_end = 1600 - 1,
+};
+
+static void trigger_reschedule(void) {
+  bool changed = viaems_reschedule_on_trigger(&hosted_viaems, &pending_plan);
+  trace_record((struct trace_record){
+    .type = TRACE_RESCHEDULE,
+    .time = curtime,
+    .value = changed,
+  });
+  if (changed) {
+    submit_plan(&pending_plan);
+  }
+}
+
+/* The test trigger's input is only known to the decoder, so it is traced from
+ * the decoder's trigger counts */
+static void trace_test_trigger(timeval_t time,
+                               uint32_t t0_count,
+                               uint32_t t1_count) {
+  if (hosted_viaems.decoder.t0_count != t0_count) {
+    trace_record((struct trace_record){
+      .type = TRACE_TRIGGER,
+      .time = time,
+      .pin = 0,
+    });
+  }
+  if (hosted_viaems.decoder.t1_count != t1_count) {
+    trace_record((struct trace_record){
+      .type = TRACE_TRIGGER,
+      .time = time,
+      .pin = 1,
+    });
+  }
+}
+
 void *platform_timebase_thread(void *_ptr) {
   (void)_ptr;
 
   /* Each iteration will jump forward 200 uS, and first:
    *  - handle any sim wakeups between now and +200 uS
    *  - handle any replay events between now and +200 uS
-   *  - run the main engine rescheduling
-   *  - process the list of events provided
+   *  - output the pending plan for the next 200 uS
+   *  - run the main engine rescheduling for the 200 uS after that
    *  - actually wait 200 uS of real time
    */
 
@@ -206,12 +268,18 @@ void *platform_timebase_thread(void *_ptr) {
     timeval_t after = curtime + 800; /* 200 uS */
 
     if (sim_wakeup_enabled && time_before(sim_wakeup_time, after)) {
+      uint32_t t0_count = hosted_viaems.decoder.t0_count;
+      uint32_t t1_count = hosted_viaems.decoder.t1_count;
+      timeval_t time = sim_wakeup_time;
       sim_wakeup_callback(&hosted_viaems.decoder);
       sim_wakeup_enabled = false;
+      trace_test_trigger(time, t0_count, t1_count);
+      trigger_reschedule();
     }
 
     handle_replay_events(after);
 
+    uint32_t swap_start = span_start();
     struct engine_update update = { .current_time = after };
     update.position = decoder_get_engine_position(&hosted_viaems.decoder);
     sensor_update_adc(&hosted_viaems.sensors, &update.position, &current_adc);
@@ -220,14 +288,23 @@ void *platform_timebase_thread(void *_ptr) {
 
     retire_plan(&plan);
 
-    plan = (struct platform_plan){
-      .schedulable_start = after,
-      .schedulable_end = after + 800 - 1,
-    };
+    plan = pending_plan;
+    execute_plan(&plan);
 
-    viaems_reschedule(&hosted_viaems, &update, &plan);
+    pending_plan = (struct platform_plan){
+      .schedulable_start = after + 800,
+      .schedulable_end = after + 1600 - 1,
+    };
 
-    execute_plan(&plan);
+    viaems_reschedule(&hosted_viaems, &update, &pending_plan);
+    submit_plan(&pending_plan);
+    span_end(SPAN_BUFFER_SWAP, swap_start);
+    trace_record((struct trace_record){
+      .type = TRACE_PLAN,
+      .time = pending_plan.schedulable_start,
+      .value = pending_plan.n_events,
+      .aux = pending_plan.gpio,
+    });
 
     struct timespec next_tick = add_times(current_time, tick_increment);
     clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
@@ -241,13 +318,16 @@ struct hosted_args {
   const char *read_config_file;
   const char *write_config_file;
   const char *read_replay_file;
+  const char *wall_film_file;
+  const char *feed_bench_file;
+  const char *trace_file;
   bool benchmark_mode;
 };
 
 static void parse_args(struct hosted_args *args, int argc, char *argv[]) {
   *args = (struct hosted_args){ 0 };
   int opt;
-  while ((opt = getopt(argc, argv, "c:o:bi:")) != -1) {
+  while ((opt = getopt(argc, argv, "c:o:bi:w:f:t:")) != -1) {
     switch (opt) {
     case 'b':
       args->benchmark_mode = true;
@@ -261,10 +341,20 @@ static void parse_args(struct hosted_args *args, int argc, char *argv[]) {
     case 'i':
       args->read_replay_file = strdup(optarg);
       break;
+    case 'w':
+      args->wall_film_file = strdup(optarg);
+      break;
+    case 'f':
+      args->feed_bench_file = strdup(optarg);
+      break;
+    case 't':
+      args->trace_file = strdup(optarg);
+      break;
     default:
       fprintf(
         stderr,
-        "usage: viaems [-c config] [-o outconfig] [-b] [-i replayfile]\n");
+        "usage: viaems [-c config] [-o outconfig] [-b] [-i replayfile] "
+        "[-w transientlog] [-f consolelog] [-t tracefile]\n");
       exit(EXIT_FAILURE);
     }
   }
@@ -276,11 +366,13 @@ struct replay_event {
     NO_EVENT,
     TRIGGER_EVENT,
     ADC_EVENT,
+    KNOCK_EVENT,
     END_EVENT,
   } type;
 
   uint32_t trigger;
   struct adc_update adc;
+  struct knock_update knock;
 };
 
 static FILE *replay_file = NULL;
@@ -348,6 +440,33 @@ static struct replay_event read_next_replay_event(timeval_t last_time) {
     ev.type = ADC_EVENT;
     return ev;
   }
+  case 'k': {
+    /* k <delay> <pin> <sample> [<sample> ...] */
+    int delay;
+    int pin;
+    int consumed;
+    struct replay_event ev = { .type = KNOCK_EVENT };
+    if (sscanf(linebuf, "k %d %d%n", &delay, &pin, &consumed) != 2) {
+      fprintf(stderr, "Invalid knock replay line: %s", linebuf);
+      exit(EXIT_FAILURE);
+    }
+
+    const char *pos = linebuf + consumed;
+    while (ev.knock.n_samples < MAX_KNOCK_SAMPLES) {
+      float sample;
+      if (sscanf(pos, "%f%n", &sample, &consumed) != 1) {
+        break;
+      }
+      ev.knock.samples[ev.knock.n_samples++] = sample;
+      pos += consumed;
+    }
+
+    ev.knock.valid = true;
+    ev.knock.pin = pin;
+    ev.knock.time = last_time + delay;
+    ev.time = last_time + delay;
+    return ev;
+  }
   default:
     fprintf(stderr, "Invalid replay command: %c\n", linebuf[0]);
     exit(EXIT_SUCCESS);
@@ -371,16 +490,25 @@ static void handle_replay_events(timeval_t until_time) {
       exit(EXIT_SUCCESS);
       break;
     case TRIGGER_EVENT:
+      trace_record((struct trace_record){
+        .type = TRACE_TRIGGER,
+        .time = current_event.time,
+        .pin = current_event.trigger,
+      });
       decoder_update(&hosted_viaems.decoder,
                      &(struct trigger_event){
                        .time = current_event.time,
                        .type = current_event.trigger == 0 ? TRIGGER : SYNC });
+      trigger_reschedule();
       break;
     case NO_EVENT:
       break;
     case ADC_EVENT:
       current_adc = current_event.adc;
       break;
+    case KNOCK_EVENT:
+      sensor_queue_knock(&current_event.knock);
+      break;
     }
 
     current_event = read_next_replay_event(current_event.time);
@@ -397,6 +525,16 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  if (args.wall_film_file) {
+    int start_wall_film_sim(const char *);
+    return start_wall_film_sim(args.wall_film_file) ? EXIT_FAILURE : 0;
+  }
+
+  if (args.feed_bench_file) {
+    int start_feed_bench(const char *);
+    return start_feed_bench(args.feed_bench_file) ? EXIT_FAILURE : 0;
+  }
+
   struct config *config = platform_load_config();
   viaems_init(&hosted_viaems, config);
 
@@ -408,6 +546,10 @@ int main(int argc, char *argv[]) {
     replay_file = fopen(args.read_replay_file, "r");
   }
 
+  if (args.trace_file && !trace_open(args.trace_file)) {
+    exit(EXIT_FAILURE);
+  }
+
   /* Set stdin nonblock */
   fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL, 0) | O_NONBLOCK);
 
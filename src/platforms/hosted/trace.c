@@ -0,0 +1,93 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* The file is mapped in chunks, and remapped larger as it fills. Records are
+ * written straight into the mapping, and the kernel writes them back */
+#define TRACE_CHUNK_SIZE (64 * 1024 * 1024)
+
+static struct {
+  int fd;
+  uint8_t *map;
+  size_t mapped;
+  size_t used;
+} trace = { .fd = -1 };
+
+static bool trace_map(size_t size) {
+  if (ftruncate(trace.fd, size) < 0) {
+    perror("ftruncate");
+    return false;
+  }
+
+  void *map;
+  if (trace.map) {
+    map = mremap(trace.map, trace.mapped, size, MREMAP_MAYMOVE);
+  } else {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace.fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return false;
+  }
+  trace.map = map;
+  trace.mapped = size;
+  return true;
+}
+
+/* Trims the file to the records written */
+static void trace_close(void) {
+  if (trace.fd < 0) {
+    return;
+  }
+  if (trace.map) {
+    munmap(trace.map, trace.mapped);
+  }
+  if (ftruncate(trace.fd, trace.used) < 0) {
+    perror("ftruncate");
+  }
+  close(trace.fd);
+  trace.fd = -1;
+  trace.map = NULL;
+}
+
+bool trace_open(const char *path) {
+  trace.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (trace.fd < 0) {
+    perror("open");
+    return false;
+  }
+  if (!trace_map(TRACE_CHUNK_SIZE)) {
+    trace_close();
+    return false;
+  }
+
+  struct trace_header header = {
+    .magic = TRACE_MAGIC,
+    .version = TRACE_VERSION,
+    .record_size = sizeof(struct trace_record),
+    .tickrate = TICKRATE,
+  };
+  memcpy(trace.map, &header, sizeof(header));
+  trace.used = sizeof(header);
+
+  atexit(trace_close);
+  return true;
+}
+
+void trace_record(struct trace_record record) {
+  if (trace.fd < 0) {
+    return;
+  }
+  if ((trace.used + sizeof(record) > trace.mapped) &&
+      !trace_map(trace.mapped + TRACE_CHUNK_SIZE)) {
+    trace_close();
+    return;
+  }
+  memcpy(trace.map + trace.used, &record, sizeof(record));
+  trace.used += sizeof(record);
+}
@@ -0,0 +1,51 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+/* Binary trace of the hosted platform's inputs and outputs. A trace file is a
+ * struct trace_header followed by fixed-size struct trace_records in the order
+ * they were recorded, all little-endian. A record type of zero ends the trace
+ */
+
+#define TRACE_MAGIC "VTRC"
+#define TRACE_VERSION 1
+
+struct trace_header {
+  char magic[4];
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t tickrate;
+  uint32_t reserved;
+};
+
+typedef enum {
+  TRACE_END,
+  TRACE_TRIGGER,    /* pin is the trigger input */
+  TRACE_OUTPUT,     /* pin changed to aux, value is all outputs after */
+  TRACE_GPIO,       /* value is all gpios */
+  TRACE_RESCHEDULE, /* A trigger rescheduled, value is 1 if the plan changed */
+  TRACE_PLAN,       /* time is the plan's start, value the number of events and
+                       aux its gpios */
+} trace_record_type;
+
+struct trace_record {
+  uint32_t time;
+  uint8_t type;
+  uint8_t pin;
+  uint16_t reserved;
+  uint32_t value;
+  uint32_t aux;
+};
+
+/* Starts tracing to path, returning false if it cannot be created. The trace
+ * is finished when the program exits */
+bool trace_open(const char *path);
+
+/* Appends a record to the trace, if tracing. Only one thread may record */
+void trace_record(struct trace_record record);
+
+#endif
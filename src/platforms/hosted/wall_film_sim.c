@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "calculations.h"
+#include "config.h"
+#include "util.h"
+#include "viaems.h"
+
+/* Host simulation of transient fueling.  A logged throttle transient is
+ * replayed through calculate_ignition_and_fuel, and the commanded fuel is fed
+ * into a wall film plant.  The fuel actually delivered to the cylinder at each
+ * injection is compared to the desired quantity.
+ *
+ * The log is whitespace separated lines of:
+ *   <time ms> <rpm> <map kPa> <tps %> <clt C>
+ * Lines starting with # are ignored.
+ */
+
+#define MAX_SAMPLES 4096
+
+struct transient_sample {
+  float time_ms;
+  float rpm;
+  float map;
+  float tps;
+  float clt;
+};
+
+static struct transient_sample samples[MAX_SAMPLES];
+static int n_samples = 0;
+
+static int load_transient(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror("fopen");
+    return -1;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), f) && (n_samples < MAX_SAMPLES)) {
+    struct transient_sample *s = &samples[n_samples];
+    if (line[0] == '#') {
+      continue;
+    }
+    if (sscanf(line,
+               "%f %f %f %f %f",
+               &s->time_ms,
+               &s->rpm,
+               &s->map,
+               &s->tps,
+               &s->clt) == 5) {
+      n_samples++;
+    }
+  }
+  fclose(f);
+  return n_samples > 1 ? 0 : -1;
+}
+
+static struct transient_sample sample_at(float time_ms) {
+  int i = 1;
+  while ((i < n_samples - 1) && (samples[i].time_ms < time_ms)) {
+    i++;
+  }
+  const struct transient_sample *a = &samples[i - 1];
+  const struct transient_sample *b = &samples[i];
+  float frac = (time_ms - a->time_ms) / (b->time_ms - a->time_ms);
+  frac = fminf(fmaxf(frac, 0.0f), 1.0f);
+  return (struct transient_sample){
+    .time_ms = time_ms,
+    .rpm = a->rpm + (b->rpm - a->rpm) * frac,
+    .map = a->map + (b->map - a->map) * frac,
+    .tps = a->tps + (b->tps - a->tps) * frac,
+    .clt = a->clt + (b->clt - a->clt) * frac,
+  };
+}
+
+struct transient_results {
+  int injections;
+  float rms_error;
+  float max_error;
+};
+
+/* Replay the loaded transient with the provided config. The plant's X and tau
+ * are the config's tables scaled by x_scale and tau_scale to model a
+ * mismatched calibration */
+static struct transient_results run_transient(const struct config *config,
+                                              float x_scale,
+                                              float tau_scale) {
+  struct calculations calcs = { 0 };
+  struct transient_results results = { 0 };
+  const degrees_t spacing = 720.0f / config->fueling.injections_per_cycle;
+  const timeval_t step = time_from_us(200);
+
+  float plant_film = 0.0f;
+  timeval_t last_injection = 0;
+  degrees_t angle = 0.0f;
+  float last_tps = samples[0].tps;
+  float sum_squares = 0.0f;
+
+  for (timeval_t now = step;
+       us_from_time(now) / 1000.0f < samples[n_samples - 1].time_ms;
+       now += step) {
+    struct transient_sample s = sample_at(us_from_time(now) / 1000.0f);
+    degrees_t last_angle = angle;
+    angle = fmodf(angle + degrees_from_time_diff(step, s.rpm), 720.0f);
+
+    struct engine_update update = {
+      .current_time = now,
+      .position = {
+        .time = now,
+        .valid_until = now + step,
+        .has_position = true,
+        .has_rpm = true,
+        .rpm = s.rpm,
+        .tooth_rpm = s.rpm,
+        .last_trigger_angle = angle,
+      },
+      .sensors = {
+        .MAP = { .value = s.map },
+        .TPS = { .value = s.tps,
+                 .derivative = (s.tps - last_tps) / 0.0002f },
+        .CLT = { .value = s.clt },
+        .IAT = { .value = 25.0f },
+        .FRT = { .value = 25.0f },
+        .BRV = { .value = 14.0f },
+      },
+    };
+    last_tps = s.tps;
+
+    struct calculated_values values =
+      calculate_ignition_and_fuel(config, &update, &calcs);
+
+    if (fmodf(angle, spacing) >= fmodf(last_angle, spacing)) {
+      continue;
+    }
+
+    /* An injection occurs: inject the commanded quantity into the plant */
+    float injected = (values.fuelvol_per_cycle + (values.tipin / 1000.0f) +
+                      values.wall_film_correction) /
+                     config->fueling.injections_per_cycle;
+    float desired =
+      values.fuelvol_per_cycle / config->fueling.injections_per_cycle;
+
+    float x = x_scale *
+              interpolate_table_twoaxis(&config->wall_film_x, s.clt, s.map);
+    float tau_ms = tau_scale * interpolate_table_twoaxis(
+                                 &config->wall_film_tau, s.clt, s.map);
+    float dt_ms = us_from_time(now - last_injection) / 1000.0f;
+    float evaporated = plant_film * (1.0f - expf(-dt_ms / tau_ms));
+    last_injection = now;
+
+    float delivered = ((1.0f - x) * injected) + evaporated;
+    plant_film += (x * injected) - evaporated;
+
+    /* Skip the first cycles while the film builds up */
+    if (now < time_from_us(200000)) {
+      continue;
+    }
+
+    float error = 100.0f * (delivered - desired) / desired;
+    sum_squares += error * error;
+    if (fabsf(error) > fabsf(results.max_error)) {
+      results.max_error = error;
+    }
+    results.injections++;
+  }
+
+  if (results.injections > 0) {
+    results.rms_error = sqrtf(sum_squares / results.injections);
+  }
+  return results;
+}
+
+static void report(const char *name, struct transient_results r) {
+  printf("%-40s%-12d%-12.2f%-12.2f\n",
+         name,
+         r.injections,
+         (double)r.rms_error,
+         (double)r.max_error);
+}
+
+int start_wall_film_sim(const char *path) {
+  if (load_transient(path) < 0) {
+    fprintf(stderr, "Unable to load transient log %s\n", path);
+    return -1;
+  }
+
+  static struct config config;
+  config = default_config;
+
+  printf("Name                                    Injections  RMS err %%  "
+         "Max err %%\n");
+
+  config.fueling.wall_film = false;
+  report("Tipin enrichment", run_transient(&config, 1.0f, 1.0f));
+  report("Tipin enrichment (X, tau +30%)", run_transient(&config, 1.3f, 1.3f));
+
+  config.fueling.wall_film = true;
+  report("Wall film", run_transient(&config, 1.0f, 1.0f));
+  report("Wall film (X, tau +30%)", run_transient(&config, 1.3f, 1.3f));
+
+  return 0;
+}
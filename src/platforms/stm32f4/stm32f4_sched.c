@@ -165,9 +165,16 @@ void TIM2_IRQHandler(void) {
     }
   }
 
+  bool triggered = cc1_fired || cc2_fired;
+
   if (TIM2->SR & TIM_SR_CC4IF) {
     TIM2->SR = ~TIM_SR_CC4IF;
     sim_wakeup_callback(&stm32f4_viaems.decoder);
+    triggered = true;
+  }
+
+  if (triggered) {
+    stm32_trigger_reschedule(&stm32f4_viaems);
   }
 }
 
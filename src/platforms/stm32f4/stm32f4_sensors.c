@@ -147,7 +147,7 @@ void DMA2_Stream0_IRQHandler(void) {
       decoder_get_engine_position(&stm32f4_viaems.decoder);
     __enable_irq();
     sensor_update_adc(&stm32f4_viaems.sensors, &pos, &update);
-    process_knock_inputs(&stm32f4_viaems.sensors, sequence);
+    process_knock_inputs(sequence);
   }
 }
 
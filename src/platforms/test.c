@@ -4,13 +4,17 @@
 #include "calculations.h"
 #include "config.h"
 #include "console.h"
+#include "cuts.h"
 #include "decoder.h"
 #include "platform.h"
 #include "scheduler.h"
 #include "sensors.h"
+#include "spans.h"
 #include "table.h"
 #include "tasks.h"
 #include "util.h"
+#include "ve_learn.h"
+#include "viaems.h"
 #include "crc.h"
 
 /* Disable leak detection in asan. There are several convenience allocations,
@@ -72,9 +76,13 @@ void main(int argc, char *argv[]) {
   suite_add_tcase(viaems_suite, setup_decoder_tests());
   suite_add_tcase(viaems_suite, setup_scheduler_tests());
   suite_add_tcase(viaems_suite, setup_calculations_tests());
+  suite_add_tcase(viaems_suite, setup_cuts_tests());
   suite_add_tcase(viaems_suite, setup_console_tests());
   suite_add_tcase(viaems_suite, setup_tasks_tests());
   suite_add_tcase(viaems_suite, setup_crc_tests());
+  suite_add_tcase(viaems_suite, setup_viaems_tests());
+  suite_add_tcase(viaems_suite, setup_ve_learn_tests());
+  suite_add_tcase(viaems_suite, setup_spans_tests());
   SRunner *sr = srunner_create(viaems_suite);
   srunner_run_all(sr, CK_VERBOSE);
   exit(srunner_ntests_failed(sr));
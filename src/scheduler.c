@@ -1,5 +1,6 @@
 #include "scheduler.h"
 #include "config.h"
+#include "cuts.h"
 #include "decoder.h"
 #include "platform.h"
 #include "util.h"
@@ -9,7 +10,7 @@
 #include <strings.h>
 
 /* Returns true if both the start and stop entry have been confirmed to fire */
-static bool event_has_fired(struct output_event_schedule_state *ev) {
+static bool event_has_fired(const struct output_event_schedule_state *ev) {
   return (ev->start.state == SCHED_FIRED) && (ev->stop.state == SCHED_FIRED);
 }
 
@@ -38,6 +39,7 @@ static void reset_fired_event(struct output_event_schedule_state *ev) {
   assert(ev->stop.state == SCHED_FIRED);
   ev->start.state = SCHED_UNSCHEDULED;
   ev->stop.state = SCHED_UNSCHEDULED;
+  ev->cycles++;
 }
 
 /* Attempt to deschedule an output event. If the start event can't be disabled,
@@ -235,6 +237,51 @@ static bool schedule_fuel_event(struct output_event_schedule_state *ev,
   return true;
 }
 
+/* Skips an output's next event for a partial cut. Rather than being output,
+ * the event is marked as fired at the time it would have ended, so that like a
+ * fired event it is not scheduled again until its next cycle */
+static void skip_event(struct output_event_schedule_state *ev,
+                       timeval_t earliest_schedulable_time,
+                       const struct engine_position *pos,
+                       degrees_t advance) {
+  degrees_t firing_angle = clamp_angle(
+    clamp_angle(ev->config->angle - advance, 720) - pos->last_trigger_angle,
+    720);
+  timeval_t stop_time =
+    pos->time + time_from_rpm_diff(pos->tooth_rpm, firing_angle);
+
+  if (event_has_fired(ev)) {
+    if (time_diff(stop_time, ev->stop.time) <
+        time_from_rpm_diff(pos->rpm, 90)) {
+      return;
+    }
+    reset_fired_event(ev);
+  }
+
+  /* Too late to skip an event that is already being output */
+  if (!sched_entry_is_mutable(&ev->start) ||
+      !sched_entry_is_mutable(&ev->stop) ||
+      time_before(stop_time, earliest_schedulable_time)) {
+    return;
+  }
+
+  ev->start.time = stop_time;
+  ev->stop.time = stop_time;
+  ev->start.state = SCHED_FIRED;
+  ev->stop.state = SCHED_FIRED;
+}
+
+/* Returns true if the output's next event is cut. Outputs are numbered per
+ * type, so that fuel and ignition outputs listed in the same cylinder order
+ * are cut together */
+static bool event_is_cut(const struct config *config,
+                         const struct output_event_schedule_state *ev,
+                         uint32_t level,
+                         uint32_t index) {
+  uint32_t cycle = ev->cycles + (event_has_fired(ev) ? 1 : 0);
+  return cut_skips_event(level, config->cuts.pattern, cycle, index);
+}
+
 void schedule_events(const struct config *config,
                      const struct calculated_values *calcs,
                      const struct engine_position *pos,
@@ -242,20 +289,35 @@ void schedule_events(const struct config *config,
                      size_t n_outputs,
                      timeval_t earliest_scheduable_time) {
 
+  uint32_t n_ignition = 0;
+  uint32_t n_fuel = 0;
   for (size_t i = 0; i < n_outputs; i++) {
     switch (ev[i].config->type) {
-    case IGNITION_EVENT:
+    case IGNITION_EVENT: {
+      degrees_t advance = calcs->timing_advance + calcs->timing_trim[i] -
+                          calcs->knock_retard[i];
+      if (event_is_cut(config, &ev[i], calcs->spark_cut, n_ignition++)) {
+        skip_event(&ev[i], earliest_scheduable_time, pos, advance);
+        break;
+      }
       schedule_ignition_event(config,
                               &ev[i],
                               earliest_scheduable_time,
                               pos,
-                              (degrees_t)calcs->timing_advance,
+                              advance,
                               calcs->dwell_us);
       break;
+    }
 
     case FUEL_EVENT:
-      schedule_fuel_event(
-        &ev[i], earliest_scheduable_time, pos, calcs->fueling_us);
+      if (event_is_cut(config, &ev[i], calcs->fuel_cut, n_fuel++)) {
+        skip_event(&ev[i], earliest_scheduable_time, pos, 0);
+        break;
+      }
+      schedule_fuel_event(&ev[i],
+                          earliest_scheduable_time,
+                          pos,
+                          calcs->fueling_us + calcs->fuel_trim_us[i]);
       break;
 
     default:
@@ -595,6 +657,128 @@ START_TEST(check_deschedule_event) {
 }
 END_TEST
 
+START_TEST(check_schedule_events_knock_retard) {
+  struct engine_position pos = { .has_position = true,
+                                 .has_rpm = true,
+                                 .rpm = 6000,
+                                 .tooth_rpm = 6000,
+                                 .valid_until = -1 };
+
+  struct output_event_config confs[2] = {
+    { .type = IGNITION_EVENT, .angle = 360, .pin = 0 },
+    { .type = IGNITION_EVENT, .angle = 360, .pin = 1 },
+  };
+  struct output_event_schedule_state evs[2] = {
+    { .config = &confs[0] },
+    { .config = &confs[1] },
+  };
+
+  struct calculated_values calcs = {
+    .timing_advance = 20,
+    .dwell_us = 1000,
+    .knock_retard = { 0, 5 },
+  };
+
+  schedule_events(&default_config, &calcs, &pos, evs, 2, 0);
+  ck_assert(evs[0].stop.state == SCHED_SCHEDULED);
+  ck_assert(evs[1].stop.state == SCHED_SCHEDULED);
+
+  /* Only the second output is retarded */
+  ck_assert_int_eq(evs[0].stop.time, time_from_rpm_diff(pos.rpm, 360 - 20));
+  ck_assert_int_eq(evs[1].stop.time, time_from_rpm_diff(pos.rpm, 360 - 15));
+}
+END_TEST
+
+START_TEST(check_schedule_events_trims) {
+  struct engine_position pos = { .has_position = true,
+                                 .has_rpm = true,
+                                 .rpm = 6000,
+                                 .tooth_rpm = 6000,
+                                 .valid_until = -1 };
+
+  struct output_event_config confs[3] = {
+    { .type = IGNITION_EVENT, .angle = 360, .pin = 0 },
+    { .type = FUEL_EVENT, .angle = 360, .pin = 1 },
+    { .type = FUEL_EVENT, .angle = 360, .pin = 2 },
+  };
+  struct output_event_schedule_state evs[3] = {
+    { .config = &confs[0] },
+    { .config = &confs[1] },
+    { .config = &confs[2] },
+  };
+
+  struct calculated_values calcs = {
+    .timing_advance = 20,
+    .dwell_us = 1000,
+    .timing_trim = { 2 },
+    .fueling_us = 1000,
+    .fuel_trim_us = { 0, 0, 100 },
+  };
+
+  schedule_events(&default_config, &calcs, &pos, evs, 3, 0);
+  ck_assert_int_eq(evs[0].stop.time, time_from_rpm_diff(pos.rpm, 360 - 22));
+  ck_assert_int_eq(evs[1].stop.time - evs[1].start.time, time_from_us(1000));
+  ck_assert_int_eq(evs[2].stop.time - evs[2].start.time, time_from_us(1100));
+}
+END_TEST
+
+START_TEST(check_schedule_events_partial_cut) {
+  struct engine_position pos = { .has_position = true,
+                                 .has_rpm = true,
+                                 .rpm = 6000,
+                                 .tooth_rpm = 6000,
+                                 .valid_until = -1 };
+
+  struct output_event_config confs[5] = {
+    { .type = IGNITION_EVENT, .angle = 0, .pin = 0 },
+    { .type = IGNITION_EVENT, .angle = 180, .pin = 1 },
+    { .type = IGNITION_EVENT, .angle = 360, .pin = 2 },
+    { .type = IGNITION_EVENT, .angle = 540, .pin = 3 },
+    { .type = FUEL_EVENT, .angle = 360, .pin = 4 },
+  };
+  struct output_event_schedule_state evs[5];
+  for (int i = 0; i < 5; i++) {
+    evs[i] = (struct output_event_schedule_state){ .config = &confs[i] };
+  }
+
+  /* Half of the ignition events are skipped, fuel is unaffected */
+  struct calculated_values calcs = {
+    .timing_advance = 20,
+    .dwell_us = 1000,
+    .fueling_us = 1000,
+    .spark_cut = default_config.cuts.pattern / 2,
+  };
+  schedule_events(&default_config, &calcs, &pos, evs, 5, 0);
+  for (int i = 0; i < 4; i++) {
+    bool skipped = (i % 2) == 0;
+    ck_assert(evs[i].start.state ==
+              (skipped ? SCHED_FIRED : SCHED_SCHEDULED));
+    ck_assert(evs[i].stop.state == (skipped ? SCHED_FIRED : SCHED_SCHEDULED));
+  }
+  ck_assert(evs[4].stop.state == SCHED_SCHEDULED);
+
+  /* Skipped events are not rescheduled in the same cycle */
+  schedule_events(&default_config, &calcs, &pos, evs, 5, 0);
+  ck_assert(evs[0].stop.state == SCHED_FIRED);
+
+  /* Next cycle, the pattern has rotated to the other outputs */
+  for (int i = 0; i < 5; i++) {
+    if (evs[i].stop.state == SCHED_SCHEDULED) {
+      evs[i].start.state = SCHED_FIRED;
+      evs[i].stop.state = SCHED_FIRED;
+    }
+  }
+  pos.time += time_from_rpm_diff(pos.rpm, 720);
+  schedule_events(&default_config, &calcs, &pos, evs, 5, pos.time);
+  for (int i = 0; i < 4; i++) {
+    bool skipped = (i % 2) == 1;
+    ck_assert(evs[i].stop.state == (skipped ? SCHED_FIRED : SCHED_SCHEDULED));
+    ck_assert_int_eq(evs[i].cycles, 1);
+  }
+  ck_assert(evs[4].stop.state == SCHED_SCHEDULED);
+}
+END_TEST
+
 TCase *setup_scheduler_tests() {
   TCase *tc = tcase_create("scheduler");
   tcase_add_test(tc, check_schedule_ignition);
@@ -607,6 +791,9 @@ TCase *setup_scheduler_tests() {
   tcase_add_test(tc, check_schedule_ignition_reschedule_active_too_early);
   tcase_add_test(tc, check_schedule_fuel_immediately_after_finish);
   tcase_add_test(tc, check_deschedule_event);
+  tcase_add_test(tc, check_schedule_events_knock_retard);
+  tcase_add_test(tc, check_schedule_events_trims);
+  tcase_add_test(tc, check_schedule_events_partial_cut);
   return tc;
 }
 #endif
@@ -38,6 +38,14 @@ struct output_event_config {
                         this is the target angle to end the event */
   uint32_t pin;      /* Which pin to use for the event */
   bool inverted;     /* If true, output is active-low */
+
+  /* Per-output trims. The fuel trim is a percentage of fuel added, the timing
+   * trim degrees of advance added.  Each optionally adds a lookup from one of
+   * config's trim tables (1-based, 0 for none) */
+  float fuel_trim;
+  degrees_t timing_trim;
+  uint32_t fuel_trim_table;
+  uint32_t timing_trim_table;
 };
 
 /* Stores the scheduling state for a single output */
@@ -46,6 +54,7 @@ struct output_event_schedule_state {
     *config; /* Reference to the configuration for the event */
   struct schedule_entry start; /* Schedule state for event start */
   struct schedule_entry stop;  /* Schedule state for event stop */
+  uint32_t cycles;             /* Events fired or skipped */
 };
 
 struct config;
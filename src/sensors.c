@@ -4,6 +4,8 @@
 #include "decoder.h"
 #include "platform.h"
 #include "sensors.h"
+#include "spans.h"
+#include "spsc.h"
 #include "util.h"
 
 float sensor_convert_linear(const struct sensor_config *conf, const float raw) {
@@ -32,6 +34,53 @@ static void window_reset(struct sensor_state *s) {
   s->window_collecting = false;
   s->window_accumulator = 0;
   s->window_sample_count = 0;
+  s->window_history.count = 0;
+}
+
+/* Completed MAP windows are queued from the ADC interrupt for the console to
+ * collect from the idle loop */
+static struct sensor_window map_window_queue_windows[MAP_WINDOW_QUEUE_SIZE];
+static struct spsc_queue map_window_queue = { .size = MAP_WINDOW_QUEUE_SIZE };
+
+static void window_queue(const struct sensor_window *w) {
+  int32_t idx = spsc_allocate(&map_window_queue);
+  if (idx < 0) {
+    return;
+  }
+  map_window_queue_windows[idx] = *w;
+  spsc_push(&map_window_queue);
+}
+
+void sensors_collect_map_windows(struct sensor_window_history *h) {
+  for (int i = 0; i < MAP_WINDOW_QUEUE_SIZE; i++) {
+    int32_t idx = spsc_next(&map_window_queue);
+    if (idx < 0) {
+      return;
+    }
+    h->windows[h->count % SENSOR_WINDOW_HISTORY] =
+      map_window_queue_windows[idx];
+    h->count += 1;
+    spsc_release(&map_window_queue);
+  }
+}
+
+static float window_complete(struct sensor_state *s) {
+  float mean = s->window_accumulator / s->window_sample_count;
+  struct sensor_window_history *h = &s->window_history;
+  struct sensor_window *w = &h->windows[h->count % SENSOR_WINDOW_HISTORY];
+  *w = (struct sensor_window){
+    .start = s->window_start,
+    .min_angle = s->window_min_angle,
+    .min = s->window_min,
+    .max = s->window_max,
+    .mean = mean,
+    .sample_count = s->window_sample_count,
+  };
+  h->count += 1;
+  if (s->queue_windows) {
+    window_queue(w);
+  }
+  return mean;
 }
 
 static float sensor_convert_linear_windowed(struct sensor_state *state,
@@ -46,20 +95,31 @@ static float sensor_convert_linear_windowed(struct sensor_state *state,
   if (!in_window || (window_start != state->window_start)) {
     if (state->window_collecting && state->window_sample_count > 0) {
       state->window_collecting = false;
-      result = state->window_accumulator / state->window_sample_count;
+      result = window_complete(state);
     }
   }
 
   if (in_window) {
+    float value = sensor_convert_linear(state->config, raw);
     if (!state->window_collecting) {
       state->window_start = window_start;
       state->window_accumulator = 0;
       state->window_sample_count = 0;
+      state->window_min = value;
+      state->window_max = value;
+      state->window_min_angle = angle;
     }
     /* Accumulate */
     state->window_collecting = true;
-    state->window_accumulator += sensor_convert_linear(state->config, raw);
+    state->window_accumulator += value;
     state->window_sample_count += 1;
+    if (value < state->window_min) {
+      state->window_min = value;
+      state->window_min_angle = angle;
+    }
+    if (value > state->window_max) {
+      state->window_max = value;
+    }
   }
 
   /* Return previous processed value */
@@ -80,19 +140,64 @@ float sensor_convert_thermistor(const struct sensor_config *conf,
   return t - 273.15f;
 }
 
-static sensor_fault detect_faults(const struct sensor_state *s, float raw) {
+static uint32_t fault_window_mask(uint32_t window) {
+  uint32_t samples = sensor_fault_debounce_limit(window);
+  if (samples >= 32) {
+    return 0xffffffff;
+  }
+  return (1u << samples) - 1;
+}
+
+static sensor_fault detect_faults(struct sensor_state *s,
+                                  timeval_t time,
+                                  float raw) {
   if (s->output.fault != FAULT_NONE) {
     /* Some faults come from platform code before this point, pass it back */
     return s->output.fault;
   }
   /* Handle conn and range fault conditions */
-  if ((s->config->fault_config.max != 0)) {
-    if ((s->config->fault_config.min > raw) ||
-        (s->config->fault_config.max < raw)) {
-      return FAULT_RANGE;
-    }
+  if ((s->config->fault_config.max == 0)) {
+    return FAULT_NONE;
+  }
+
+  struct sensor_fault_stats *f = &s->fault_stats;
+  uint32_t out_of_range = (s->config->fault_config.min > raw) ||
+                          (s->config->fault_config.max < raw);
+  /* In range with none out of range in the window, as is usual */
+  if (!out_of_range && !f->history) {
+    return FAULT_NONE;
+  }
+
+  /* Debounce range faults: enter fault when debounce_count of the last
+   * debounce_window samples were out of range, leave it when none are. The
+   * history only keeps the samples in the window */
+  uint32_t mask = fault_window_mask(s->config->fault_config.debounce_window);
+  f->history = ((f->history << 1) | out_of_range) & mask;
+  if (!f->history) {
+    f->active = false;
+    return FAULT_NONE;
+  }
+  uint32_t count = __builtin_popcount(f->history);
+
+  /* A count that can't be reached in the window would never fault */
+  uint32_t required = s->config->fault_config.debounce_count;
+  uint32_t limit =
+    sensor_fault_debounce_limit(s->config->fault_config.debounce_window);
+  if (required > limit) {
+    required = limit;
+  }
+  if (!f->active && (count >= required)) {
+    f->active = true;
+    f->start = time;
+    f->total += 1;
+  }
+  if (!f->active) {
+    return FAULT_NONE;
+  }
+  if (time_diff(time, f->start) > f->longest) {
+    f->longest = time_diff(time, f->start);
   }
-  return FAULT_NONE;
+  return FAULT_RANGE;
 }
 
 static float process_derivative(float previous_value, float new_value) {
@@ -114,9 +219,14 @@ static void sensor_update_raw(struct sensor_state *s,
   const struct sensor_config *conf = s->config;
   struct sensor_value out;
 
-  if ((out.fault = detect_faults(s, raw)) != FAULT_NONE) {
+  if ((out.fault = detect_faults(s, time, raw)) != FAULT_NONE) {
     out.value = conf->fault_config.fault_value;
     out.derivative = 0;
+  } else if (s->fault_stats.history) {
+    /* Out of range samples in the window haven't faulted yet, so hold the
+     * last good value rather than filtering them in */
+    out.value = s->output.value;
+    out.derivative = 0;
   } else {
     float new_value = 0.0f;
     switch (conf->method) {
@@ -173,6 +283,8 @@ void sensor_update_freq(struct sensors *s,
   update_single_freq_sensor(&s->FRT, p, u);
   update_single_freq_sensor(&s->FRP, p, u);
   update_single_freq_sensor(&s->ETH, p, u);
+  update_single_freq_sensor(&s->CLU, p, u);
+  update_single_freq_sensor(&s->VSS, p, u);
 }
 
 static void update_single_adc_sensor(struct sensor_state *s,
@@ -191,6 +303,7 @@ static void update_single_adc_sensor(struct sensor_state *s,
 void sensor_update_adc(struct sensors *s,
                        const struct engine_position *p,
                        const struct adc_update *u) {
+  uint32_t start = span_start();
   update_single_adc_sensor(&s->MAP, p, u);
   update_single_adc_sensor(&s->BRV, p, u);
   update_single_adc_sensor(&s->IAT, p, u);
@@ -201,6 +314,9 @@ void sensor_update_adc(struct sensors *s,
   update_single_adc_sensor(&s->FRT, p, u);
   update_single_adc_sensor(&s->FRP, p, u);
   update_single_adc_sensor(&s->ETH, p, u);
+  update_single_adc_sensor(&s->CLU, p, u);
+  update_single_adc_sensor(&s->VSS, p, u);
+  span_end(SPAN_SENSORS, start);
 }
 
 static void update_single_const_sensor(struct sensor_state *s) {
@@ -228,12 +344,19 @@ void knock_configure(struct knock_sensor *knock) {
   knock->w = 2.0f * 3.14159f * (float)knock->freq / (float)knock->width;
   knock->cr = cosf(knock->w);
 
+  knock->sample_ticks = (float)time_from_us(1000000) / (float)samplerate;
+
   knock->n_samples = 0;
   knock->sprev = 0.0f;
   knock->sprev2 = 0.0f;
 };
 
-static void knock_add_sample(struct knock_sensor *knock, float sample) {
+static void knock_add_sample(struct knock_sensor *knock,
+                             float sample,
+                             timeval_t time) {
+  if (knock->n_samples == 0) {
+    knock->block_start = time;
+  }
 
   knock->n_samples += 1;
   float s = sample + knock->cr * 2 * knock->sprev - knock->sprev2;
@@ -243,6 +366,8 @@ static void knock_add_sample(struct knock_sensor *knock, float sample) {
   if (knock->n_samples == 64) {
     knock->value = knock->sprev * knock->sprev + knock->sprev2 * knock->sprev2 -
                    knock->sprev * knock->sprev2 * knock->cr * 2;
+    knock->time = knock->block_start + time_diff(time, knock->block_start) / 2;
+    knock->seq++;
 
     knock->n_samples = 0;
     knock->sprev = 0;
@@ -253,11 +378,66 @@ static void knock_add_sample(struct knock_sensor *knock, float sample) {
 void sensor_update_knock(struct sensors *s, const struct knock_update *update) {
   struct knock_sensor *knk = (update->pin == 0) ? &s->KNK1 : &s->KNK2;
 
+  /* A block missing samples would give a meaningless result */
+  if (update->after_drop) {
+    knk->n_samples = 0;
+    knk->sprev = 0;
+    knk->sprev2 = 0;
+  }
+
   for (int i = 0; i < update->n_samples; i++) {
-    knock_add_sample(knk, update->samples[i]);
+    timeval_t time = update->time + (timeval_t)(i * knk->sample_ticks);
+    knock_add_sample(knk, update->samples[i], time);
   }
 }
 
+/* Knock samples are queued from the ADC interrupt, and the Goertzel filter is
+ * run on them in batches from the idle loop */
+static struct knock_update knock_queue_updates[KNOCK_QUEUE_SIZE];
+static struct spsc_queue knock_queue = { .size = KNOCK_QUEUE_SIZE };
+
+static _Atomic uint32_t knock_dropped;
+static bool knock_pin_dropped[2]; /* Only touched by the producer */
+
+bool sensor_queue_knock(const struct knock_update *update) {
+  bool *pin_dropped = &knock_pin_dropped[update->pin != 0];
+  int32_t idx = spsc_allocate(&knock_queue);
+  if (idx < 0) {
+    knock_dropped++;
+    *pin_dropped = true;
+    return false;
+  }
+  knock_queue_updates[idx] = *update;
+  knock_queue_updates[idx].after_drop = *pin_dropped;
+  *pin_dropped = false;
+  spsc_push(&knock_queue);
+  return true;
+}
+
+uint32_t sensors_knock_dropped(void) {
+  return knock_dropped;
+}
+
+void sensors_process_knock(struct sensors *s) {
+  /* Bound the batch size so a busy producer can't starve the idle loop */
+  for (int i = 0; i < KNOCK_QUEUE_SIZE; i++) {
+    int32_t idx = spsc_next(&knock_queue);
+    if (idx < 0) {
+      return;
+    }
+    sensor_update_knock(s, &knock_queue_updates[idx]);
+    spsc_release(&knock_queue);
+  }
+}
+
+static struct knock_value knock_get_value(const struct knock_sensor *k) {
+  return (struct knock_value){
+    .time = k->time,
+    .seq = k->seq,
+    .value = k->value,
+  };
+}
+
 struct sensor_values sensors_get_values(const struct sensors *s) {
   return (struct sensor_values){
     .MAP = s->MAP.output,
@@ -270,14 +450,16 @@ struct sensor_values sensors_get_values(const struct sensors *s) {
     .FRT = s->FRT.output,
     .FRP = s->FRP.output,
     .ETH = s->ETH.output,
-    .KNK1 = s->KNK1.value,
-    .KNK2 = s->KNK2.value,
+    .CLU = s->CLU.output,
+    .VSS = s->VSS.output,
+    .KNK1 = knock_get_value(&s->KNK1),
+    .KNK2 = knock_get_value(&s->KNK2),
   };
 }
 
 void sensors_init(const struct sensor_configs *configs, struct sensors *s) {
   *s = (struct sensors){
-    .MAP = { .config = &configs->MAP },
+    .MAP = { .config = &configs->MAP, .queue_windows = true },
     .BRV = { .config = &configs->BRV },
     .IAT = { .config = &configs->IAT },
     .CLT = { .config = &configs->CLT },
@@ -287,6 +469,8 @@ void sensors_init(const struct sensor_configs *configs, struct sensors *s) {
     .FRT = { .config = &configs->FRT },
     .FRP = { .config = &configs->FRP },
     .ETH = { .config = &configs->ETH },
+    .CLU = { .config = &configs->CLU },
+    .VSS = { .config = &configs->VSS },
     .KNK1 = { .config = &configs->KNK1 },
     .KNK2 = { .config = &configs->KNK2 },
   };
@@ -302,10 +486,14 @@ void sensors_init(const struct sensor_configs *configs, struct sensors *s) {
   update_single_const_sensor(&s->FRT);
   update_single_const_sensor(&s->FRP);
   update_single_const_sensor(&s->ETH);
+  update_single_const_sensor(&s->CLU);
+  update_single_const_sensor(&s->VSS);
 }
 
 #ifdef UNITTEST
 #include <check.h>
+#include <pthread.h>
+#include <sched.h>
 
 START_TEST(check_sensor_convert_linear) {
   struct sensor_config conf = {
@@ -357,6 +545,199 @@ START_TEST(check_sensor_convert_linear_windowed) {
 }
 END_TEST
 
+START_TEST(check_sensor_fault_immediate) {
+  struct sensor_config conf = {
+    .fault_config = { .min = 1.0f, .max = 4.0f },
+  };
+  struct sensor_state state = { .config = &conf };
+
+  ck_assert_int_eq(detect_faults(&state, 0, 2.0f), FAULT_NONE);
+  ck_assert_int_eq(detect_faults(&state, 10, 4.5f), FAULT_RANGE);
+  ck_assert_int_eq(detect_faults(&state, 20, 2.0f), FAULT_NONE);
+  ck_assert_int_eq(state.fault_stats.total, 1);
+  ck_assert_int_eq(state.fault_stats.start, 10);
+}
+END_TEST
+
+START_TEST(check_sensor_fault_debounce) {
+  struct sensor_config conf = {
+    .fault_config = {
+      .min = 1.0f,
+      .max = 4.0f,
+      .debounce_count = 3,
+      .debounce_window = 5,
+    },
+  };
+  struct sensor_state state = { .config = &conf };
+  const struct sensor_fault_stats *stats = &state.fault_stats;
+
+  /* Two bad samples in five do not fault */
+  const float noisy[] = { 2.0f, 4.5f, 2.0f, 0.5f, 2.0f, 2.0f, 2.0f };
+  for (unsigned i = 0; i < sizeof(noisy) / sizeof(noisy[0]); i++) {
+    ck_assert_int_eq(detect_faults(&state, i, noisy[i]), FAULT_NONE);
+  }
+  ck_assert_int_eq(stats->total, 0);
+
+  /* Third bad sample in the window enters fault */
+  ck_assert_int_eq(detect_faults(&state, 100, 4.5f), FAULT_NONE);
+  ck_assert_int_eq(detect_faults(&state, 110, 4.5f), FAULT_NONE);
+  ck_assert_int_eq(detect_faults(&state, 120, 4.5f), FAULT_RANGE);
+  ck_assert(stats->active);
+  ck_assert_int_eq(stats->total, 1);
+  ck_assert_int_eq(stats->start, 120);
+
+  /* Fault holds until a full window is in range */
+  for (int i = 1; i < 5; i++) {
+    ck_assert_int_eq(detect_faults(&state, 120 + 10 * i, 2.0f), FAULT_RANGE);
+  }
+  ck_assert_int_eq(detect_faults(&state, 170, 2.0f), FAULT_NONE);
+  ck_assert(!stats->active);
+  ck_assert_int_eq(stats->longest, 40);
+
+  /* A second, shorter fault updates the count but not the longest */
+  for (int i = 0; i < 3; i++) {
+    detect_faults(&state, 200 + i, 0.0f);
+  }
+  for (int i = 0; i < 5; i++) {
+    detect_faults(&state, 210 + i, 2.0f);
+  }
+  ck_assert_int_eq(stats->total, 2);
+  ck_assert_int_eq(stats->start, 202);
+  ck_assert_int_eq(stats->longest, 40);
+
+  /* A count that can't be reached in the window faults on a full window */
+  conf.fault_config.debounce_count = 10;
+  for (int i = 0; i < 4; i++) {
+    ck_assert_int_eq(detect_faults(&state, 300 + i, 0.0f), FAULT_NONE);
+  }
+  ck_assert_int_eq(detect_faults(&state, 304, 0.0f), FAULT_RANGE);
+}
+END_TEST
+
+START_TEST(check_sensor_fault_debounce_holds_value) {
+  struct sensor_config conf = {
+    .method = METHOD_LINEAR,
+    .range = { .min = 0.0f, .max = 100.0f },
+    .raw_max = 5.0f,
+    .fault_config = {
+      .min = 1.0f,
+      .max = 4.0f,
+      .debounce_count = 3,
+      .debounce_window = 5,
+      .fault_value = 50.0f,
+    },
+  };
+  struct sensor_state state = { .config = &conf };
+  struct engine_position pos = { 0 };
+
+  sensor_update_raw(&state, &pos, 0, 2.0f);
+  ck_assert_float_eq(state.output.value, 40.0f);
+
+  /* A bad sample isn't converted while it is debounced, and the value is
+   * held until the window is in range again */
+  sensor_update_raw(&state, &pos, 10, 4.9f);
+  ck_assert_int_eq(state.output.fault, FAULT_NONE);
+  ck_assert_float_eq(state.output.value, 40.0f);
+  for (int i = 0; i < 4; i++) {
+    sensor_update_raw(&state, &pos, 20 + i, 3.0f);
+    ck_assert_float_eq(state.output.value, 40.0f);
+  }
+  sensor_update_raw(&state, &pos, 30, 3.0f);
+  ck_assert_float_eq_tol(state.output.value, 60.0f, 0.001f);
+}
+END_TEST
+
+START_TEST(check_sensor_window_history) {
+  struct sensor_config conf = {
+    .range = { .min=0, .max=4096.0},
+    .raw_max = 4096.0,
+    .window = {
+      .windows_per_cycle = 8,
+      .window_opening = 45,
+    },
+  };
+
+  struct sensor_state state = {
+    .config = &conf,
+  };
+  const struct sensor_window_history *h = &state.window_history;
+
+  ck_assert_ptr_null(sensor_window_get(h, 0));
+
+  sensor_convert_linear_windowed(&state, 0, 2048.0f);
+  sensor_convert_linear_windowed(&state, 10, 1000.0f);
+  sensor_convert_linear_windowed(&state, 40, 3000.0f);
+  sensor_convert_linear_windowed(&state, 50, 0.0f);
+
+  const struct sensor_window *w = sensor_window_get(h, 0);
+  ck_assert_ptr_nonnull(w);
+  ck_assert_ptr_null(sensor_window_get(h, 1));
+  ck_assert_float_eq_tol(w->start, 0, 0.01);
+  ck_assert_float_eq_tol(w->min, 1000, 0.01);
+  ck_assert_float_eq_tol(w->min_angle, 10, 0.01);
+  ck_assert_float_eq_tol(w->max, 3000, 0.01);
+  ck_assert_float_eq_tol(w->mean, 2016, 0.01);
+  ck_assert_int_eq(w->sample_count, 3);
+
+  /* Fill the history past its size, one sample per window */
+  for (int i = 1; i <= SENSOR_WINDOW_HISTORY + 2; i++) {
+    sensor_convert_linear_windowed(&state, (i % 8) * 90 + 5, 100.0f * i);
+  }
+  sensor_convert_linear_windowed(&state, 60, 0.0f);
+
+  ck_assert_int_eq(h->count, SENSOR_WINDOW_HISTORY + 3);
+  ck_assert_float_eq_tol(sensor_window_get(h, 0)->mean, 1000, 0.01);
+  ck_assert_float_eq_tol(sensor_window_get(h, 0)->start, 180, 0.01);
+  ck_assert_float_eq_tol(
+    sensor_window_get(h, SENSOR_WINDOW_HISTORY - 1)->mean, 300, 0.01);
+  ck_assert_ptr_null(sensor_window_get(h, SENSOR_WINDOW_HISTORY));
+
+  /* Losing sync clears the history */
+  window_reset(&state);
+  ck_assert_ptr_null(sensor_window_get(h, 0));
+}
+END_TEST
+
+START_TEST(check_sensor_window_queue) {
+  struct sensor_config conf = {
+    .range = { .min=0, .max=4096.0},
+    .raw_max = 4096.0,
+    .window = {
+      .windows_per_cycle = 8,
+      .window_opening = 45,
+    },
+  };
+
+  struct sensor_state state = {
+    .config = &conf,
+    .queue_windows = true,
+  };
+  struct sensor_window_history collected = { 0 };
+  sensors_collect_map_windows(&collected);
+  collected.count = 0;
+
+  /* One sample per window, each completed by the next */
+  for (int i = 0; i <= MAP_WINDOW_QUEUE_SIZE + 2; i++) {
+    sensor_convert_linear_windowed(&state, (i % 8) * 90 + 5, 100.0f * i);
+  }
+
+  /* Windows that don't fit in the queue are lost, it holds one less than its
+   * size */
+  sensors_collect_map_windows(&collected);
+  ck_assert_int_eq(collected.count, MAP_WINDOW_QUEUE_SIZE - 1);
+  ck_assert_float_eq_tol(sensor_window_get(&collected, 0)->mean,
+                         100.0f * (MAP_WINDOW_QUEUE_SIZE - 2),
+                         0.01);
+
+  sensor_convert_linear_windowed(&state, 5, 0.0f);
+  sensors_collect_map_windows(&collected);
+  ck_assert_int_eq(collected.count, MAP_WINDOW_QUEUE_SIZE);
+  ck_assert_float_eq_tol(sensor_window_get(&collected, 0)->mean,
+                         100.0f * (MAP_WINDOW_QUEUE_SIZE + 2),
+                         0.01);
+}
+END_TEST
+
 START_TEST(check_sensor_convert_linear_windowed_skipped) {
   struct sensor_config conf = {
     .range = { .min=0, .max=4096.0},
@@ -572,6 +953,125 @@ START_TEST(check_knock_configure) {
 }
 END_TEST
 
+START_TEST(check_knock_queue) {
+  struct knock_sensor_config conf = {
+    .frequency = 7000,
+  };
+  struct sensors direct = { .KNK1 = { .config = &conf } };
+  struct sensors queued = { .KNK1 = { .config = &conf } };
+  knock_configure(&direct.KNK1);
+  knock_configure(&queued.KNK1);
+
+  struct knock_update update = { .valid = true, .pin = 0, .n_samples = 16 };
+  for (int i = 0; i < 64; i += 16) {
+    for (int j = 0; j < 16; j++) {
+      update.samples[j] = sinf(2.0f * 3.14159f * 9.0f * (i + j) / 64.0f);
+    }
+    sensor_update_knock(&direct, &update);
+    ck_assert(sensor_queue_knock(&update));
+  }
+
+  /* Nothing is processed until the queue is drained */
+  ck_assert_float_eq(queued.KNK1.value, 0.0f);
+  sensors_process_knock(&queued);
+  ck_assert_float_gt(direct.KNK1.value, 0.0f);
+  ck_assert_float_eq(queued.KNK1.value, direct.KNK1.value);
+
+  /* A full queue rejects updates rather than overwriting them */
+  for (int i = 0; i < KNOCK_QUEUE_SIZE - 1; i++) {
+    ck_assert(sensor_queue_knock(&update));
+  }
+  uint32_t dropped = sensors_knock_dropped();
+  ck_assert(!sensor_queue_knock(&update));
+  ck_assert_int_eq(sensors_knock_dropped(), dropped + 1);
+  sensors_process_knock(&queued);
+  ck_assert(spsc_is_empty(&knock_queue));
+}
+END_TEST
+
+START_TEST(check_knock_block_time) {
+  struct knock_sensor_config conf = {
+    .frequency = 7000,
+  };
+  struct sensors s = { .KNK1 = { .config = &conf } };
+  knock_configure(&s.KNK1);
+  while (spsc_next(&knock_queue) >= 0) {
+    spsc_release(&knock_queue);
+  }
+
+  /* Blocks are timed at the midpoint of their samples, 20 us apart */
+  struct knock_update update = { .valid = true, .pin = 0, .n_samples = 16 };
+  for (int i = 0; i < 4; i++) {
+    update.time = 1000 + time_from_us(20 * 16 * i);
+    sensor_update_knock(&s, &update);
+  }
+  ck_assert_int_eq(s.KNK1.seq, 1);
+  ck_assert_int_eq(s.KNK1.time, 1000 + time_from_us(20 * 63) / 2);
+  struct sensor_values values = sensors_get_values(&s);
+  ck_assert_int_eq(values.KNK1.seq, 1);
+  ck_assert_int_eq(values.KNK1.time, s.KNK1.time);
+
+  /* A dropped set discards the partial block it belonged to */
+  ck_assert(sensor_queue_knock(&update));
+  for (int i = 0; i < KNOCK_QUEUE_SIZE - 2; i++) {
+    ck_assert(sensor_queue_knock(&update));
+  }
+  ck_assert(!sensor_queue_knock(&update));
+  sensors_process_knock(&s);
+  ck_assert_int_eq(s.KNK1.seq, 1 + (KNOCK_QUEUE_SIZE - 1) / 4);
+
+  ck_assert(sensor_queue_knock(&update));
+  sensors_process_knock(&s);
+  ck_assert_int_eq(s.KNK1.n_samples, 16);
+}
+END_TEST
+
+#define KNOCK_STRESS_UPDATES 100000
+
+static void *knock_stress_producer(void *_unused) {
+  (void)_unused;
+  struct knock_update update = { .valid = true, .n_samples = 16 };
+  for (int i = 0; i < KNOCK_STRESS_UPDATES; i++) {
+    update.pin = i % 2;
+    for (int j = 0; j < update.n_samples; j++) {
+      update.samples[j] = (float)i;
+    }
+    while (!sensor_queue_knock(&update)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+/* Run the producer in its own thread, and consume directly from the queue,
+ * verifying every update arrives in order and without tearing */
+START_TEST(check_knock_queue_stress) {
+  pthread_t producer;
+  ck_assert_int_eq(
+    pthread_create(&producer, NULL, knock_stress_producer, NULL), 0);
+
+  int expected = 0;
+  while (expected < KNOCK_STRESS_UPDATES) {
+    int32_t idx = spsc_next(&knock_queue);
+    if (idx < 0) {
+      sched_yield();
+      continue;
+    }
+    const struct knock_update *update = &knock_queue_updates[idx];
+    ck_assert_int_eq(update->pin, expected % 2);
+    ck_assert_int_eq(update->n_samples, 16);
+    for (int j = 0; j < update->n_samples; j++) {
+      ck_assert_float_eq(update->samples[j], (float)expected);
+    }
+    spsc_release(&knock_queue);
+    expected++;
+  }
+
+  pthread_join(producer, NULL);
+  ck_assert(spsc_is_empty(&knock_queue));
+}
+END_TEST
+
 TCase *setup_sensor_tests() {
   TCase *sensor_tests = tcase_create("sensors");
   tcase_add_test(sensor_tests, check_sensor_convert_linear);
@@ -579,11 +1079,19 @@ TCase *setup_sensor_tests() {
   tcase_add_test(sensor_tests, check_sensor_convert_linear_windowed_skipped);
   tcase_add_test(sensor_tests, check_sensor_convert_linear_windowed_wide);
   tcase_add_test(sensor_tests, check_sensor_convert_linear_windowed_offset);
+  tcase_add_test(sensor_tests, check_sensor_window_history);
+  tcase_add_test(sensor_tests, check_sensor_window_queue);
+  tcase_add_test(sensor_tests, check_sensor_fault_immediate);
+  tcase_add_test(sensor_tests, check_sensor_fault_debounce);
+  tcase_add_test(sensor_tests, check_sensor_fault_debounce_holds_value);
   tcase_add_test(sensor_tests, check_sensor_convert_therm);
 
   tcase_add_test(sensor_tests, check_current_angle_in_window);
 
   tcase_add_test(sensor_tests, check_knock_configure);
+  tcase_add_test(sensor_tests, check_knock_queue);
+  tcase_add_test(sensor_tests, check_knock_block_time);
+  tcase_add_test(sensor_tests, check_knock_queue_stress);
   return sensor_tests;
 }
 
@@ -5,6 +5,9 @@
 #define SENSOR_FREQ_DIVIDER 4096
 #define MAX_ADC_PINS 16
 #define MAX_KNOCK_SAMPLES 16
+#define KNOCK_QUEUE_SIZE 64
+#define MAP_WINDOW_QUEUE_SIZE 16
+#define SENSOR_WINDOW_HISTORY 8
 
 typedef enum {
   SENSOR_NONE,
@@ -51,6 +54,10 @@ struct sensor_config {
     float min;
     float max;
     float fault_value;
+    uint32_t debounce_count;  /* Out of range samples in debounce_window to
+                                 enter fault, 0 for immediate */
+    uint32_t debounce_window; /* Samples considered, up to 32. Fault is
+                                 cleared when all are in range */
   } fault_config;
 
   struct window_config {
@@ -67,14 +74,55 @@ struct sensor_value {
   sensor_fault fault;
 };
 
+/* Statistics for a single completed sample window */
+struct sensor_window {
+  degrees_t start;     /* Angle the window opened at */
+  degrees_t min_angle; /* Angle of the lowest sample */
+  float min;
+  float max;
+  float mean;
+  uint32_t sample_count;
+};
+
+struct sensor_window_history {
+  uint32_t count; /* Completed windows since sync, newest is at
+                     (count - 1) % SENSOR_WINDOW_HISTORY */
+  struct sensor_window windows[SENSOR_WINDOW_HISTORY];
+};
+
+/* Largest debounce_count that can be reached in a debounce_window */
+static inline uint32_t sensor_fault_debounce_limit(uint32_t window) {
+  if (window <= 1) {
+    return 1;
+  }
+  if (window >= 32) {
+    return 32;
+  }
+  return window;
+}
+
+struct sensor_fault_stats {
+  uint32_t history; /* One bit per sample, set if out of range */
+  bool active;
+  timeval_t start;   /* Time the current or last fault started */
+  uint32_t total;    /* Number of debounced faults */
+  timeval_t longest; /* Longest fault duration */
+};
+
 struct sensor_state {
   const struct sensor_config *config;
   struct sensor_value output;
+  struct sensor_fault_stats fault_stats;
 
   bool window_collecting;
   degrees_t window_start;
   float window_accumulator;
   uint32_t window_sample_count;
+  float window_min;
+  float window_max;
+  degrees_t window_min_angle;
+  struct sensor_window_history window_history;
+  bool queue_windows; /* Completed windows are queued for the console */
 };
 
 struct knock_sensor_config {
@@ -89,10 +137,16 @@ struct knock_sensor {
   float w;
   float cr;
 
+  float sample_ticks; /* Time between samples */
+
   uint32_t n_samples;
   float sprev;
   float sprev2;
+  timeval_t block_start; /* Time of the first sample of the current block */
+
   float value;
+  timeval_t time; /* Midpoint of the last completed block */
+  uint32_t seq;   /* Completed blocks */
 };
 
 struct sensor_configs {
@@ -106,6 +160,8 @@ struct sensor_configs {
   struct sensor_config FRT;
   struct sensor_config FRP;
   struct sensor_config ETH;
+  struct sensor_config CLU; /* Clutch switch, pressed above 0.5 */
+  struct sensor_config VSS; /* Vehicle speed */
   struct knock_sensor_config KNK1;
   struct knock_sensor_config KNK2;
 };
@@ -121,10 +177,20 @@ struct sensors {
   struct sensor_state FRT;
   struct sensor_state FRP;
   struct sensor_state ETH;
+  struct sensor_state CLU;
+  struct sensor_state VSS;
   struct knock_sensor KNK1;
   struct knock_sensor KNK2;
 };
 
+/* Result of the last completed block of a knock input. Each block has a new
+ * seq, so that it is only acted on once */
+struct knock_value {
+  timeval_t time; /* Midpoint of the block's samples */
+  uint32_t seq;
+  float value;
+};
+
 struct sensor_values {
   struct sensor_value MAP;
   struct sensor_value BRV;
@@ -136,10 +202,31 @@ struct sensor_values {
   struct sensor_value FRT;
   struct sensor_value FRP;
   struct sensor_value ETH;
-  float KNK1;
-  float KNK2;
+  struct sensor_value CLU;
+  struct sensor_value VSS;
+  struct knock_value KNK1;
+  struct knock_value KNK2;
 };
 
+/* Returns a completed window, with age 0 being the most recent, or NULL if
+ * that window is not available */
+static inline const struct sensor_window *sensor_window_get(
+  const struct sensor_window_history *h,
+  uint32_t age) {
+  if ((age >= h->count) || (age >= SENSOR_WINDOW_HISTORY)) {
+    return NULL;
+  }
+  return &h->windows[(h->count - 1 - age) % SENSOR_WINDOW_HISTORY];
+}
+
+/* Returns a completed MAP window for the engine loop, as sensor_window_get.
+ * The history is kept in the sensors rather than copied into each update */
+static inline const struct sensor_window *sensors_map_window(
+  const struct sensors *s,
+  uint32_t age) {
+  return sensor_window_get(&s->MAP.window_history, age);
+}
+
 typedef enum {
   RISING_EDGE,
   FALLING_EDGE,
@@ -176,6 +263,8 @@ struct adc_update {
 struct knock_update {
   timeval_t time; /* Time of first sample in set */
   bool valid;
+  bool after_drop; /* Sets for this pin were dropped just before, set by the
+                      queue */
   int pin;
   int n_samples;
   float samples[MAX_KNOCK_SAMPLES];
@@ -194,6 +283,21 @@ void sensor_update_adc(struct sensors *,
                        const struct engine_position *,
                        const struct adc_update *);
 void sensor_update_knock(struct sensors *, const struct knock_update *);
+
+/* Queue knock samples for later processing, safe to call from a single
+ * producer interrupt. Returns false if the queue is full, in which case the
+ * set is counted as dropped and the pin's partial block is discarded */
+bool sensor_queue_knock(const struct knock_update *);
+
+/* Total knock sample sets dropped while the queue was full */
+uint32_t sensors_knock_dropped(void);
+
+/* Process queued knock samples, must be called from a single consumer */
+void sensors_process_knock(struct sensors *);
+
+/* Adds the MAP windows queued since the last call to h, must be called from a
+ * single consumer. Windows completed while the queue is full are lost */
+void sensors_collect_map_windows(struct sensor_window_history *h);
 void knock_configure(struct knock_sensor *k);
 
 struct sensor_values sensors_get_values(const struct sensors *);
@@ -0,0 +1,220 @@
+#include "spans.h"
+#include "spsc.h"
+
+const char *const span_names[NUM_SPANS] = {
+  [SPAN_DECODER] = "decoder",
+  [SPAN_SENSORS] = "sensors",
+  [SPAN_BUFFER_SWAP] = "buffer-swap",
+  [SPAN_RESCHEDULE] = "reschedule",
+  [SPAN_TASKS] = "tasks",
+  [SPAN_CALCULATIONS] = "calculations",
+  [SPAN_SCHEDULE] = "schedule",
+  [SPAN_PLAN] = "plan",
+};
+
+static struct span_histogram span_histograms[NUM_SPANS];
+
+static uint32_t span_histogram_bucket(uint32_t cycles) {
+  uint32_t bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+  return (bucket < SPAN_HISTOGRAM_BUCKETS) ? bucket
+                                           : SPAN_HISTOGRAM_BUCKETS - 1;
+}
+
+static void span_histogram_add(span_id id, uint32_t cycles) {
+  struct span_histogram *h = &span_histograms[id];
+  h->count++;
+  h->buckets[span_histogram_bucket(cycles)]++;
+  if (cycles > h->max_cycles) {
+    h->max_cycles = cycles;
+  }
+}
+
+const struct span_histogram *span_histogram(span_id id) {
+  return &span_histograms[id];
+}
+
+void span_histograms_reset(void) {
+  for (int i = 0; i < NUM_SPANS; i++) {
+    span_histograms[i] = (struct span_histogram){ 0 };
+  }
+}
+
+void span_end(span_id id, uint32_t start) {
+  uint32_t end = cycle_count();
+  span_histogram_add(id, end - start);
+#ifdef SPANS
+  span_record(id, start, end);
+#endif
+}
+
+#ifdef SPANS
+/* Spans are dropped while their ring is full */
+#ifndef SPAN_LOG_SIZE
+#define SPAN_LOG_SIZE 128
+#endif
+
+/* The decoder runs in the trigger interrupt, the sensors in the ADC interrupt,
+ * and the rest in the buffer swap, so each has its own ring and they never
+ * share a write index */
+typedef enum {
+  SPAN_CONTEXT_DECODER,
+  SPAN_CONTEXT_SENSORS,
+  SPAN_CONTEXT_BUFFER_SWAP,
+  NUM_SPAN_CONTEXTS,
+} span_context;
+
+struct span_ring {
+  struct spsc_queue queue;
+  _Atomic uint32_t dropped;
+  struct span spans[SPAN_LOG_SIZE];
+};
+
+static struct span_ring span_rings[NUM_SPAN_CONTEXTS] = {
+  [SPAN_CONTEXT_DECODER] = { .queue = { .size = SPAN_LOG_SIZE } },
+  [SPAN_CONTEXT_SENSORS] = { .queue = { .size = SPAN_LOG_SIZE } },
+  [SPAN_CONTEXT_BUFFER_SWAP] = { .queue = { .size = SPAN_LOG_SIZE } },
+};
+
+static struct span_ring *span_ring_for(span_id id) {
+  switch (id) {
+  case SPAN_DECODER:
+    return &span_rings[SPAN_CONTEXT_DECODER];
+  case SPAN_SENSORS:
+    return &span_rings[SPAN_CONTEXT_SENSORS];
+  default:
+    return &span_rings[SPAN_CONTEXT_BUFFER_SWAP];
+  }
+}
+
+void span_record(span_id id, uint32_t start, uint32_t end) {
+  struct span_ring *ring = span_ring_for(id);
+  int idx = spsc_allocate(&ring->queue);
+  if (idx < 0) {
+    ring->dropped++;
+    return;
+  }
+  ring->spans[idx] = (struct span){
+    .id = id,
+    .start = start,
+    .end = end,
+  };
+  spsc_push(&ring->queue);
+}
+
+bool span_next(struct span *dest) {
+  for (int i = 0; i < NUM_SPAN_CONTEXTS; i++) {
+    struct span_ring *ring = &span_rings[i];
+    int idx = spsc_next(&ring->queue);
+    if (idx >= 0) {
+      *dest = ring->spans[idx];
+      spsc_release(&ring->queue);
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t span_dropped(void) {
+  uint32_t dropped = 0;
+  for (int i = 0; i < NUM_SPAN_CONTEXTS; i++) {
+    dropped += span_rings[i].dropped;
+  }
+  return dropped;
+}
+#endif
+
+#ifdef UNITTEST
+#include <check.h>
+
+#ifdef SPANS
+static void drain_spans(void) {
+  struct span s;
+  while (span_next(&s))
+    ;
+}
+
+START_TEST(check_spans_record) {
+  drain_spans();
+  uint32_t dropped = span_dropped();
+
+  span_record(SPAN_RESCHEDULE, 100, 200);
+  span_record(SPAN_DECODER, 150, 160);
+  span_record(SPAN_TASKS, 110, 120);
+
+  /* Each context's spans are read in order */
+  struct span s;
+  ck_assert(span_next(&s));
+  ck_assert_int_eq(s.id, SPAN_DECODER);
+  ck_assert_int_eq(s.start, 150);
+  ck_assert_int_eq(s.end, 160);
+
+  ck_assert(span_next(&s));
+  ck_assert_int_eq(s.id, SPAN_RESCHEDULE);
+  ck_assert_int_eq(s.start, 100);
+
+  ck_assert(span_next(&s));
+  ck_assert_int_eq(s.id, SPAN_TASKS);
+  ck_assert(!span_next(&s));
+
+  /* A full ring drops new spans, and only that context's */
+  for (uint32_t i = 0; i < SPAN_LOG_SIZE + 4; i++) {
+    span_record(SPAN_PLAN, i, i + 1);
+  }
+  span_record(SPAN_DECODER, 0, 1);
+  ck_assert_int_eq(span_dropped(), dropped + 5);
+
+  ck_assert(span_next(&s));
+  ck_assert_int_eq(s.id, SPAN_DECODER);
+  for (uint32_t i = 0; i < SPAN_LOG_SIZE - 1; i++) {
+    ck_assert(span_next(&s));
+    ck_assert_int_eq(s.id, SPAN_PLAN);
+    ck_assert_int_eq(s.start, i);
+  }
+  ck_assert(!span_next(&s));
+}
+END_TEST
+#endif
+
+START_TEST(check_span_histograms) {
+  span_histograms_reset();
+
+  span_histogram_add(SPAN_PLAN, 0);
+  span_histogram_add(SPAN_PLAN, 1);
+  span_histogram_add(SPAN_PLAN, 2);
+  span_histogram_add(SPAN_PLAN, 3);
+  span_histogram_add(SPAN_PLAN, 1000);
+  span_histogram_add(SPAN_PLAN, 1024);
+  span_histogram_add(SPAN_PLAN, UINT32_MAX);
+
+  const struct span_histogram *h = span_histogram(SPAN_PLAN);
+  ck_assert_int_eq(h->count, 7);
+  ck_assert_uint_eq(h->max_cycles, UINT32_MAX);
+  ck_assert_int_eq(h->buckets[0], 1);
+  ck_assert_int_eq(h->buckets[1], 1);
+  ck_assert_int_eq(h->buckets[2], 2);
+  ck_assert_int_eq(h->buckets[10], 1);
+  ck_assert_int_eq(h->buckets[11], 1);
+  ck_assert_int_eq(h->buckets[SPAN_HISTOGRAM_BUCKETS - 1], 1);
+  ck_assert_int_eq(span_histogram(SPAN_DECODER)->count, 0);
+
+  /* Durations are taken across the cycle counter wrapping */
+  span_end(SPAN_DECODER, UINT32_MAX);
+  ck_assert_int_eq(span_histogram(SPAN_DECODER)->count, 1);
+  ck_assert_int_eq(span_histogram(SPAN_DECODER)->buckets[1], 1);
+
+  span_histograms_reset();
+  ck_assert_int_eq(span_histogram(SPAN_PLAN)->count, 0);
+  ck_assert_int_eq(span_histogram(SPAN_PLAN)->buckets[2], 0);
+}
+END_TEST
+
+TCase *setup_spans_tests() {
+  TCase *tc = tcase_create("spans");
+#ifdef SPANS
+  tcase_add_test(tc, check_spans_record);
+#endif
+  tcase_add_test(tc, check_span_histograms);
+  return tc;
+}
+
+#endif
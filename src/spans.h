@@ -0,0 +1,71 @@
+#ifndef SPANS_H
+#define SPANS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+/* Timed sections of the engine loop. Each one's duration in cycles is always
+ * counted into a histogram. When built with SPANS, its start and end cycle
+ * counts are also queued for the console to read out */
+typedef enum {
+  SPAN_DECODER,
+  SPAN_SENSORS,
+  SPAN_BUFFER_SWAP,
+  SPAN_RESCHEDULE,
+  SPAN_TASKS,
+  SPAN_CALCULATIONS,
+  SPAN_SCHEDULE,
+  SPAN_PLAN,
+  NUM_SPANS,
+} span_id;
+
+#define SPAN_HISTOGRAM_BUCKETS 24
+
+/* Bucket n counts the spans of 2^(n-1) up to 2^n cycles, and bucket 0 those
+ * of no cycles. The last bucket also counts any longer */
+struct span_histogram {
+  uint32_t count;
+  uint32_t max_cycles;
+  uint32_t buckets[SPAN_HISTOGRAM_BUCKETS];
+};
+
+extern const char *const span_names[NUM_SPANS];
+
+#ifdef SPANS
+/* Cycle counts are truncated to 32 bits and wrap */
+struct span {
+  span_id id;
+  uint32_t start;
+  uint32_t end;
+};
+
+/* Queues a span, or drops it if its ring is full */
+void span_record(span_id id, uint32_t start, uint32_t end);
+
+/* Dequeues the next recorded span into dest, returning false if there are
+ * none */
+bool span_next(struct span *dest);
+
+/* Total spans dropped since startup */
+uint32_t span_dropped(void);
+#endif
+
+const struct span_histogram *span_histogram(span_id id);
+
+/* Clears every histogram. Spans that end while it runs may be lost */
+void span_histograms_reset(void);
+
+static inline uint32_t span_start(void) {
+  return cycle_count();
+}
+
+void span_end(span_id id, uint32_t start);
+
+#ifdef UNITTEST
+#include <check.h>
+TCase *setup_spans_tests(void);
+#endif
+
+#endif
@@ -1,6 +1,9 @@
+#ifndef SPSC_H
+#define SPSC_H
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 struct spsc_queue {
   _Atomic uint32_t read;
@@ -64,3 +67,5 @@ static inline void spsc_release(struct spsc_queue *q) {
   atomic_store_explicit(
     &q->read, spsc_next_index(q, this_read), memory_order_release);
 }
+
+#endif
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <math.h>
 
 #include "table.h"
 
@@ -83,6 +84,51 @@ float interpolate_table_twoaxis(const struct table_2d *t, float x, float y) {
   return xy;
 }
 
+/* Returns the lower cell index for value, clamped to the axis, and sets frac
+ * to its fractional position towards the next cell */
+static int axis_position(const struct table_axis *axis,
+                         float value,
+                         float *frac) {
+  if (value < axis->values[0]) {
+    value = axis->values[0];
+  }
+  if (value > axis->values[axis->num - 1]) {
+    value = axis->values[axis->num - 1];
+  }
+
+  const int index = axis_find_cell_lower(axis, value);
+  const float x1 = axis->values[index];
+  const float x2 = axis->values[index + 1];
+  *frac = (value - x1) / (x2 - x1);
+  return index;
+}
+
+void table_weights_twoaxis(const struct table_2d *t,
+                           float x,
+                           float y,
+                           struct table_2d_weights *w) {
+  float xfrac;
+  float yfrac;
+  w->col = axis_position(&t->cols, x, &xfrac);
+  w->row = axis_position(&t->rows, y, &yfrac);
+
+  w->weights[0][0] = (1.0f - xfrac) * (1.0f - yfrac);
+  w->weights[0][1] = xfrac * (1.0f - yfrac);
+  w->weights[1][0] = (1.0f - xfrac) * yfrac;
+  w->weights[1][1] = xfrac * yfrac;
+}
+
+int table_axis_nearest(const struct table_axis *axis, float value) {
+  int nearest = 0;
+  for (int i = 1; i < (int)axis->num; i++) {
+    if (fabsf(axis->values[i] - value) <
+        fabsf(axis->values[nearest] - value)) {
+      nearest = i;
+    }
+  }
+  return nearest;
+}
+
 static int table_valid_axis(const struct table_axis *a) {
   if (a->num > MAX_AXIS_SIZE) {
     return 0;
@@ -189,6 +235,32 @@ START_TEST(check_table_twoaxis_interpolate) {
 }
 END_TEST
 
+START_TEST(check_table_twoaxis_weights) {
+  struct table_2d_weights w;
+
+  table_weights_twoaxis(&t2, 7.5, -45, &w);
+  ck_assert_int_eq(w.col, 0);
+  ck_assert_int_eq(w.row, 0);
+  ck_assert_float_eq(w.weights[0][0], 0.25);
+  ck_assert_float_eq(w.weights[0][1], 0.25);
+  ck_assert_float_eq(w.weights[1][0], 0.25);
+  ck_assert_float_eq(w.weights[1][1], 0.25);
+
+  table_weights_twoaxis(&t2, 16, -20, &w);
+  ck_assert_int_eq(w.col, 2);
+  ck_assert_int_eq(w.row, 2);
+  ck_assert_float_eq_tol(w.weights[0][0], 0.0, 0.0001);
+  ck_assert_float_eq_tol(w.weights[1][0], 0.8, 0.0001);
+  ck_assert_float_eq_tol(w.weights[1][1], 0.2, 0.0001);
+
+  /* Clamped outside of the table */
+  table_weights_twoaxis(&t2, 0, -100, &w);
+  ck_assert_int_eq(w.col, 0);
+  ck_assert_int_eq(w.row, 0);
+  ck_assert_float_eq(w.weights[0][0], 1.0);
+}
+END_TEST
+
 START_TEST(check_table_oneaxis_fullsize_clamp) {
   struct table_1d table = {
     .cols = {
@@ -280,6 +352,7 @@ TCase *setup_table_tests() {
   tcase_add_test(table_tests, check_axis_find_cell);
   tcase_add_test(table_tests, check_table_oneaxis_interpolate);
   tcase_add_test(table_tests, check_table_twoaxis_interpolate);
+  tcase_add_test(table_tests, check_table_twoaxis_weights);
   tcase_add_test(table_tests, check_table_oneaxis_fullsize_clamp);
   tcase_add_test(table_tests, check_table_twoaxis_fullsize_clamp);
   return table_tests;
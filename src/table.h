@@ -25,11 +25,27 @@ struct table_2d {
   float data[MAX_AXIS_SIZE][MAX_AXIS_SIZE];
 };
 
+/* Bilinear weights of the four cells surrounding a point in a 2d table.
+ * weights[r][c] applies to data[row + r][col + c] */
+struct table_2d_weights {
+  int row;
+  int col;
+  float weights[2][2];
+};
+
 float interpolate_table_oneaxis(const struct table_1d *, float column);
 float interpolate_table_twoaxis(const struct table_2d *,
                                 float row,
                                 float column);
 
+void table_weights_twoaxis(const struct table_2d *,
+                           float row,
+                           float column,
+                           struct table_2d_weights *);
+
+/* Returns the index of the axis value closest to value */
+int table_axis_nearest(const struct table_axis *, float value);
+
 int table_valid_oneaxis(const struct table_1d *);
 int table_valid_twoaxis(const struct table_2d *);
 
@@ -1,3 +1,5 @@
+#include <math.h>
+
 #include "tasks.h"
 #include "calculations.h"
 #include "config.h"
@@ -32,24 +34,253 @@ static bool determine_fuel_pump_state(struct tasks *state,
   }
 }
 
+/* PID on MAP error from the target table, with the open loop duty as
+ * feed-forward. Only updated once per control period, otherwise the last
+ * duty is held */
+static float boost_closed_loop(const struct boost_control_config *config,
+                               struct boost_state *state,
+                               const struct engine_update *u,
+                               float feed_forward) {
+  timeval_t period = time_from_us(config->period_ms * 1000);
+  if (state->initialized &&
+      (time_diff(u->current_time, state->time) < period)) {
+    return state->duty;
+  }
+
+  float dt = 0.0f;
+  if (state->initialized) {
+    dt = (float)time_diff(u->current_time, state->time) /
+         (float)time_from_us(1000000);
+  }
+  state->initialized = true;
+  state->time = u->current_time;
+
+  float map = u->sensors.MAP.value;
+  state->target = interpolate_table_twoaxis(
+    &config->target_map, u->position.rpm, u->sensors.TPS.value);
+  float error = state->target - map;
+
+  /* Derivative on measurement, so target changes don't kick the valve */
+  float derivative = 0.0f;
+  if (dt > 0.0f) {
+    derivative = -config->kd * (map - state->last_map) / dt;
+  }
+  state->last_map = map;
+
+  /* Anti-windup: don't integrate further into a saturated output */
+  float proportional = config->kp * error;
+  float unclamped = feed_forward + proportional + state->integral + derivative;
+  bool saturated = ((unclamped >= 100.0f) && (error > 0.0f)) ||
+                   ((unclamped <= 0.0f) && (error < 0.0f));
+  if (!saturated) {
+    state->integral += config->ki * error * dt;
+    state->integral = fminf(fmaxf(state->integral, -100.0f), 100.0f);
+  }
+
+  float duty = feed_forward + proportional + state->integral + derivative;
+  state->duty = fminf(fmaxf(duty, 0.0f), 100.0f);
+  return state->duty;
+}
+
+/* Above overboost, duty is ramped down to zero (wastegate open) at overboost
+ * plus overboost_ramp, where boost cut takes over */
+static float overboost_protection(const struct boost_control_config *config,
+                                  float map,
+                                  float duty) {
+  if (map <= config->overboost) {
+    return duty;
+  }
+  if (config->overboost_ramp <= 0.0f) {
+    return 0.0f;
+  }
+  float remaining = 1.0f - ((map - config->overboost) / config->overboost_ramp);
+  return duty * fmaxf(remaining, 0.0f);
+}
+
 static float handle_boost_control(const struct boost_control_config *config,
+                                  struct boost_state *state,
                                   const struct engine_update *u) {
   float duty;
   float map = u->sensors.MAP.value;
   float tps = u->sensors.TPS.value;
+  float feed_forward =
+    interpolate_table_oneaxis(&config->pwm_duty_vs_rpm, u->position.rpm);
+
   if (map < config->enable_threshold_kpa) {
     /* Below the "enable" threshold, keep the valve off */
     duty = 0.0f;
+    *state = (struct boost_state){ 0 };
   } else if (map < config->control_threshold_kpa &&
              tps > config->control_threshold_tps) {
     /* Above "enable", but below "control", and WOT, so keep wastegate at
      * atmostpheric pressure to improve spool time */
     duty = 100.0f;
+    *state = (struct boost_state){ 0 };
+  } else if (config->closed_loop) {
+    duty = boost_closed_loop(config, state, u, feed_forward);
   } else {
     /* We are controlling the wastegate with PWM */
-    duty = interpolate_table_oneaxis(&config->pwm_duty_vs_rpm, u->position.rpm);
+    duty = feed_forward;
+  }
+  return overboost_protection(config, map, duty);
+}
+
+/* Radiator fan. The fan turns on above on_temp and off below off_temp, and
+ * runs at the duty for the current CLT when PWM driven. A faulted CLT sensor
+ * turns the fan on. After the engine stops, the fan keeps running for up to
+ * run_on_ms. CLT changes slowly, so the state is only updated once per
+ * period */
+static void handle_fan_control(const struct fan_control_config *config,
+                               struct fan_state *state,
+                               const struct engine_update *u) {
+  const struct engine_position *d = &u->position;
+  timeval_t run_on = time_from_us(config->run_on_ms * 1000);
+  bool turning =
+    d->has_rpm && time_in_range(u->current_time, d->time, d->valid_until);
+
+  if (turning) {
+    state->engine_last_valid = u->current_time;
+  } else if (!state->initialized ||
+             (time_diff(u->current_time, state->engine_last_valid) >=
+              run_on)) {
+    /* Keep the last valid time just outside of the run on time so that time
+     * rolling over doesn't turn the fan back on */
+    state->engine_last_valid = u->current_time - run_on - time_from_us(1000000);
+  }
+
+  timeval_t period = time_from_us(config->period_ms * 1000);
+  if (state->initialized &&
+      (time_diff(u->current_time, state->time) < period)) {
+    return;
+  }
+  state->initialized = true;
+  state->time = u->current_time;
+
+  const struct sensor_value *clt = &u->sensors.CLT;
+  bool running =
+    turning || (time_diff(u->current_time, state->engine_last_valid) < run_on);
+  if (!running) {
+    state->on = false;
+  } else if (clt->fault != FAULT_NONE) {
+    state->on = true;
+  } else if (clt->value >= config->on_temp) {
+    state->on = true;
+  } else if (clt->value <= config->off_temp) {
+    state->on = false;
+  }
+
+  if (!state->on) {
+    state->duty = 0.0f;
+  } else if (clt->fault != FAULT_NONE) {
+    state->duty = 100.0f;
+  } else {
+    float duty = interpolate_table_oneaxis(&config->duty_vs_clt, clt->value);
+    state->duty = fminf(fmaxf(duty, 0.0f), 100.0f);
+  }
+}
+
+/* Idle speed control. The valve position is the feed-forward duty for the
+ * current CLT plus a PID correction on the error from the target rpm. While
+ * idling, the ignition advance is also trimmed in proportion to the error, as
+ * the engine responds to timing much faster than to air. */
+static void handle_idle_control(const struct idle_control_config *config,
+                                struct idle_state *state,
+                                const struct engine_update *u) {
+  const struct engine_position *pos = &u->position;
+  float clt = u->sensors.CLT.value;
+  float rpm = pos->rpm;
+
+  float dt = 0.0f;
+  if (state->initialized) {
+    dt = (float)time_diff(u->current_time, state->time) /
+         (float)time_from_us(1000000);
   }
-  return duty;
+  state->initialized = true;
+  state->time = u->current_time;
+
+  float target = interpolate_table_oneaxis(&config->target_rpm_vs_clt, clt);
+  float feed_forward = interpolate_table_oneaxis(&config->duty_vs_clt, clt);
+  state->target_rpm = target;
+
+  bool running =
+    pos->has_rpm && engine_position_is_synced(pos, u->current_time);
+  state->active = running && (u->sensors.TPS.value < config->max_tps) &&
+                  (rpm < target + config->activation_rpm);
+
+  if (!state->active) {
+    /* Hold the learned integral so the valve is near the right position when
+     * returning to idle */
+    state->timing_assist = 0.0f;
+    state->last_rpm = rpm;
+    state->duty = fminf(fmaxf(feed_forward + state->integral, config->min_duty),
+                        config->max_duty);
+    return;
+  }
+
+  float error = target - rpm;
+
+  /* Integrate only within the duty limits to avoid windup */
+  state->integral += config->ki * error * dt;
+  state->integral = fminf(fmaxf(state->integral,
+                                config->min_duty - feed_forward),
+                          config->max_duty - feed_forward);
+
+  /* Derivative on measurement, so target changes don't kick the valve */
+  float derivative = 0.0f;
+  if (dt > 0.0f) {
+    derivative = -config->kd * (rpm - state->last_rpm) / dt;
+  }
+  state->last_rpm = rpm;
+
+  float duty =
+    feed_forward + (config->kp * error) + state->integral + derivative;
+  state->duty = fminf(fmaxf(duty, config->min_duty), config->max_duty);
+
+  state->timing_assist =
+    fminf(fmaxf(config->timing_kp * error, -config->max_timing_assist),
+          config->max_timing_assist);
+}
+
+/* Drives a stepper idle valve towards the commanded position, one step per
+ * call at most, within the configured step rate. The valve is first driven
+ * fully closed to find its position. Both pins are written on every call, as
+ * the platform may alternate between plans that each keep their own outputs.
+ * A direction change is output one call before the next step edge. */
+static void handle_idle_stepper(const struct idle_control_config *config,
+                                struct idle_state *state,
+                                timeval_t now,
+                                struct platform_plan *plan) {
+  uint32_t target = state->duty / 100.0f * config->stepper_steps;
+  if (!state->stepper_homed) {
+    if (state->stepper_position == 0) {
+      state->stepper_position = config->stepper_steps;
+    }
+    target = 0;
+  }
+
+  bool step = false;
+  if (state->step_high) {
+    /* Complete the previous step pulse */
+    state->step_high = false;
+  } else if (state->stepper_position != target) {
+    bool opening = target > state->stepper_position;
+    if (opening != state->stepper_opening) {
+      state->stepper_opening = opening;
+    } else if ((config->stepper_rate > 0) &&
+               (time_diff(now, state->last_step) >=
+                time_from_us(1000000 / config->stepper_rate))) {
+      step = true;
+      state->step_high = true;
+      state->last_step = now;
+      state->stepper_position += opening ? 1 : -1;
+      if (state->stepper_position == 0) {
+        state->stepper_homed = true;
+      }
+    }
+  }
+
+  plan_set_gpio(plan, config->dir_pin, state->stepper_opening);
+  plan_set_gpio(plan, config->pin, step);
 }
 
 /* Checks for a variety of failure conditions, and produces a check engine
@@ -123,21 +354,104 @@ static bool handle_check_engine_light(const struct cel_config *config,
     state->cel_state, u->current_time, state->cel_time);
 }
 
+static void run_fuel_pump_task(struct viaems *viaems,
+                               const struct engine_update *update) {
+  viaems->tasks.fuelpump_on = determine_fuel_pump_state(&viaems->tasks, update);
+}
+
+static void run_cel_task(struct viaems *viaems,
+                         const struct engine_update *update) {
+  viaems->tasks.cel_on =
+    handle_check_engine_light(&viaems->config->cel, &viaems->tasks, update);
+}
+
+static void run_boost_task(struct viaems *viaems,
+                           const struct engine_update *update) {
+  viaems->tasks.boost_duty = handle_boost_control(
+    &viaems->config->boost_control, &viaems->tasks.boost, update);
+}
+
+static void run_idle_task(struct viaems *viaems,
+                          const struct engine_update *update) {
+  if (viaems->config->idle_control.enabled) {
+    handle_idle_control(
+      &viaems->config->idle_control, &viaems->tasks.idle, update);
+  } else {
+    viaems->tasks.idle = (struct idle_state){ 0 };
+  }
+}
+
+static void run_fan_task(struct viaems *viaems,
+                         const struct engine_update *update) {
+  if (viaems->config->fan_control.enabled) {
+    handle_fan_control(
+      &viaems->config->fan_control, &viaems->tasks.fan, update);
+  } else {
+    viaems->tasks.fan = (struct fan_state){ 0 };
+  }
+}
+
+/* Periods are in reschedules (nominally 200 uS). Phases are chosen so that no
+ * two tasks run in the same reschedule */
+const struct task task_table[NUM_TASKS] = {
+  [TASK_FUEL_PUMP] = { "fuel-pump", 50, 0, run_fuel_pump_task },
+  [TASK_BOOST] = { "boost", 10, 1, run_boost_task },
+  [TASK_IDLE] = { "idle", 50, 13, run_idle_task },
+  [TASK_CEL] = { "cel", 50, 25, run_cel_task },
+  [TASK_FAN] = { "fan", 50, 37, run_fan_task },
+};
+
+/* Runs any tasks that are due, then applies every task's last outputs to the
+ * plan. The platform may alternate between several plans, each keeping only
+ * the outputs last written to it, so every output is written each time */
 void run_tasks(struct viaems *viaems,
                const struct engine_update *update,
                struct platform_plan *plan) {
-  plan_set_gpio(plan,
-                viaems->config->fueling.fuel_pump_pin,
-                determine_fuel_pump_state(&viaems->tasks, update));
-
-  plan_set_gpio(
-    plan,
-    viaems->config->cel.pin,
-    handle_check_engine_light(&viaems->config->cel, &viaems->tasks, update));
-
-  plan_set_pwm(plan,
-               viaems->config->boost_control.pin,
-               handle_boost_control(&viaems->config->boost_control, update));
+  struct tasks *tasks = &viaems->tasks;
+
+  for (int i = 0; i < NUM_TASKS; i++) {
+    const struct task *task = &task_table[i];
+    if ((tasks->tick % task->period) != task->phase) {
+      continue;
+    }
+
+    uint64_t start = cycle_count();
+    task->run(viaems, update);
+    uint32_t cycles = cycle_count() - start;
+
+    struct task_stats *stats = &tasks->stats[i];
+    stats->runs++;
+    stats->last_cycles = cycles;
+    if (cycles > stats->max_cycles) {
+      stats->max_cycles = cycles;
+    }
+  }
+  tasks->tick++;
+
+  const struct config *config = viaems->config;
+  plan_set_gpio(plan, config->fueling.fuel_pump_pin, tasks->fuelpump_on);
+  plan_set_gpio(plan, config->cel.pin, tasks->cel_on);
+  plan_set_pwm(plan, config->boost_control.pin, tasks->boost_duty);
+
+  const struct fan_control_config *fan = &config->fan_control;
+  if (fan->enabled) {
+    if (fan->output == FAN_OUTPUT_PWM) {
+      plan_set_pwm(plan, fan->pin, tasks->fan.duty);
+    } else {
+      plan_set_gpio(plan, fan->pin, tasks->fan.on);
+    }
+  }
+
+  /* Each step pulse spans two reschedules, so the stepper is driven on
+   * every reschedule rather than on the rate divided tick */
+  const struct idle_control_config *idle = &config->idle_control;
+  if (idle->enabled) {
+    if (idle->valve == IDLE_VALVE_STEPPER) {
+      handle_idle_stepper(idle, &tasks->idle, update->current_time, plan);
+    } else {
+      plan_set_pwm(plan, idle->pin, tasks->idle.duty);
+    }
+  }
 }
 
 #ifdef UNITTEST
@@ -256,11 +570,350 @@ START_TEST(check_tasks_cel_pin_state) {
 }
 END_TEST
 
+/* First order turbo plant for the boost tests: MAP follows the wastegate duty
+ * with a lag, and gain is kPa of boost per % duty */
+static float run_boost_plant(const struct boost_control_config *config,
+                             struct boost_state *state,
+                             timeval_t *time,
+                             float *map,
+                             float gain,
+                             int ms) {
+  float max_map = *map;
+  for (int i = 0; i < ms; i++) {
+    *time += time_from_us(1000);
+    struct engine_update update = {
+      .current_time = *time,
+      .position = { .rpm = 4000 },
+      .sensors = { .MAP = { .value = *map }, .TPS = { .value = 100 } },
+    };
+    float duty = handle_boost_control(config, state, &update);
+    float steady_map = 100.0f + (gain * duty);
+    *map += (steady_map - *map) * 0.001f / 0.3f;
+    max_map = fmaxf(max_map, *map);
+  }
+  return max_map;
+}
+
+START_TEST(check_tasks_boost_control) {
+  struct boost_control_config config = default_config.boost_control;
+  config.closed_loop = true;
+  struct boost_state state = { 0 };
+  timeval_t time = 0;
+  float map = 100;
+
+  /* Feed-forward of 50% overshoots the 200 kPa target with this turbo */
+  run_boost_plant(&config, &state, &time, &map, 2.5f, 5000);
+  ck_assert_float_eq_tol(state.target, 200, 0.01);
+  ck_assert_float_eq_tol(map, 200, 2);
+  ck_assert_float_eq_tol(state.duty, 40, 1);
+
+  /* Loop only runs once per period */
+  struct engine_update update = {
+    .current_time = state.time + time_from_us(1000),
+    .position = { .rpm = 4000 },
+    .sensors = { .MAP = { .value = 150 }, .TPS = { .value = 100 } },
+  };
+  float duty = state.duty;
+  ck_assert_float_eq(handle_boost_control(&config, &state, &update), duty);
+  update.current_time = state.time + time_from_us(20000);
+  ck_assert_float_gt(handle_boost_control(&config, &state, &update), duty);
+}
+END_TEST
+
+START_TEST(check_tasks_boost_control_windup) {
+  struct boost_control_config config = default_config.boost_control;
+  config.closed_loop = true;
+  struct boost_state state = { 0 };
+  timeval_t time = 0;
+  float map = 100;
+
+  /* Turbo can't reach target, so the output saturates without the integral
+   * winding up */
+  run_boost_plant(&config, &state, &time, &map, 0.8f, 5000);
+  ck_assert_float_eq(state.duty, 100);
+  ck_assert_float_lt(state.integral, 50.1);
+
+  /* Once the turbo can make boost, the overshoot is limited */
+  float max_map = run_boost_plant(&config, &state, &time, &map, 2.5f, 5000);
+  ck_assert_float_lt(max_map, 240);
+  ck_assert_float_eq_tol(map, 200, 2);
+}
+END_TEST
+
+START_TEST(check_tasks_overboost_ramp) {
+  struct boost_control_config config = default_config.boost_control;
+  struct boost_state state = { 0 };
+  struct engine_update update = {
+    .position = { .rpm = 4000 },
+    .sensors = { .MAP = { .value = 250 }, .TPS = { .value = 100 } },
+  };
+
+  ck_assert_float_eq(handle_boost_control(&config, &state, &update), 50);
+
+  /* Halfway up the ramp, duty is halved */
+  update.sensors.MAP.value = 270;
+  ck_assert_float_eq_tol(
+    handle_boost_control(&config, &state, &update), 25, 0.01);
+
+  update.sensors.MAP.value = 285;
+  ck_assert_float_eq(handle_boost_control(&config, &state, &update), 0);
+}
+END_TEST
+
+START_TEST(check_tasks_run_tasks_rate_divided) {
+  static struct viaems viaems = { .config = &default_config };
+  struct engine_update update = {
+    .position = { .valid_until = -1, .has_position = true, .has_rpm = true },
+  };
+
+  /* At most one task runs per reschedule */
+  for (int i = 0; i < 500; i++) {
+    uint32_t runs_before = 0;
+    for (int t = 0; t < NUM_TASKS; t++) {
+      runs_before += viaems.tasks.stats[t].runs;
+    }
+
+    struct platform_plan plan = { 0 };
+    update.current_time = time_from_us(200 * i);
+    run_tasks(&viaems, &update, &plan);
+
+    uint32_t runs_after = 0;
+    for (int t = 0; t < NUM_TASKS; t++) {
+      runs_after += viaems.tasks.stats[t].runs;
+    }
+    ck_assert_int_le(runs_after - runs_before, 1);
+
+    /* Outputs are applied whether or not the task ran */
+    ck_assert(plan.gpio & (1 << default_config.fueling.fuel_pump_pin));
+    ck_assert_float_eq(plan.pwm[default_config.boost_control.pin], 0.0f);
+  }
+
+  for (int t = 0; t < NUM_TASKS; t++) {
+    ck_assert_int_eq(viaems.tasks.stats[t].runs, 500 / task_table[t].period);
+    ck_assert_int_ge(viaems.tasks.stats[t].max_cycles,
+                     viaems.tasks.stats[t].last_cycles);
+  }
+}
+END_TEST
+
+static struct engine_update fan_update(timeval_t time,
+                                       float clt,
+                                       bool turning) {
+  return (struct engine_update){
+    .current_time = time,
+    .position = { .time = time,
+                  .valid_until = time + time_from_us(1000),
+                  .has_position = turning,
+                  .has_rpm = turning,
+                  .rpm = 800 },
+    .sensors = { .CLT = { .value = clt } },
+  };
+}
+
+START_TEST(check_tasks_fan_control) {
+  struct fan_control_config config = default_config.fan_control;
+  struct fan_state state = { 0 };
+  timeval_t time = time_from_us(1000);
+  struct engine_update update;
+
+  /* Not turned on without the engine running */
+  update = fan_update(time, 100, false);
+  handle_fan_control(&config, &state, &update);
+  ck_assert(!state.on);
+
+  /* Hysteresis between off_temp and on_temp */
+  const float temps[] = { 92, 96, 92, 89, 93 };
+  const bool on[] = { false, true, true, false, false };
+  for (int i = 0; i < 5; i++) {
+    time += time_from_us(250000);
+    update = fan_update(time, temps[i], true);
+    handle_fan_control(&config, &state, &update);
+    ck_assert(state.on == on[i]);
+    if (i == 1) {
+      ck_assert_float_eq_tol(state.duty, 64, 0.01);
+    }
+  }
+  ck_assert_float_eq(state.duty, 0);
+
+  /* Only updated once per period */
+  update = fan_update(time + time_from_us(100000), 100, true);
+  handle_fan_control(&config, &state, &update);
+  ck_assert(!state.on);
+
+  /* A faulted sensor runs the fan at full duty */
+  time += time_from_us(250000);
+  update = fan_update(time, 0, true);
+  update.sensors.CLT.fault = FAULT_RANGE;
+  handle_fan_control(&config, &state, &update);
+  ck_assert(state.on);
+  ck_assert_float_eq(state.duty, 100);
+
+  /* Runs on after the engine stops, until run_on_ms has passed */
+  timeval_t stopped = time;
+  for (time += time_from_us(250000);
+       time_diff(time, stopped) < time_from_us(59000000);
+       time += time_from_us(250000)) {
+    update = fan_update(time, 100, false);
+    handle_fan_control(&config, &state, &update);
+    ck_assert(state.on);
+    ck_assert_float_eq(state.duty, 80);
+  }
+  time = stopped + time_from_us(60000000);
+  update = fan_update(time, 100, false);
+  handle_fan_control(&config, &state, &update);
+  ck_assert(!state.on);
+
+  /* and stays off */
+  time += time_from_us(600000000);
+  update = fan_update(time, 100, false);
+  handle_fan_control(&config, &state, &update);
+  ck_assert(!state.on);
+}
+END_TEST
+
+/* Engine speed plant for the idle tests. Air follows the valve with a lag,
+ * timing acts immediately, and the engine speed lags the torque balance */
+struct idle_plant {
+  timeval_t time;
+  float rpm;
+  float air;
+  float load; /* rpm lost to load at steady state */
+};
+
+static struct engine_update idle_plant_update(const struct idle_plant *plant,
+                                              float tps) {
+  return (struct engine_update){
+    .current_time = plant->time,
+    .position = { .time = plant->time,
+                  .valid_until = plant->time + time_from_us(1000),
+                  .has_position = true,
+                  .has_rpm = true,
+                  .rpm = plant->rpm },
+    .sensors = { .CLT = { .value = 80 }, .TPS = { .value = tps } },
+  };
+}
+
+/* Runs the plant and idle control for ms, returns the lowest rpm seen */
+static float run_idle_plant(const struct idle_control_config *config,
+                            struct idle_state *state,
+                            struct idle_plant *plant,
+                            int ms) {
+  const float dt = 0.01f;
+  float min_rpm = plant->rpm;
+  for (int i = 0; i < ms / 10; i++) {
+    plant->time += time_from_us(10000);
+    struct engine_update update = idle_plant_update(plant, 0.0f);
+    handle_idle_control(config, state, &update);
+
+    plant->air += (state->duty - plant->air) * dt / 0.5f;
+    float steady_rpm = (25.0f * plant->air) + 100.0f +
+                       (20.0f * state->timing_assist) - plant->load;
+    plant->rpm += (steady_rpm - plant->rpm) * dt / 0.2f;
+    min_rpm = fminf(min_rpm, plant->rpm);
+  }
+  return min_rpm;
+}
+
+START_TEST(check_tasks_idle_control) {
+  struct idle_control_config config = default_config.idle_control;
+  struct idle_state state = { 0 };
+
+  /* Feed-forward alone settles at 800 rpm, below the 850 target */
+  struct idle_plant plant = { .rpm = 1200, .air = 28 };
+  run_idle_plant(&config, &state, &plant, 10000);
+  ck_assert(state.active);
+  ck_assert_float_eq_tol(plant.rpm, 850, 5);
+  ck_assert_float_gt(state.duty, 28);
+  ck_assert_float_eq_tol(state.timing_assist, 0, 0.2);
+
+  /* A load step is recovered by the valve */
+  struct idle_state settled = state;
+  struct idle_plant settled_plant = plant;
+  plant.load = 150;
+  float assisted_dip = run_idle_plant(&config, &state, &plant, 10000);
+  ck_assert_float_eq_tol(plant.rpm, 850, 5);
+
+  /* and the timing assist reduces the dip */
+  config.timing_kp = 0.0f;
+  state = settled;
+  plant = settled_plant;
+  plant.load = 150;
+  float unassisted_dip = run_idle_plant(&config, &state, &plant, 10000);
+  ck_assert_float_eq_tol(plant.rpm, 850, 5);
+  ck_assert_float_gt(assisted_dip, unassisted_dip + 20);
+
+  /* Off idle, the valve holds position without timing assist */
+  float duty = state.duty;
+  plant.time += time_from_us(10000);
+  struct engine_update update = idle_plant_update(&plant, 20.0f);
+  update.position.rpm = 2500;
+  handle_idle_control(&config, &state, &update);
+  ck_assert(!state.active);
+  ck_assert_float_eq_tol(state.duty, duty, 1.0);
+  ck_assert_float_eq(state.timing_assist, 0.0f);
+}
+END_TEST
+
+START_TEST(check_tasks_idle_stepper) {
+  struct idle_control_config config = default_config.idle_control;
+  config.valve = IDLE_VALVE_STEPPER;
+  config.stepper_steps = 20;
+  config.stepper_rate = 1000;
+
+  struct idle_state state = { .duty = 50 };
+  timeval_t time = 0;
+  int pulses = 0;
+
+  /* Plans are alternated like the platform's output buffers, and start with
+   * stale outputs that must be overwritten */
+  struct platform_plan plans[2] = {
+    { .gpio = 0xffffffff },
+    { .gpio = 0xffffffff },
+  };
+  bool last_dir = true;
+
+  /* Homes by closing fully, then opens to the commanded position */
+  for (int i = 0; i < 200; i++) {
+    struct platform_plan *plan = &plans[i % 2];
+    time += time_from_us(500);
+    bool was_high = state.step_high;
+    handle_idle_stepper(&config, &state, time, plan);
+
+    bool step = plan->gpio & (1 << config.pin);
+    bool dir = plan->gpio & (1 << config.dir_pin);
+    ck_assert(dir == state.stepper_opening);
+    ck_assert(step == (!was_high && state.step_high));
+    if (step) {
+      /* Direction was already output on the previous reschedule */
+      ck_assert(dir == last_dir);
+      pulses++;
+    }
+    last_dir = dir;
+
+    if (pulses == 20) {
+      ck_assert(state.stepper_homed);
+      ck_assert_int_eq(state.stepper_position, 0);
+    }
+  }
+  ck_assert_int_eq(pulses, 30);
+  ck_assert_int_eq(state.stepper_position, 10);
+  ck_assert(state.stepper_opening);
+  ck_assert(!(plans[0].gpio & plans[1].gpio & (1 << config.pin)));
+}
+END_TEST
+
 TCase *setup_tasks_tests() {
   TCase *tasks_tests = tcase_create("tasks");
   tcase_add_test(tasks_tests, check_tasks_handle_fuel_pump);
   tcase_add_test(tasks_tests, check_tasks_next_cel_state);
   tcase_add_test(tasks_tests, check_tasks_cel_pin_state);
+  tcase_add_test(tasks_tests, check_tasks_boost_control);
+  tcase_add_test(tasks_tests, check_tasks_boost_control_windup);
+  tcase_add_test(tasks_tests, check_tasks_overboost_ramp);
+  tcase_add_test(tasks_tests, check_tasks_run_tasks_rate_divided);
+  tcase_add_test(tasks_tests, check_tasks_fan_control);
+  tcase_add_test(tasks_tests, check_tasks_idle_control);
+  tcase_add_test(tasks_tests, check_tasks_idle_stepper);
   return tasks_tests;
 }
 
@@ -1,18 +1,70 @@
 #ifndef TASKS_H
 #define TASKS_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "platform.h"
 #include "table.h"
 
 struct boost_control_config {
-  struct table_1d pwm_duty_vs_rpm;
+  struct table_1d pwm_duty_vs_rpm; /* Open loop duty, or closed loop
+                                      feed-forward */
   float enable_threshold_kpa;
   float control_threshold_kpa;
   float control_threshold_tps;
   uint32_t pin;
-  float overboost;
+  float overboost;      /* MAP at which duty starts ramping down */
+  float overboost_ramp; /* kPa over overboost to reach zero duty and cut */
+
+  /* Closed loop control of MAP to the target table */
+  bool closed_loop;
+  struct table_2d target_map; /* RPM/TPS vs target MAP (kPa) */
+  float kp;                   /* Duty % per kPa of error */
+  float ki;                   /* Duty % per kPa of error per second */
+  float kd;                   /* Duty % per kPa/s of MAP change */
+  uint32_t period_ms;         /* Control loop period */
+};
+
+typedef enum {
+  IDLE_VALVE_PWM,
+  IDLE_VALVE_STEPPER,
+} idle_valve_type;
+
+struct idle_control_config {
+  bool enabled;
+  idle_valve_type valve;
+  uint32_t pin;            /* PWM output, or stepper step GPIO */
+  uint32_t dir_pin;        /* Stepper direction GPIO, high opens */
+  uint32_t stepper_steps;  /* Stepper steps from closed to fully open */
+  uint32_t stepper_rate;   /* Maximum stepper steps per second */
+  struct table_1d target_rpm_vs_clt;
+  struct table_1d duty_vs_clt; /* Feed-forward valve position */
+  float kp;                /* Duty % per rpm of error */
+  float ki;                /* Duty % per rpm of error per second */
+  float kd;                /* Duty % per rpm/s of rpm change */
+  float min_duty;
+  float max_duty;
+  float max_tps;           /* Idle control is active below this TPS */
+  float activation_rpm;    /* and below this many rpm above target */
+  float timing_kp;         /* Degrees of advance per rpm of error */
+  float max_timing_assist; /* Limit of timing advance or retard */
+};
+
+typedef enum {
+  FAN_OUTPUT_GPIO,
+  FAN_OUTPUT_PWM,
+} fan_output_type;
+
+struct fan_control_config {
+  bool enabled;
+  fan_output_type output;
+  uint32_t pin;      /* GPIO, or PWM output */
+  float on_temp;     /* CLT to turn the fan on */
+  float off_temp;    /* CLT to turn the fan off */
+  struct table_1d duty_vs_clt; /* PWM duty while on */
+  uint32_t run_on_ms; /* Time the fan may keep running after engine stop */
+  uint32_t period_ms; /* Fan state update period */
 };
 
 struct cel_config {
@@ -29,19 +81,87 @@ typedef enum {
   CEL_FASTBLINK,
 } cel_state_t;
 
+typedef enum {
+  TASK_FUEL_PUMP,
+  TASK_BOOST,
+  TASK_IDLE,
+  TASK_CEL,
+  TASK_FAN,
+  NUM_TASKS,
+} task_id;
+
+struct viaems;
+struct engine_update;
+struct platform_plan;
+
+/* Entry in the task table. A task runs on reschedules where the reschedule
+ * count modulo period equals phase */
+struct task {
+  const char *name;
+  uint32_t period; /* Reschedules between runs */
+  uint32_t phase;
+  void (*run)(struct viaems *viaems, const struct engine_update *update);
+};
+
+extern const struct task task_table[NUM_TASKS];
+
+struct task_stats {
+  uint32_t runs;
+  uint32_t last_cycles;
+  uint32_t max_cycles; /* Worst case execution time */
+};
+
 struct tasks {
+  uint32_t tick; /* Reschedule count */
+  struct task_stats stats[NUM_TASKS];
+
+  /* Last outputs of the tasks, applied to the plan on every reschedule */
+  bool fuelpump_on;
+  bool cel_on;
+  float boost_duty;
+
   timeval_t fuelpump_last_valid;
 
+  struct boost_state {
+    bool initialized;
+    timeval_t time; /* Time of the last control loop update */
+    float target;
+    float integral;
+    float last_map;
+    float duty;
+  } boost;
+
+  struct fan_state {
+    bool initialized;
+    bool on;
+    float duty;
+    timeval_t time;              /* Time of the last fan update */
+    timeval_t engine_last_valid; /* Last time the engine was turning */
+  } fan;
+
   cel_state_t cel_state;
   timeval_t cel_time;
+
+  struct idle_state {
+    bool initialized;
+    bool active;
+    timeval_t time;
+    float target_rpm;
+    float last_rpm;
+    float integral;
+    float duty;          /* Commanded valve position (%) */
+    float timing_assist; /* Degrees of advance added while idling */
+
+    bool stepper_homed;
+    bool step_high;
+    bool stepper_opening; /* Direction pin output */
+    uint32_t stepper_position;
+    timeval_t last_step;
+  } idle;
 };
 
 void handle_emergency_shutdown(void);
 
-struct viaems;
-struct engine_update;
-struct platform_plan;
-
 void run_tasks(struct viaems *viaems,
                const struct engine_update *update,
                struct platform_plan *plan);
@@ -0,0 +1,337 @@
+#include <math.h>
+
+#include "calculations.h"
+#include "config.h"
+#include "spsc.h"
+#include "ve_learn.h"
+#include "viaems.h"
+
+#define VE_LEARN_QUEUE_SIZE 16
+
+static struct spsc_queue ve_learn_queue = {
+  .size = VE_LEARN_QUEUE_SIZE,
+};
+static struct ve_learn_point ve_learn_points[VE_LEARN_QUEUE_SIZE];
+
+void ve_learn_sample(const struct ve_learn_config *config,
+                     struct ve_learn *state,
+                     const struct engine_update *update,
+                     const struct calculated_values *calcs) {
+  if (!config->enabled) {
+    state->passes = 0;
+    return;
+  }
+
+  state->passes++;
+  if (state->passes < config->decimation) {
+    return;
+  }
+  state->passes = 0;
+
+  /* Only learn at steady state without any enrichments or cuts, as the EGO
+   * reading lags the operating point */
+  const struct sensor_values *sensors = &update->sensors;
+  bool steady = (update->position.rpm >= config->min_rpm) &&
+                (sensors->CLT.value >= config->min_clt) &&
+                (sensors->EGO.fault == FAULT_NONE) &&
+                (fabsf(sensors->TPS.derivative) <= config->max_tps_rate) &&
+                (calcs->tipin == 0.0f) && (calcs->lambda > 0.0f) &&
+                !calculated_values_has_cuts(calcs);
+  if (!steady) {
+    return;
+  }
+
+  int idx = spsc_allocate(&ve_learn_queue);
+  if (idx < 0) {
+    state->dropped++;
+    return;
+  }
+
+  ve_learn_points[idx] = (struct ve_learn_point){
+    .rpm = update->position.rpm,
+    .map = sensors->MAP.value,
+    .ve = calcs->ve * (1.0f + (calcs->lambda_ltt / 100.0f)) *
+          (1.0f + (calcs->lambda_stt / 100.0f)),
+    .lambda = calcs->lambda,
+    .ego = sensors->EGO.value,
+  };
+  spsc_push(&ve_learn_queue);
+}
+
+static bool axes_match(const struct table_axis *a, const struct table_axis *b) {
+  if (a->num != b->num) {
+    return false;
+  }
+  for (uint32_t i = 0; i < a->num; i++) {
+    if (a->values[i] != b->values[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool ve_learn_matches(const struct config *config,
+                             const struct ve_learn *state) {
+  return state->initialized && axes_match(&state->table.cols, &config->ve.cols) &&
+         axes_match(&state->table.rows, &config->ve.rows);
+}
+
+/* The fuel delivered scales with the VE fueled with, so the VE that would
+ * have met the commanded lambda is ve * ego / lambda. The error from the
+ * learned table is distributed over the four surrounding cells by their
+ * bilinear weights. */
+static void ve_learn_point(const struct ve_learn_config *config,
+                           struct ve_learn *state,
+                           const struct ve_learn_point *p) {
+  struct table_2d *t = &state->table;
+  float target = p->ve * p->ego / p->lambda;
+  float error = target - interpolate_table_twoaxis(t, p->rpm, p->map);
+
+  struct table_2d_weights w;
+  table_weights_twoaxis(t, p->rpm, p->map, &w);
+
+  for (int r = 0; r < 2; r++) {
+    for (int c = 0; c < 2; c++) {
+      float weight = w.weights[r][c];
+      if (weight <= 0.0f) {
+        continue;
+      }
+      int row = w.row + r;
+      int col = w.col + c;
+      t->data[row][col] += config->rate * weight * error;
+      state->hits[row][col]++;
+      if (config->confidence_samples > 0.0f) {
+        state->confidence[row][col] += weight *
+                                       (1.0f - state->confidence[row][col]) /
+                                       config->confidence_samples;
+      }
+    }
+  }
+  state->samples++;
+}
+
+void ve_learn_process(const struct config *config, struct ve_learn *state) {
+  /* Learning restarts if the ve table's axes change */
+  if (!ve_learn_matches(config, state)) {
+    state->table = config->ve;
+    for (int row = 0; row < MAX_AXIS_SIZE; row++) {
+      for (int col = 0; col < MAX_AXIS_SIZE; col++) {
+        state->hits[row][col] = 0;
+        state->confidence[row][col] = 0.0f;
+      }
+    }
+    state->samples = 0;
+    state->initialized = true;
+  }
+
+  int idx;
+  while ((idx = spsc_next(&ve_learn_queue)) >= 0) {
+    struct ve_learn_point p = ve_learn_points[idx];
+    spsc_release(&ve_learn_queue);
+    ve_learn_point(&config->ve_learn, state, &p);
+  }
+}
+
+static bool ve_learn_confident(const struct config *config,
+                               const struct ve_learn *state,
+                               int row,
+                               int col) {
+  return state->confidence[row][col] >= config->ve_learn.min_confidence;
+}
+
+/* The learned VE includes the long term trim it was fueled with, so trim
+ * cells whose nearest ve cell is committed are cleared to not apply it
+ * twice */
+static void ve_learn_clear_ltt(struct config *config,
+                               const struct ve_learn *state) {
+  struct table_2d *ltt = &config->lambda_ltt;
+  if (!table_valid_twoaxis(ltt)) {
+    return;
+  }
+  for (uint32_t row = 0; row < ltt->rows.num; row++) {
+    int ve_row = table_axis_nearest(&config->ve.rows, ltt->rows.values[row]);
+    for (uint32_t col = 0; col < ltt->cols.num; col++) {
+      int ve_col = table_axis_nearest(&config->ve.cols, ltt->cols.values[col]);
+      if (ve_learn_confident(config, state, ve_row, ve_col)) {
+        ltt->data[row][col] = 0.0f;
+      }
+    }
+  }
+}
+
+uint32_t ve_learn_commit(struct config *config, struct ve_learn *state) {
+  if (!ve_learn_matches(config, state)) {
+    return 0;
+  }
+
+  uint32_t committed = 0;
+  for (uint32_t row = 0; row < config->ve.rows.num; row++) {
+    for (uint32_t col = 0; col < config->ve.cols.num; col++) {
+      if (ve_learn_confident(config, state, row, col)) {
+        config->ve.data[row][col] = state->table.data[row][col];
+        committed++;
+      }
+    }
+  }
+  ve_learn_clear_ltt(config, state);
+  return committed;
+}
+
+void ve_learn_reset(struct ve_learn *state) {
+  state->initialized = false;
+}
+
+#ifdef UNITTEST
+#include <check.h>
+
+/* Queues one operating point at 90 C, with EGO reading lean by factor */
+static void sample_point(const struct config *config,
+                         struct ve_learn *state,
+                         float rpm,
+                         float map,
+                         float factor) {
+  struct calculated_values calcs = {
+    .ve = interpolate_table_twoaxis(&config->ve, rpm, map),
+    .lambda = interpolate_table_twoaxis(&config->commanded_lambda, rpm, map),
+  };
+  struct engine_update update = {
+    .position = { .rpm = rpm },
+    .sensors = {
+      .MAP = { .value = map },
+      .CLT = { .value = 90 },
+      .EGO = { .value = calcs.lambda * factor },
+    },
+  };
+  ve_learn_sample(&config->ve_learn, state, &update, &calcs);
+}
+
+static void drain_ve_learn_queue(void) {
+  while (spsc_next(&ve_learn_queue) >= 0) {
+    spsc_release(&ve_learn_queue);
+  }
+}
+
+START_TEST(check_ve_learn_distribution) {
+  struct config config = default_config;
+  config.ve_learn.enabled = true;
+  config.ve_learn.decimation = 1;
+  struct ve_learn state = { 0 };
+  drain_ve_learn_queue();
+  ve_learn_process(&config, &state);
+
+  /* Midway between 900/1200 rpm and 40/50 kPa, each cell gets a quarter */
+  float ve = interpolate_table_twoaxis(&config.ve, 1050, 45);
+  sample_point(&config, &state, 1050, 45, 1.1f);
+  ve_learn_process(&config, &state);
+  ck_assert_int_eq(state.samples, 1);
+
+  float step = config.ve_learn.rate * 0.25f * (0.1f * ve);
+  for (int row = 2; row < 4; row++) {
+    for (int col = 2; col < 4; col++) {
+      ck_assert_float_eq_tol(
+        state.table.data[row][col], config.ve.data[row][col] + step, 0.0001);
+      ck_assert_int_eq(state.hits[row][col], 1);
+      ck_assert_float_eq_tol(state.confidence[row][col],
+                             0.25f / config.ve_learn.confidence_samples,
+                             0.0001);
+    }
+  }
+  ck_assert_int_eq(state.hits[1][2], 0);
+  ck_assert_int_eq(state.hits[2][4], 0);
+
+  /* On a cell, only that cell learns */
+  sample_point(&config, &state, 3000, 80, 1.1f);
+  ve_learn_process(&config, &state);
+  ck_assert_int_eq(state.hits[6][7], 1);
+  ck_assert_int_eq(state.hits[6][8], 0);
+  ck_assert_int_eq(state.hits[7][7], 0);
+}
+END_TEST
+
+START_TEST(check_ve_learn_converges_and_commits) {
+  struct config config = default_config;
+  config.ve_learn.enabled = true;
+  config.ve_learn.decimation = 1;
+  struct ve_learn state = { 0 };
+  drain_ve_learn_queue();
+
+  float ve = interpolate_table_twoaxis(&config.ve, 1050, 45);
+  for (int i = 0; i < 1000; i++) {
+    sample_point(&config, &state, 1050, 45, 1.1f);
+    ve_learn_process(&config, &state);
+  }
+  ck_assert_float_eq_tol(
+    interpolate_table_twoaxis(&state.table, 1050, 45), ve * 1.1f, 0.05);
+  ck_assert_float_gt(state.confidence[2][2], 0.9f);
+
+  /* Only confident cells are committed, clearing their long term trim */
+  state.confidence[2][2] = 0.0f;
+  float unlearned = config.ve.data[2][2];
+  config.lambda_ltt.data[2][2] = 5.0f;
+  config.lambda_ltt.data[3][3] = 5.0f;
+  ck_assert_int_eq(ve_learn_commit(&config, &state), 3);
+  ck_assert_float_eq(config.ve.data[2][2], unlearned);
+  ck_assert_float_eq(config.ve.data[3][3], state.table.data[3][3]);
+  ck_assert_float_eq(config.lambda_ltt.data[2][2], 5.0f);
+  ck_assert_float_eq(config.lambda_ltt.data[3][3], 0.0f);
+
+  /* Changing the table axes restarts learning */
+  config.ve.cols.values[15] = 7500;
+  ck_assert_int_eq(ve_learn_commit(&config, &state), 0);
+  ve_learn_process(&config, &state);
+  ck_assert_int_eq(state.samples, 0);
+  ck_assert_int_eq(state.hits[3][3], 0);
+}
+END_TEST
+
+START_TEST(check_ve_learn_sampling) {
+  struct config config = default_config;
+  config.ve_learn.enabled = true;
+  config.ve_learn.decimation = 4;
+  struct ve_learn state = { 0 };
+  drain_ve_learn_queue();
+  ve_learn_process(&config, &state);
+
+  /* Decimated */
+  for (int i = 0; i < 8; i++) {
+    sample_point(&config, &state, 3000, 80, 1.0f);
+  }
+  ve_learn_process(&config, &state);
+  ck_assert_int_eq(state.samples, 2);
+
+  /* Not learned during transients */
+  config.ve_learn.decimation = 1;
+  struct calculated_values calcs = { .ve = 50, .lambda = 1.0, .tipin = 10 };
+  struct engine_update update = {
+    .position = { .rpm = 3000 },
+    .sensors = { .MAP = { .value = 80 }, .CLT = { .value = 90 } },
+  };
+  ve_learn_sample(&config.ve_learn, &state, &update, &calcs);
+  calcs.tipin = 0;
+  update.sensors.TPS.derivative = 100;
+  ve_learn_sample(&config.ve_learn, &state, &update, &calcs);
+  update.sensors.TPS.derivative = 0;
+  update.sensors.EGO.fault = FAULT_RANGE;
+  ve_learn_sample(&config.ve_learn, &state, &update, &calcs);
+  ve_learn_process(&config, &state);
+  ck_assert_int_eq(state.samples, 2);
+
+  /* Samples are dropped when the queue is full */
+  for (int i = 0; i < VE_LEARN_QUEUE_SIZE + 4; i++) {
+    sample_point(&config, &state, 3000, 80, 1.0f);
+  }
+  ck_assert_int_eq(state.dropped, 5);
+  ve_learn_process(&config, &state);
+  ck_assert_int_eq(state.samples, 2 + VE_LEARN_QUEUE_SIZE - 1);
+}
+END_TEST
+
+TCase *setup_ve_learn_tests() {
+  TCase *tc = tcase_create("ve_learn");
+  tcase_add_test(tc, check_ve_learn_distribution);
+  tcase_add_test(tc, check_ve_learn_converges_and_commits);
+  tcase_add_test(tc, check_ve_learn_sampling);
+  return tc;
+}
+
+#endif
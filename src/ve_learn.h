@@ -0,0 +1,71 @@
+#ifndef VE_LEARN_H
+#define VE_LEARN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+#include "table.h"
+
+struct ve_learn_config {
+  bool enabled;
+  uint32_t min_rpm;
+  float min_clt;
+  float max_tps_rate;       /* Only learn at steady throttle (%/s) */
+  uint32_t decimation;      /* Calculation passes per sampled operating point */
+  float rate;               /* Fraction of the VE error corrected per sample */
+  float confidence_samples; /* Weighted samples for a cell to reach 63%
+                               confidence */
+  float min_confidence;     /* Cells below this confidence are not committed */
+};
+
+/* Operating point sampled from the calculation pass */
+struct ve_learn_point {
+  float rpm;
+  float map;
+  float ve;     /* VE fueled with, including closed-loop trims */
+  float lambda; /* Commanded lambda */
+  float ego;    /* Measured lambda */
+};
+
+/* Learning state. The learned table starts as a copy of the ve table and is
+ * only copied back when committed */
+struct ve_learn {
+  uint32_t passes; /* Calculation passes since the last sample */
+  uint32_t dropped;
+  uint32_t samples;
+
+  bool initialized;
+  struct table_2d table;
+  uint32_t hits[MAX_AXIS_SIZE][MAX_AXIS_SIZE];
+  float confidence[MAX_AXIS_SIZE][MAX_AXIS_SIZE];
+};
+
+struct config;
+struct engine_update;
+struct calculated_values;
+
+/* Queues the current operating point if it is suitable for learning. Called
+ * from the calculation pass */
+void ve_learn_sample(const struct ve_learn_config *config,
+                     struct ve_learn *state,
+                     const struct engine_update *update,
+                     const struct calculated_values *calcs);
+
+/* Learns from all queued operating points. Called outside of interrupt
+ * context */
+void ve_learn_process(const struct config *config, struct ve_learn *state);
+
+/* Copies learned cells with at least min_confidence into the ve table, returns
+ * the number of cells copied */
+uint32_t ve_learn_commit(struct config *config, struct ve_learn *state);
+
+/* Discards all learning, restarting from the current ve table */
+void ve_learn_reset(struct ve_learn *state);
+
+#ifdef UNITTEST
+#include <check.h>
+TCase *setup_ve_learn_tests(void);
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "console.h"
+#include "spans.h"
 #include "util.h"
 #include "viaems.h"
 
@@ -35,14 +36,28 @@ void viaems_reschedule(struct viaems *viaems,
                        struct platform_plan *plan) {
 
   const struct config *config = viaems->config;
+  uint32_t reschedule_start = span_start();
 
   // Run ancillary tasks
+  uint32_t start = span_start();
   run_tasks(viaems, u, plan);
+  span_end(SPAN_TASKS, start);
+
+  start = span_start();
+  update_closed_loop_lambda(viaems->config, u, &viaems->calculations);
 
   if (engine_position_is_synced(&u->position, u->current_time)) {
     struct calculated_values calcs =
       calculate_ignition_and_fuel(config, u, &viaems->calculations);
+    calcs.timing_advance += viaems->tasks.idle.timing_assist;
+    span_end(SPAN_CALCULATIONS, start);
+
+    viaems->last_calcs = calcs;
+    viaems->last_calcs_valid = !calculated_values_has_cuts(&calcs);
+
+    ve_learn_sample(&config->ve_learn, &viaems->ve_learn, u, &calcs);
 
+    start = span_start();
     if (calculated_values_has_cuts(&calcs)) {
       invalidate_scheduled_events(viaems->events, MAX_EVENTS);
     } else {
@@ -53,13 +68,48 @@ void viaems_reschedule(struct viaems *viaems,
                       MAX_EVENTS,
                       plan->schedulable_start);
     }
+    span_end(SPAN_SCHEDULE, start);
     record_engine_update(viaems, u, &calcs);
   } else {
+    span_end(SPAN_CALCULATIONS, start);
+    viaems->last_calcs_valid = false;
     invalidate_scheduled_events(viaems->events, MAX_EVENTS);
     record_engine_update(viaems, u, NULL);
   }
 
+  start = span_start();
+  populate_plan_from_events(plan, viaems->events);
+  span_end(SPAN_PLAN, start);
+  span_end(SPAN_RESCHEDULE, reschedule_start);
+}
+
+bool viaems_reschedule_on_trigger(struct viaems *viaems,
+                                  struct platform_plan *plan) {
+  const struct config *config = viaems->config;
+
+  if (!config->decoder.trigger_reschedule || !viaems->last_calcs_valid) {
+    return false;
+  }
+
+  struct engine_position pos = decoder_get_engine_position(&viaems->decoder);
+  if (!engine_position_is_synced(&pos, plan->schedulable_start)) {
+    return false;
+  }
+
+  /* Nothing in the plan has been output, so let the scheduler move it */
+  for (int i = 0; i < plan->n_events; i++) {
+    plan->schedule[i]->state = SCHED_SCHEDULED;
+  }
+
+  schedule_events(config,
+                  &viaems->last_calcs,
+                  &pos,
+                  viaems->events,
+                  MAX_EVENTS,
+                  plan->schedulable_start);
+
   populate_plan_from_events(plan, viaems->events);
+  return true;
 }
 
 void viaems_init(struct viaems *v, struct config *config) {
@@ -73,5 +123,91 @@ void viaems_init(struct viaems *v, struct config *config) {
 }
 
 void viaems_idle(struct viaems *viaems, timeval_t time) {
-  console_process(viaems->config, time);
+  sensors_process_knock(&viaems->sensors);
+  ve_learn_process(viaems->config, &viaems->ve_learn);
+  closed_loop_process_ltt(viaems->config, &viaems->calculations);
+  console_process(viaems, time);
+}
+
+#ifdef UNITTEST
+#include <check.h>
+
+static bool plan_contains(const struct platform_plan *plan,
+                          const struct schedule_entry *entry) {
+  for (int i = 0; i < plan->n_events; i++) {
+    if (plan->schedule[i] == entry) {
+      return true;
+    }
+  }
+  return false;
+}
+
+START_TEST(check_viaems_reschedule_on_trigger) {
+  struct config config = default_config;
+  struct viaems viaems;
+  viaems_init(&viaems, &config);
+
+  viaems.last_calcs = (struct calculated_values){
+    .timing_advance = 20,
+    .dwell_us = 1000,
+    .fueling_us = 1000,
+  };
+  viaems.last_calcs_valid = true;
+  viaems.decoder.output = (struct engine_position){
+    .time = 0,
+    .valid_until = 100000,
+    .has_position = true,
+    .has_rpm = true,
+    .rpm = 6000,
+    .tooth_rpm = 6000,
+    .last_trigger_angle = 0,
+  };
+
+  /* The next trigger arrives early, 10 degrees at 6000 rpm is 1111 ticks */
+  const timeval_t trigger_time = 400;
+  const timeval_t initial_start =
+    time_from_rpm_diff(6000, 100) - time_from_us(1000);
+  const timeval_t expected_start =
+    trigger_time + time_from_rpm_diff(6000, 90) - time_from_us(1000);
+
+  struct platform_plan plan = {
+    .schedulable_start = expected_start,
+    .schedulable_end = expected_start + 799,
+  };
+
+  /* Disabled by default */
+  ck_assert(!viaems_reschedule_on_trigger(&viaems, &plan));
+  ck_assert_int_eq(plan.n_events, 0);
+
+  config.decoder.trigger_reschedule = true;
+  ck_assert(viaems_reschedule_on_trigger(&viaems, &plan));
+  ck_assert(plan_contains(&plan, &viaems.events[1].start));
+  ck_assert_int_eq(viaems.events[1].start.time, initial_start);
+
+  /* Plan is submitted to the platform but not yet output */
+  for (int i = 0; i < plan.n_events; i++) {
+    plan.schedule[i]->state = SCHED_SUBMITTED;
+  }
+
+  viaems.decoder.output.time = trigger_time;
+  viaems.decoder.output.last_trigger_angle = 10;
+  ck_assert(viaems_reschedule_on_trigger(&viaems, &plan));
+  ck_assert(plan_contains(&plan, &viaems.events[1].start));
+  ck_assert_int_eq(viaems.events[1].start.state, SCHED_SCHEDULED);
+  ck_assert_int_eq(viaems.events[1].start.time, expected_start);
+
+  /* Nothing is changed if the last calculations had cuts */
+  viaems.last_calcs_valid = false;
+  viaems.decoder.output.time = 0;
+  viaems.decoder.output.last_trigger_angle = 0;
+  ck_assert(!viaems_reschedule_on_trigger(&viaems, &plan));
+  ck_assert_int_eq(viaems.events[1].start.time, expected_start);
+}
+END_TEST
+
+TCase *setup_viaems_tests() {
+  TCase *tc = tcase_create("viaems");
+  tcase_add_test(tc, check_viaems_reschedule_on_trigger);
+  return tc;
 }
+#endif
@@ -6,6 +6,7 @@
 #include "scheduler.h"
 #include "sensors.h"
 #include "tasks.h"
+#include "ve_learn.h"
 
 struct config;
 struct schedule_entry;
@@ -17,7 +18,12 @@ struct viaems {
   struct sensors sensors;
   struct calculations calculations;
   struct tasks tasks;
+  struct ve_learn ve_learn;
   struct output_event_schedule_state events[MAX_EVENTS];
+
+  /* Most recent calculations, reused to reschedule on each trigger */
+  struct calculated_values last_calcs;
+  bool last_calcs_valid;
 };
 
 /* Convenience struct representing the current engine state to run engine
@@ -37,7 +43,22 @@ void viaems_reschedule(struct viaems *viaems,
                        const struct engine_update *update,
                        struct platform_plan *plan);
 
+/* Lightweight partial reschedule run from trigger context when
+ * decoder.trigger_reschedule is enabled.  Events are rescheduled from the
+ * latest decoder position using the calculations from the last
+ * viaems_reschedule, and plan is repopulated.  The caller guarantees that
+ * none of the entries in plan have been output yet, as they are made mutable
+ * again.  Returns true if plan was changed.
+ */
+bool viaems_reschedule_on_trigger(struct viaems *viaems,
+                                  struct platform_plan *plan);
+
 void viaems_init(struct viaems *v, struct config *config);
 
 void viaems_idle(struct viaems *viaems, timeval_t now);
+
+#ifdef UNITTEST
+#include <check.h>
+TCase *setup_viaems_tests(void);
+#endif
 #endif
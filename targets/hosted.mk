@@ -1,6 +1,9 @@
 VPATH=src/platforms/${PLATFORM}
 
-OBJS+= hosted.o
+OBJS+= hosted.o \
+       feed_bench.o \
+       trace.o \
+       wall_film_sim.o
 
 CFLAGS+= -Og -DSUPPORTS_POSIX_TIMERS -Wno-error=unused-result
 CFLAGS+= -D TICKRATE=4000000 -D_POSIX_C_SOURCE=199309L -D_GNU_SOURCE
@@ -3,7 +3,7 @@ OBJS+= test.o
 CFLAGS+= $(shell pkg-config --cflags check)
 CFLAGS+= -Og
 CFLAGS+= -D TICKRATE=4000000 -DUNITTEST
-CFLAGS+= -fsanitize=undefined -fsanitize=address
+CFLAGS+= -fsanitize=undefined -fsanitize=address -pthread
 
 LDFLAGS+= $(shell pkg-config --libs check)
 